@@ -40,6 +40,14 @@ typedef void (*IO_Delay_Func)(uint32_t);
 typedef int16_t (*IO_Send_Func)(const uint8_t *cmd, uint16_t len, uint32_t timeout);
 typedef int16_t (*IO_Receive_Func)(uint8_t *data, uint16_t len, uint32_t timeout);
 
+/* A buffer of a scattered receive, filled in turn with the next len bytes */
+typedef struct {
+  uint8_t  *data;
+  uint16_t  len;
+} IO_Segment_t;
+
+typedef int16_t (*IO_ReceiveSegments_Func)(const IO_Segment_t *segments, uint8_t count, uint32_t timeout);
+
 
 /* Exported typedef ----------------------------------------------------------*/
 typedef enum {
@@ -227,12 +235,24 @@ typedef struct {
   uint8_t               Backlog;
 } ES_WIFI_Conn_t;
 
+/* Socket settings the module holds, so that a send or receive only issues
+   the setters whose value changed. ES_WIFI_STATE_UNKNOWN when not known. */
+#define ES_WIFI_STATE_UNKNOWN  0xFFFFFFFFU
+
+typedef struct {
+  uint32_t          Socket;          /* P0 */
+  uint32_t          SendTimeout;     /* S2 */
+  uint32_t          ReceiveLength;   /* R1 */
+  uint32_t          ReceiveTimeout;  /* R2 */
+} ES_WIFI_SocketState_t;
+
 typedef struct {
   IO_Init_Func       IO_Init;
   IO_DeInit_Func     IO_DeInit;
   IO_Delay_Func      IO_Delay;
   IO_Send_Func       IO_Send;
   IO_Receive_Func    IO_Receive;
+  IO_ReceiveSegments_Func IO_ReceiveSegments;
 } ES_WIFI_IO_t;
 
 typedef struct {
@@ -250,6 +270,9 @@ typedef struct {
   uint8_t            CmdData[ES_WIFI_DATA_SIZE];
   uint32_t           Timeout;
   uint32_t           BufferSize;
+  uint32_t           CommandCount; /* AT commands sent since power up */
+  ES_WIFI_SocketState_t SocketState;
+  uint32_t           SkippedCommandCount; /* setters not sent, the module held the value */
 } ES_WIFIObject_t;
 
 
@@ -329,7 +352,8 @@ ES_WIFI_Status_t  ES_WIFI_RegisterBusIO(ES_WIFIObject_t *Obj, IO_Init_Func    IO
                                                               IO_DeInit_Func  IO_DeInit,
                                                               IO_Delay_Func   IO_Delay,
                                                               IO_Send_Func    IO_Send,
-                                                              IO_Receive_Func IO_Receive);
+                                                              IO_Receive_Func IO_Receive,
+                                                              IO_ReceiveSegments_Func IO_ReceiveSegments);
 
 ES_WIFI_Status_t  ES_WIFI_StoreCreds( ES_WIFIObject_t *Obj,
                                       ES_WIFI_CredsFunction_t credsFunction, uint8_t credSet,
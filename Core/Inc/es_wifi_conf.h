@@ -25,6 +25,10 @@
 
 //#define WIFI_USE_CMSIS_OS
 
+/* Receive and send each command or payload in one DMA transfer on DMA2
+   channels 1 and 2, the calling task sleeps until it is done */
+#define ES_WIFI_USE_SPI_DMA                         1
+
 #ifdef WIFI_USE_CMSIS_OS
 #include "cmsis_os.h"
 
@@ -39,13 +43,24 @@ extern osMutexId es_wifi_mutex;
 #define SPI_INTERFACE_PRIO              configMAX_SYSCALL_INTERRUPT_PRIORITY
 #else
 
-#define LOCK_WIFI()
-#define UNLOCK_WIFI()
+/* one task at a time drives the module, the sockets of the others wait,
+   see es_wifi_io.c */
+void SPI_WIFI_LockBus(void);
+void SPI_WIFI_UnlockBus(void);
+
+#define LOCK_WIFI()             SPI_WIFI_LockBus()
+#define UNLOCK_WIFI()           SPI_WIFI_UnlockBus()
 #define LOCK_SPI()
 #define UNLOCK_SPI()
 #define SEM_SIGNAL(a)
+#if ES_WIFI_USE_SPI_DMA
+#include "FreeRTOSConfig.h"
+/* the SPI, DMA and data ready interrupts wake the waiting task */
+#define SPI_INTERFACE_PRIO              configLIBRARY_MAX_SYSCALL_INTERRUPT_PRIORITY
+#else
 #define SPI_INTERFACE_PRIO              0
 #endif
+#endif
 
 #define ES_WIFI_MAX_SSID_NAME_SIZE                  32
 #define ES_WIFI_MAX_PSWD_NAME_SIZE                  32
@@ -25,6 +25,26 @@
 
 /* Includes ------------------------------------------------------------------*/
 #include "stm32l4xx_hal.h"
+#include "es_wifi_conf.h"
+#include "es_wifi.h"
+
+/* Exported types ------------------------------------------------------------*/
+/* Transfer statistics, NSS low to high: the time the module takes to answer
+   is counted apart. Throughput is bytes over time, the CPU is busy for the
+   transfer time the calling task did not sleep. */
+typedef struct
+{
+  uint32_t RxTransfers;
+  uint32_t RxBytes;
+  uint32_t RxUs;
+  uint32_t TxTransfers;
+  uint32_t TxBytes;
+  uint32_t TxUs;
+  uint32_t DmaTransfers;     /* receives and sends moved by DMA */
+  uint32_t BlockedUs;        /* of RxUs and TxUs, the task slept */
+  uint32_t ReadyWaitMs;      /* waiting for CMD/DATA-READY to rise */
+  uint32_t ReadyBlockedMs;   /* of ReadyWaitMs, the task slept */
+} SPI_WIFI_Stats_t;
 
 /* Exported constants --------------------------------------------------------*/
 
@@ -53,9 +73,16 @@ int8_t  SPI_WIFI_DeInit(void);
 int8_t  SPI_WIFI_Init(uint16_t mode);
 int8_t  SPI_WIFI_ResetModule(void);
 int16_t SPI_WIFI_ReceiveData(uint8_t *pData, uint16_t len, uint32_t timeout);
+int16_t SPI_WIFI_ReceiveSegments(const IO_Segment_t *segments, uint8_t count, uint32_t timeout);
 int16_t SPI_WIFI_SendData(const uint8_t *pData, uint16_t len, uint32_t timeout);
 void    SPI_WIFI_Delay(uint32_t Delay);
 void    SPI_WIFI_ISR(void);
+void    SPI_WIFI_GetStats(SPI_WIFI_Stats_t *stats);
+
+#if ES_WIFI_USE_SPI_DMA
+extern DMA_HandleTypeDef hdma_spi3_rx;
+extern DMA_HandleTypeDef hdma_spi3_tx;
+#endif /* ES_WIFI_USE_SPI_DMA */
 
 #ifdef __cplusplus
 }
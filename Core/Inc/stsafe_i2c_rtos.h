@@ -0,0 +1,22 @@
+#ifndef INC_STSAFE_I2C_RTOS_H_
+#define INC_STSAFE_I2C_RTOS_H_
+
+#include <stdint.h>
+
+/*
+ * STSAFEA_HW_t bus binding for I2C2 that runs transfers in interrupt mode and
+ * blocks the calling task on a task notification until they complete. Delays
+ * (command processing waits and NACK back-off) yield with vTaskDelay.
+ * Selected in StSafeA_HW_Probe by STSAFEA_USE_RTOS_I2C_BUS.
+ *
+ * Before the scheduler is started every call falls back to the blocking BSP
+ * functions and HAL_Delay.
+ */
+
+int32_t stsafe_I2C_Init(void);
+int32_t stsafe_I2C_DeInit(void);
+int32_t stsafe_I2C_Send(uint16_t DevAddr, uint8_t *pData, uint16_t Length);
+int32_t stsafe_I2C_Recv(uint16_t DevAddr, uint8_t *pData, uint16_t Length);
+void stsafe_Delay(uint32_t msDelay);
+
+#endif /* INC_STSAFE_I2C_RTOS_H_ */
@@ -9,16 +9,78 @@
 
 #include "transport_interface.h"
 
+// Local envelope limits: data is a non-zero multiple of 8 bytes, the envelope
+// (AES key wrap) is 8 bytes longer
+#define STSAFE_ENVELOPE_MAX_DATA_SIZE 480U
+#define STSAFE_ENVELOPE_OVERHEAD 8U
+
+typedef struct
+{
+	uint32_t pregenerated; // key pairs generated ahead of a handshake
+	uint32_t hits; // handshakes that found a ready key pair
+	uint32_t misses; // handshakes that had to generate inline
+	uint32_t invalidated; // ready key pairs dropped by an init or reset
+	uint32_t savedMs; // total key generation time moved off the handshake
+} EphemeralKeyStats_t;
+
+/*
+ * Handshake time spent on STSAFE requests made by the PK callbacks. While the
+ * chip works the connecting task first reads ahead on the socket and then
+ * blocks, so overlappedMs + blockedMs == chipMs.
+ */
+typedef struct
+{
+	uint32_t calls;
+	uint32_t chipMs; // from posting the request to its completion
+	uint32_t overlappedMs; // reading ahead on the socket
+	uint32_t blockedMs; // blocked, the CPU is free for other tasks
+	uint32_t prefetchedBytes; // read ahead while the chip was busy
+} PkCallStats_t;
+
+typedef enum
+{
+	CRYPTO_ENGINE_STSAFE, CRYPTO_ENGINE_HOST
+} CryptoEngine_t;
+
+typedef enum
+{
+	CRYPTO_OP_VERIFY_HOST, // peer signatures verified by wolfCrypt
+	CRYPTO_OP_VERIFY_STSAFE, // peer signatures verified by the chip
+	CRYPTO_OP_SIGN, // slot 0 key, always on the chip
+	CRYPTO_OP_KEYGEN, // TLS 1.3 key share in the EPHEMERAL slot, on the chip
+	CRYPTO_OP_ECDH, // EPHEMERAL slot key, always on the chip
+	CRYPTO_OP_COUNT
+} CryptoOperation_t;
+
+typedef struct
+{
+	uint32_t count;
+	uint32_t totalMs;
+	uint32_t maxMs;
+} CryptoOperationStats_t;
+
+typedef struct
+{
+	CryptoEngine_t verifyEngine; // where peer signatures currently go
+	uint32_t hostVerifyMs; // boot benchmark averages, 0 until calibrated
+	uint32_t stsafeVerifyMs;
+	CryptoOperationStats_t operations[CRYPTO_OP_COUNT];
+} CryptoDispatchStats_t;
+
 bool stsafea_init(StSafeA_Handle_t *stsafea_handle,
 		uint8_t *a_rx_tx_stsafea_data);
 
-bool stsafea_load_client_cert(StSafeA_Handle_t *stsafea_handle,
-		NetworkCredentials_t *NetworkCredentials);
+bool stsafea_load_client_cert(NetworkCredentials_t *NetworkCredentials);
 
 int stsafe_VerifyPeerCertCb(WOLFSSL *ssl, const unsigned char *sig,
 		unsigned int sigSz, const unsigned char *hash, unsigned int hashSz,
 		const unsigned char *keyDer, unsigned int keySz, int *result, void *ctx);
 
+// TLS 1.3 key share: the key pair is made in the EPHEMERAL slot and only its
+// public point is handed to wolfSSL, stsafe_SharedSecretCb then uses the slot
+int stsafe_KeyGenCb(WOLFSSL *ssl, ecc_key *key, unsigned int keySz,
+		int ecc_curve, void *ctx);
+
 int stsafe_SharedSecretCb(WOLFSSL *ssl, ecc_key *otherKey,
 		unsigned char *pubKeyDer, unsigned int *pubKeySz, unsigned char *out,
 		unsigned int *outlen, int side, void *ctx);
@@ -27,6 +89,38 @@ int stsafe_SignCertificateCb(WOLFSSL *ssl, const unsigned char *in,
 		unsigned int inSz, unsigned char *out, unsigned int *outSz,
 		const unsigned char *key, unsigned int keySz, void *ctx);
 
+// Ephemeral key readiness -- the key pair used by stsafe_SharedSecretCb.
+// Prepare queues a background generation and returns whether a key is ready.
+bool stsafe_EphemeralKeyPrepare(void);
+void stsafe_EphemeralKeyInvalidate(void);
+// At the end of every handshake, drops a key share key it did not use and
+// queues a new key
+void stsafe_EphemeralKeyAbandon(void);
+void stsafe_GetEphemeralKeyStats(EphemeralKeyStats_t *stats);
+
+// Fills output with random bytes from the chip, length is at most 255
+bool stsafe_GenerateRandom(uint8_t *output, uint8_t length);
+
+// Wraps and unwraps with the local envelope key in slot 0. The key is generated
+// on the chip the first time it is needed and never leaves it.
+bool stsafe_WrapEnvelope(const uint8_t *data, uint16_t length,
+		uint8_t *envelope);
+bool stsafe_UnwrapEnvelope(const uint8_t *envelope, uint16_t length,
+		uint8_t *data);
+
+// Signs a SHA-256 digest with the slot 0 private key, r and s are 32 bytes each
+bool stsafe_SignDigest(const uint8_t *digest, uint8_t *signatureR,
+		uint8_t *signatureS);
+
+// Only meaningful between handshakes, the MQTT task is the one updating them
+void stsafe_ResetPkCallStats(void);
+void stsafe_GetPkCallStats(PkCallStats_t *stats);
+
+// Public key only operations go to the faster engine, measured once at boot.
+// Calibrate needs the STSAFE service to be ready and runs only the first time.
+void stsafe_DispatchCalibrate(void);
+void stsafe_GetDispatchStats(CryptoDispatchStats_t *stats);
+
 void stsafe_SetupPkCallbacks(NetworkContext_t *NetworkContext);
 void stsafe_SetupPkCallbacksContext(NetworkContext_t *NetworkContext);
 
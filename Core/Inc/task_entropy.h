@@ -0,0 +1,37 @@
+#ifndef INC_TASK_ENTROPY_H_
+#define INC_TASK_ENTROPY_H_
+
+#include "main.h"
+
+/*
+ * Pool of conditioned random bytes, kept filled by the entropy task from the
+ * STM32 RNG and the STSAFE. Readers never wait on I/O: they either get bytes
+ * from the pool or, when it has run dry, straight from the STM32 RNG.
+ *
+ * The pool is a lock-free ring with a single writer (the entropy task) and
+ * any number of readers.
+ */
+
+// Must be a power of two
+#define ENTROPY_POOL_SIZE 256U
+
+typedef struct
+{
+	uint32_t fillLevel; // bytes in the pool right now
+	uint32_t minFillLevel; // lowest fill level seen by a reader
+	uint32_t produced; // conditioned bytes added to the pool
+	uint32_t consumed; // bytes handed out from the pool
+	uint32_t starvations; // reads the pool could not cover
+	uint32_t stsafeFailures; // refills done without STSAFE bytes
+	uint32_t rngFailures; // refills dropped, the STM32 RNG failed
+} EntropyStats_t;
+
+void RunTaskEntropy(GlobalState *globalState);
+
+bool entropy_Read(uint8_t *output, size_t length);
+void entropy_GetStats(EntropyStats_t *stats);
+
+// wolfSSL CUSTOM_RAND_GENERATE_SEED, returns 0 on success
+int entropy_GenerateSeed(unsigned char *output, unsigned int sz);
+
+#endif /* INC_TASK_ENTROPY_H_ */
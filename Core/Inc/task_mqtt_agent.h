@@ -5,6 +5,21 @@
 
 #define TASK_MQTT_AGENT_USE_TLS 1
 
+// Keeps a spare connection ready when the broker is slow to answer the
+// keep-alive and for the planned reconnects, see RequestMQTTReconnect. Costs
+// about 13 KB of RAM, a second network context and an 8 KB task stack, and
+// the TLS pools hold two connections for it, see Core/Inc/tls_memory.h. 0
+// leaves them out.
+#define TASK_MQTT_AGENT_USE_STANDBY 1
+
 void ConnectAndStartMQTTAgentTask(GlobalState* globalState);
 
+#if TASK_MQTT_AGENT_USE_STANDBY
+// Reconnects to the broker without dropping the session first: a new
+// connection is opened on a spare socket while the current one keeps serving,
+// then the agent switches over between two commands. Returns false before the
+// agent runs.
+bool RequestMQTTReconnect(void);
+#endif
+
 #endif /* INC_TASK_MQTT_AGENT_H_ */
@@ -0,0 +1,58 @@
+#ifndef INC_TASK_STSAFE_H_
+#define INC_TASK_STSAFE_H_
+
+#include "main.h"
+#include "FreeRTOS.h"
+#include "task.h"
+
+#include "stsafea_core.h"
+
+/*
+ * The STSAFE task is the only one that talks to the chip. Other tasks hand it
+ * operations through stsafe_ServiceCall (blocking) or stsafe_ServicePost
+ * (completion callback). Handshake requests are always served before
+ * background ones; a request that is already running is never preempted.
+ */
+
+typedef enum
+{
+	STSAFE_PRIORITY_HANDSHAKE, // sign, verify, key establishment, cert read
+	STSAFE_PRIORITY_BACKGROUND // random generation, key pre-generation, counters
+} StsafePriority_t;
+
+typedef struct StsafeRequest StsafeRequest_t;
+
+// Runs in the STSAFE task with the shared handle
+typedef StSafeA_ResponseCode_t (*StsafeOperation_t)(StSafeA_Handle_t *handle,
+		void *args);
+// Runs in the STSAFE task once the operation has returned
+typedef void (*StsafeCompletion_t)(StsafeRequest_t *request);
+
+struct StsafeRequest
+{
+	StsafeOperation_t operation;
+	void *args;
+	StsafeCompletion_t onComplete; // optional
+	TaskHandle_t waitingTask; // set by stsafe_ServiceCall
+	StSafeA_ResponseCode_t result;
+	volatile bool done; // set last, the request is no longer used after it
+};
+
+void stsafe_ServiceInit(void);
+void RunTaskSTSAFE(GlobalState *globalState);
+
+bool stsafe_ServiceWaitReady(uint32_t timeoutMs);
+
+// The request must stay valid until its completion callback has run
+bool stsafe_ServicePost(StsafePriority_t priority, StsafeRequest_t *request);
+StSafeA_ResponseCode_t stsafe_ServiceCall(StsafePriority_t priority,
+		StsafeOperation_t operation, void *args);
+
+// stsafe_ServiceCall in two halves, the caller may do other work in between.
+// A started request must be finished with stsafe_ServiceWait.
+bool stsafe_ServiceStart(StsafePriority_t priority, StsafeRequest_t *request,
+		StsafeOperation_t operation, void *args);
+bool stsafe_ServiceIsDone(const StsafeRequest_t *request);
+StSafeA_ResponseCode_t stsafe_ServiceWait(StsafeRequest_t *request);
+
+#endif /* INC_TASK_STSAFE_H_ */
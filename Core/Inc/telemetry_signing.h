@@ -0,0 +1,48 @@
+#ifndef INC_TELEMETRY_SIGNING_H_
+#define INC_TELEMETRY_SIGNING_H_
+
+#include "main.h"
+
+/*
+ * Merkle batched telemetry signing. Every published payload becomes a leaf,
+ * and once a batch is full only its root is signed by the STSAFE slot 0 key.
+ *
+ *   leaf = SHA-256(0x00 || payload)
+ *   node = SHA-256(0x01 || left || right)
+ *
+ * A node without a sibling is carried up to the next level unchanged.
+ * Tools/verify_telemetry.py checks published batches against the device
+ * certificate.
+ */
+
+// Messages per signed root, one STSAFE signature per batch
+#define TELEMETRY_SIGNING_BATCH_SIZE 8
+// Sibling hashes in a proof, ceil(log2(TELEMETRY_SIGNING_BATCH_SIZE))
+#define TELEMETRY_SIGNING_MAX_PROOF_LENGTH 3
+
+#define TELEMETRY_SIGNING_HASH_SIZE 32
+
+typedef struct
+{
+	uint32_t batchId;
+	uint8_t count;
+	uint8_t leaves[TELEMETRY_SIGNING_BATCH_SIZE][TELEMETRY_SIGNING_HASH_SIZE];
+	uint8_t root[TELEMETRY_SIGNING_HASH_SIZE];
+	uint8_t signatureR[TELEMETRY_SIGNING_HASH_SIZE];
+	uint8_t signatureS[TELEMETRY_SIGNING_HASH_SIZE];
+} TelemetryBatch_t;
+
+void TelemetryBatch_Init(TelemetryBatch_t *batch, uint32_t batchId);
+
+// Returns true once the batch is full
+bool TelemetryBatch_Add(TelemetryBatch_t *batch, const uint8_t *payload,
+		size_t payloadLength);
+
+// Computes the root and has the STSAFE sign it
+bool TelemetryBatch_Seal(TelemetryBatch_t *batch);
+
+// Returns the number of sibling hashes written to proof, leaf level first
+uint8_t TelemetryBatch_Proof(const TelemetryBatch_t *batch, uint8_t index,
+		uint8_t proof[TELEMETRY_SIGNING_MAX_PROOF_LENGTH][TELEMETRY_SIGNING_HASH_SIZE]);
+
+#endif /* INC_TELEMETRY_SIGNING_H_ */
@@ -0,0 +1,44 @@
+#ifndef INC_TLS_MEMORY_H_
+#define INC_TLS_MEMORY_H_
+
+#include <stdint.h>
+#include <stdbool.h>
+
+#include "wolfssl/wolfcrypt/settings.h"
+#include "wolfssl/ssl.h"
+
+/*
+ * wolfSSL memory, served from fixed bucket pools in the TLSPOOL RAM region
+ * instead of the FreeRTOS heap:
+ *
+ * - general pool: every allocation made without a heap hint (wolfCrypt calls
+ *   outside a connection, the stored TLS session), set as the global hint
+ * - session pool: the WOLFSSL_CTX and everything a connection allocates,
+ *   with its record buffers when TLS_MAX_FRAGMENT_LENGTH keeps them small
+ * - I/O pool: only with TLS_MAX_FRAGMENT_LENGTH 0, fixed 16 KB input and
+ *   output record buffers for each connection on the session heap
+ *
+ * The bucket sizes and counts come from Core/Inc/tls_memory_buckets.h, which
+ * Tools/tls_memory_buckets.py writes from a trace recorded with
+ * TLS_MEMORY_TRACE set to 1 in the wolfSSL configuration.
+ */
+
+// Connections that can be set up at the same time on the session heap: the
+// MQTT session and the one that replaces it, see Core/Inc/transport_socket.h
+#define TLS_MEMORY_MAX_CONNECTIONS 2U
+
+// Carves the pools and sets the general pool as the global heap hint. Must
+// run before the scheduler starts, an allocation made on the FreeRTOS heap
+// must not be freed to a pool.
+bool TLSMemory_Init(void);
+
+// Heap to create the WOLFSSL_CTX on, NULL if TLSMemory_Init failed
+WOLFSSL_HEAP_HINT* TLSMemory_SessionHeap(void);
+
+// Peak memory of a connection, before it is freed
+void TLSMemory_LogConnection(WOLFSSL *ssl);
+
+// Blocks per bucket, peak in use and in use now for both pools
+void TLSMemory_LogUsage(void);
+
+#endif /* INC_TLS_MEMORY_H_ */
@@ -0,0 +1,30 @@
+#ifndef INC_TLS_MEMORY_BUCKETS_H_
+#define INC_TLS_MEMORY_BUCKETS_H_
+
+/*
+ * Bucket layout of the wolfSSL pools, see Core/Inc/tls_memory.h. Written by
+ * Tools/tls_memory_buckets.py from a TLS_MEMORY_TRACE log: sizes in bytes,
+ * the number of blocks of each size, and the bytes the blocks take with
+ * TLS_MEMORY_BUCKET_PADDING bytes of bookkeeping each.
+ *
+ * Trace: Tools/tls_memory_trace on an x86-64 host, an upper bound for the
+ * target whose structures are no larger. Two live connections: a TLS 1.3 full
+ * handshake with chain validation, then four rounds of a PSK resumption and a
+ * pinned full handshake, each opened while the other connection is up. ECDSA
+ * P-256 chain, no 0-RTT, 25% more blocks than the peak
+ */
+
+// wolfSSL_MemoryPaddingSz() on the target, a host build sets its own
+#ifndef TLS_MEMORY_BUCKET_PADDING
+#define TLS_MEMORY_BUCKET_PADDING 16U
+#endif
+
+#define TLS_MEMORY_GENERAL_BUCKETS 288, 592, 5920
+#define TLS_MEMORY_GENERAL_DIST 27, 29, 3
+#define TLS_MEMORY_GENERAL_BLOCKS_SIZE 43648U
+
+#define TLS_MEMORY_SESSION_BUCKETS 32, 80, 160, 352, 608, 1280, 1616, 2160, 3376
+#define TLS_MEMORY_SESSION_DIST 33, 12, 17, 4, 13, 3, 3, 3, 2
+#define TLS_MEMORY_SESSION_BLOCKS_SIZE 37408U
+
+#endif /* INC_TLS_MEMORY_BUCKETS_H_ */
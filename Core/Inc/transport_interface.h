@@ -40,12 +40,27 @@
 #include "stsafea_core.h"
 #include "stsafea_service.h"
 
+#include "es_wifi.h"
+#include "transport_readahead.h"
+#include "transport_pin.h"
+
 #define STSAFEA_NUMBER_OF_BYTES_TO_GET_CERTIFICATE_SIZE 4
 #define STSAFEA_MAX_CERTIFICATE_SIZE                    500U
 
 #define WIFI_SEND_TIMEOUT 1000U
 #define WIFI_RECV_TIMEOUT 1000U
 
+// An MQTT packet gathered by the writev functions. Leaves room for the TLS
+// record header, nonce and tag within one ES_WIFI_PAYLOAD_SIZE AT send.
+#define TRANSPORT_WRITEV_BUFFER_SIZE 1152U
+
+// MQTT bytes held back on a TLS 1.3 resumption and sent as 0-RTT data, room
+// for a CONNECT with its client identifier
+#define TLS_EARLY_DATA_BUFFER_SIZE 256U
+
+// Handshake records sent by wolfSSL in a row go out in one AT send
+#define TLS_SEND_STAGING_SIZE ES_WIFI_PAYLOAD_SIZE
+
 /* *INDENT-OFF* */
 #ifdef __cplusplus
     extern "C" {
@@ -196,9 +211,25 @@ typedef struct SSLContext
 {
 	WOLFSSL_CTX *ctx; // wolfSSL context
 	WOLFSSL *ssl; // wolfSSL ssl session context
-
-	StSafeA_Handle_t stsafea_handle;
-	uint8_t a_rx_tx_stsafea_data[STSAFEA_BUFFER_MAX_SIZE];
+	// handshake records held back until wolfSSL reads, see tlsFlushSends
+	uint8_t sendStaging[TLS_SEND_STAGING_SIZE];
+	uint16_t sendStagingLength;
+	uint16_t handshakeWrites; // records wolfSSL wrote during the handshake
+	uint16_t handshakeSends; // AT sends they took
+	// resumed handshake left for the first read, see tlsFinishEarlyData
+	bool earlyDataPending;
+	uint8_t earlyData[TLS_EARLY_DATA_BUFFER_SIZE];
+	uint16_t earlyDataLength;
+	// a stored session was offered, see tlsHandshakeFailed
+	bool resumptionOffered;
+	uint32_t handshakeStart;
+	uint32_t handshakeCommands; // AT command count when the handshake started
+	TLSPinCheck_t pinCheck;
+	// application data after the handshake, logged at disconnect
+	uint32_t appWrites; // wolfSSL_write calls
+	uint32_t appBytes;
+	uint32_t appWriteMs; // spent in wolfSSL_write, the AT sends included
+	uint32_t appSends; // records handed to the module
 } SSLContext_t;
 
 /**
@@ -211,9 +242,11 @@ typedef struct SSLContext
 /* @[define_networkcontext] */
 struct NetworkContext
 {
-	uint32_t socket;
+	uint32_t socket; // from the socket pool, SOCKET_POOL_NONE while closed
 	bool isSSL;
 	SSLContext_t sslContext;
+	ReadAhead_t readAhead;
+	uint8_t writevBuffer[TRANSPORT_WRITEV_BUFFER_SIZE];
 };
 typedef struct NetworkContext NetworkContext_t;
 /* @[define_networkcontext] */
@@ -378,6 +411,14 @@ int32_t PlaintextSend(NetworkContext_t *NetworkContext, const void *Buffer,
 int32_t PlaintextRecv(NetworkContext_t *NetworkContext, void *Buffer,
 		size_t bytesToRecv);
 
+int32_t PlaintextWritev(NetworkContext_t *NetworkContext,
+		TransportOutVector_t *pIoVec, size_t ioVecCount);
+
+// Copies the vectors, as far as they fit, into the writev buffer and returns
+// the number of bytes gathered
+size_t WritevGather(NetworkContext_t *NetworkContext,
+		const TransportOutVector_t *pIoVec, size_t ioVecCount);
+
 void InitPlainTextTransport(NetworkContext_t *NetworkContext,
 		TransportInterface_t *Transport);
 
@@ -400,6 +441,13 @@ int32_t TLSSend(NetworkContext_t *NetworkContext, const void *Buffer,
 int32_t TLSRecv(NetworkContext_t *NetworkContext, void *Buffer,
 		size_t bytesToRecv);
 
+int32_t TLSWritev(NetworkContext_t *NetworkContext,
+		TransportOutVector_t *pIoVec, size_t ioVecCount);
+
+// Reads whatever the socket already holds into the read-ahead buffer without
+// waiting, returns the number of bytes read or -1 on a socket error
+int32_t TLSHandshakePrefetch(NetworkContext_t *NetworkContext);
+
 bool LoadTLSCredentials(NetworkCredentials_t *NetworkCredentials,
 		NetworkContext_t *NetworkContext);
 
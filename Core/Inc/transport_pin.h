@@ -0,0 +1,67 @@
+#ifndef INC_TRANSPORT_PIN_H_
+#define INC_TRANSPORT_PIN_H_
+
+#include <stdint.h>
+#include <stdbool.h>
+
+#include "wolfssl/wolfcrypt/settings.h"
+#include "wolfssl/ssl.h"
+#include "wolfssl/wolfcrypt/sha256.h"
+
+/*
+ * Server key pinning. After a handshake that validated the broker's chain in
+ * full, the SHA-256 of the leaf public key and of the chain as presented are
+ * kept in RAM. Later full handshakes with the same host, until the pin
+ * expires, parse the certificates without looking up the CA or checking
+ * their signatures: the leaf key must match the pin and the handshake
+ * signature is still verified with it. A key that does not match fails the
+ * handshake and drops the pin, TLSWiFiConnect then connects again and
+ * validates the chain.
+ */
+
+// Uptime after which a pin is dropped and the chain validated again
+#define TLS_PIN_LIFETIME_MS (24U * 60U * 60U * 1000U)
+
+// Per connection state, filled by TLSPin_Apply and the verify callback
+typedef struct
+{
+	bool pinned; // the chain is not validated, the leaf key must match
+	bool matched;
+	bool mismatched; // another key was presented, the pin has been dropped
+	bool validated; // the chain was validated in full, the hashes are its own
+	uint8_t hostHash[WC_SHA256_DIGEST_SIZE];
+	uint8_t keyHash[WC_SHA256_DIGEST_SIZE];
+	uint8_t chainHash[WC_SHA256_DIGEST_SIZE];
+	// peer signature verifies, when the handshake started and for the chain
+	uint32_t startVerifies;
+	uint32_t startVerifyMs;
+	uint32_t chainVerifies;
+	uint32_t chainVerifyMs;
+} TLSPinCheck_t;
+
+typedef struct
+{
+	uint32_t validations; // chains validated in full and pinned
+	uint32_t pinnedHandshakes;
+	uint32_t verifiesAvoided;
+	uint32_t msSaved; // chain verify time of the validation that made the pin
+	uint32_t keyMismatches;
+	uint32_t chainChanges; // same key in a chain that differs from the pinned one
+	uint32_t expirations;
+} TLSPinStats_t;
+
+// Before wolfSSL_connect: with a live pin for the host the chain is not
+// validated on this connection, only the leaf key is checked against the pin
+void TLSPin_Apply(WOLFSSL *ssl, const char *hostName, TLSPinCheck_t *check);
+
+// After a successful handshake: pins the key of a chain that was validated in
+// full, counts the work a pinned one saved. Returns false, and drops the pin,
+// when a pinned full handshake never presented the pinned key.
+bool TLSPin_Update(WOLFSSL *ssl, TLSPinCheck_t *check);
+
+// Drops the pin, the next handshake validates the chain
+void TLSPin_Forget(void);
+
+void TLSPin_GetStats(TLSPinStats_t *stats);
+
+#endif /* INC_TRANSPORT_PIN_H_ */
@@ -0,0 +1,50 @@
+#ifndef INC_TRANSPORT_READAHEAD_H_
+#define INC_TRANSPORT_READAHEAD_H_
+
+#include <stdint.h>
+#include <stdbool.h>
+
+#include "wifi.h"
+
+/*
+ * Per socket read-ahead between the transport receive functions and the WiFi
+ * driver. Every receive over SPI costs at least one AT command whatever its
+ * size, four when the socket settings change, so the socket is asked for as
+ * much as fits (up to ES_WIFI_PAYLOAD_SIZE) and the small reads that follow,
+ * like a TLS record header and then its body, are served from memory.
+ */
+
+// Must be a power of two and hold at least one ES_WIFI_PAYLOAD_SIZE receive
+#define READAHEAD_SIZE 2048U
+
+typedef struct
+{
+	uint8_t buffer[READAHEAD_SIZE];
+	// free-running, the fill level is write - read
+	uint32_t read;
+	uint32_t write;
+} ReadAhead_t;
+
+typedef struct
+{
+	uint32_t reads; // receive calls served
+	uint32_t readsFromMemory; // served without asking the module
+	uint32_t moduleReceives; // receives sent to the module
+	uint32_t bytesReceived;
+} ReadAheadStats_t;
+
+// Drops whatever was read ahead, when a socket is (re)opened
+void ReadAhead_Reset(ReadAhead_t *readAhead);
+
+// WIFI_ReceiveData with the same arguments and results, served from memory
+// when bytes were read ahead
+WIFI_Status_t ReadAhead_Receive(ReadAhead_t *readAhead, uint32_t socket,
+		uint8_t *pdata, uint16_t Reqlen, uint16_t *RcvDatalen, uint32_t Timeout);
+
+// Polls the socket for more bytes without waiting for them, returns the number
+// of bytes read ahead or -1 on a socket error
+int32_t ReadAhead_Fill(ReadAhead_t *readAhead, uint32_t socket);
+
+void ReadAhead_GetStats(ReadAheadStats_t *stats);
+
+#endif /* INC_TRANSPORT_READAHEAD_H_ */
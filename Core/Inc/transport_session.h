@@ -0,0 +1,47 @@
+#ifndef INC_TRANSPORT_SESSION_H_
+#define INC_TRANSPORT_SESSION_H_
+
+#include "main.h"
+
+#include "wolfssl/ssl.h"
+
+/*
+ * TLS session resumption across reconnects and reboots. The resumable session
+ * is kept in RAM and, wrapped by the STSAFE local envelope key, in the last
+ * flash page. The master secret is never written to flash in the clear.
+ */
+
+typedef struct
+{
+	uint32_t fullHandshakes;
+	uint32_t fullTotalMs;
+	uint32_t resumedHandshakes;
+	uint32_t resumedTotalMs;
+	uint32_t restoreFailures; // stored sessions that could not be unwrapped
+	uint32_t saves; // flash writes
+	uint32_t savesDeferred; // changed sessions left in RAM, see session_Persist
+	uint32_t saveFailures;
+} TLSSessionStats_t;
+
+// Registers the callback that keeps every new session and persists it when it
+// changes: at the end of a TLS 1.2 handshake, on each NewSessionTicket with
+// TLS 1.3
+void TLSSession_SetupContext(WOLFSSL_CTX *ctx);
+
+// Offers the stored session to the server, before wolfSSL_connect. Returns
+// whether a session is being resumed.
+bool TLSSession_Apply(WOLFSSL *ssl);
+
+// Early data the server allows on the session offered by TLSSession_Apply,
+// from its TLS 1.3 ticket. 0 when there is no such ticket.
+uint32_t TLSSession_EarlyDataLimit(const WOLFSSL *ssl);
+
+// After a successful handshake, counts it as full or resumed
+void TLSSession_Update(WOLFSSL *ssl, uint32_t handshakeMs);
+
+// Drops the session in RAM and in flash
+void TLSSession_Forget(void);
+
+void TLSSession_GetStats(TLSSessionStats_t *stats);
+
+#endif /* INC_TRANSPORT_SESSION_H_ */
@@ -0,0 +1,54 @@
+#ifndef INC_TRANSPORT_SOCKET_H_
+#define INC_TRANSPORT_SOCKET_H_
+
+#include <stdint.h>
+#include <stdbool.h>
+
+/*
+ * Sockets of the ES-WiFi module. The ISM43362 keeps up to four client
+ * connections, sockets 0 to 3, behind the one SPI bus. A connection takes a
+ * free socket before it opens and gives it back once it is closed, so the MQTT
+ * session can stay up while another connection is made. The AT commands of
+ * the sockets are serialized by LOCK_WIFI, each command sequence selects its
+ * socket first.
+ */
+
+#define SOCKET_POOL_SIZE 4U
+
+// Held by a connection that has no socket
+#define SOCKET_POOL_NONE 0xFFFFFFFFU
+
+typedef enum
+{
+	SOCKET_FREE = 0,
+	SOCKET_ALLOCATED, // handed out, not connected
+	SOCKET_CONNECTED
+} SocketState_t;
+
+typedef struct
+{
+	uint32_t allocations;
+	uint32_t exhausted; // allocations that found every socket taken
+	uint32_t inUse;
+	uint32_t peakInUse;
+} SocketPoolStats_t;
+
+// Takes a free socket for the owner, a name kept for the log. Returns
+// SOCKET_POOL_NONE when every socket is taken. From tasks only.
+uint32_t SocketPool_Allocate(const char *owner);
+
+// Marks an allocated socket connected or closed
+void SocketPool_SetConnected(uint32_t socket, bool connected);
+
+// Gives the socket back, its connection must be closed. SOCKET_POOL_NONE is
+// ignored.
+void SocketPool_Release(uint32_t socket);
+
+SocketState_t SocketPool_GetState(uint32_t socket);
+
+void SocketPool_GetStats(SocketPoolStats_t *stats);
+
+// A line per socket that is not free
+void SocketPool_LogUsage(void);
+
+#endif /* INC_TRANSPORT_SOCKET_H_ */
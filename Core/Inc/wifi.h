@@ -161,6 +161,8 @@ WIFI_Status_t WIFI_ModuleFirmwareUpdate(const char *url);
 WIFI_Status_t WIFI_GetModuleID(char *Id, uint8_t IdLength);
 WIFI_Status_t WIFI_GetModuleFwRevision(char *rev, uint8_t RevLength);
 WIFI_Status_t WIFI_GetModuleName(char *ModuleName, uint8_t ModuleNameLength);
+uint32_t WIFI_GetCommandCount(void);
+uint32_t WIFI_GetSkippedCommandCount(void);
 #ifdef __cplusplus
 }
 #endif
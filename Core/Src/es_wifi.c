@@ -41,8 +41,12 @@
 
 #define AT_ERROR_STRING "\r\nERROR"
 
-#define AT_DELIMETER_STRING "\r\n> "
-#define AT_DELIMETER_LEN        4
+#define AT_PADDING_CHAR         0x15
+
+/* R0 response around the payload: the leading "\r\n", then room for the
+   trailing AT_OK_STRING, its padding and anything past the requested length */
+#define AT_RECEIVE_HEAD_LEN     2
+#define AT_RECEIVE_TAIL_LEN     16
 
 /* This is equivalent to version 3.5.2.5 */
 #define UPDATED_SCAN_PARAMETERS_FW_REV (0x03050205)
@@ -81,10 +85,15 @@ static void AT_ParsePing(int32_t res[], uint32_t count, char *pdata);
 
 
 static ES_WIFI_Status_t AT_ExecuteCommand(ES_WIFIObject_t *Obj, const uint8_t *cmd, uint8_t *pdata);
+static bool AT_EndsWithOK(const uint8_t *pdata, int16_t len);
 static ES_WIFI_Status_t AT_RequestSendData(ES_WIFIObject_t *Obj, uint8_t* cmd,
                                            const uint8_t *pcmd_data, uint16_t len, uint8_t *pdata);
 static ES_WIFI_Status_t AT_RequestReceiveData(ES_WIFIObject_t *Obj, uint8_t *cmd,
                                               char *pdata, uint16_t Reqlen, uint16_t *ReadData);
+static void AT_ForgetSocketState(ES_WIFIObject_t *Obj);
+static ES_WIFI_Status_t AT_SetSocketState(ES_WIFIObject_t *Obj, const char *Setter,
+                                          uint32_t *Held, uint32_t Value);
+static ES_WIFI_Status_t AT_SelectSocket(ES_WIFIObject_t *Obj, uint8_t Socket);
 
 uint32_t HAL_GetTick(void);
 
@@ -713,6 +722,24 @@ static void AT_ParsePing(int32_t res[], uint32_t count, char *pdata)
 
 
 
+/**
+  * @brief  Check that a response ends with AT_OK_STRING, looking only at its
+  *         end: the module pads a response to whole words with 0x15.
+  * @param  pdata: pointer to the response
+  * @param  len: response length
+  * @retval true for an OK response.
+  */
+static bool AT_EndsWithOK(const uint8_t *pdata, int16_t len)
+{
+  while ((len > 0) && (pdata[len - 1] == AT_PADDING_CHAR))
+  {
+    len--;
+  }
+
+  return (len >= (int16_t)AT_OK_STRING_LEN) &&
+         (memcmp(pdata + len - AT_OK_STRING_LEN, AT_OK_STRING, AT_OK_STRING_LEN) == 0);
+}
+
 /**
   * @brief  Execute AT command.
   * @param  Obj: pointer to the module handle
@@ -726,6 +753,7 @@ static ES_WIFI_Status_t AT_ExecuteCommand(ES_WIFIObject_t *Obj, const uint8_t *c
   int16_t recv_len = 0;
 
   DEBUGCMD("%s\n",cmd);
+  Obj->CommandCount++;
 
   if ((Obj->fops.IO_Send != NULL) && (Obj->fops.IO_Receive != NULL)) {
 
@@ -744,7 +772,7 @@ static ES_WIFI_Status_t AT_ExecuteCommand(ES_WIFIObject_t *Obj, const uint8_t *c
       *(pdata + recv_len) = 0;
       DEBUGCMD("%s\n",cmd);
 
-      if (strstr((char *)pdata, AT_OK_STRING))
+      if (AT_EndsWithOK(pdata, recv_len))
       {
         return ES_WIFI_STATUS_OK;
       }
@@ -755,6 +783,7 @@ static ES_WIFI_Status_t AT_ExecuteCommand(ES_WIFIObject_t *Obj, const uint8_t *c
     }
     if (recv_len == ES_WIFI_ERROR_STUFFING_FOREVER)
     {
+      AT_ForgetSocketState(Obj);
       return ES_WIFI_STATUS_MODULE_CRASH;
     }
    }
@@ -784,6 +813,8 @@ static ES_WIFI_Status_t AT_RequestSendData(ES_WIFIObject_t *Obj, uint8_t* cmd,
   /* Can send only even number of byte on first send. */
   if (cmd_len & 1) return ES_WIFI_STATUS_ERROR;
 
+  Obj->CommandCount++;
+
   if ((Obj->fops.IO_Send != NULL) && (Obj->fops.IO_Receive != NULL)) {
 
   n = Obj->fops.IO_Send(cmd, cmd_len, Obj->Timeout);
@@ -796,7 +827,7 @@ static ES_WIFI_Status_t AT_RequestSendData(ES_WIFIObject_t *Obj, uint8_t* cmd,
       if (recv_len > 0)
       {
         *(pdata + recv_len) = 0;
-        if(strstr((char *)pdata, AT_OK_STRING))
+        if (AT_EndsWithOK(pdata, recv_len))
         {
           return ES_WIFI_STATUS_OK;
         }
@@ -812,6 +843,7 @@ static ES_WIFI_Status_t AT_RequestSendData(ES_WIFIObject_t *Obj, uint8_t* cmd,
 
       if (recv_len == ES_WIFI_ERROR_STUFFING_FOREVER)
       {
+        AT_ForgetSocketState(Obj);
         return ES_WIFI_STATUS_MODULE_CRASH;
       }
       return ES_WIFI_STATUS_ERROR;
@@ -827,10 +859,34 @@ static ES_WIFI_Status_t AT_RequestSendData(ES_WIFIObject_t *Obj, uint8_t* cmd,
 
 
 /**
-  * @brief  Parses Received data.
+  * @brief  Byte of a scattered receive.
+  * @param  Segments: the buffers, in the order they were filled
+  * @param  Count: number of buffers
+  * @param  Pos: offset of the byte in the response
+  * @retval The byte, 0 past the buffers.
+  */
+static uint8_t AT_SegmentByte(const IO_Segment_t *Segments, uint8_t Count, uint16_t Pos)
+{
+  for (uint8_t i = 0; i < Count; i++)
+  {
+    if (Pos < Segments[i].len)
+    {
+      return Segments[i].data[Pos];
+    }
+    Pos -= Segments[i].len;
+  }
+  return 0;
+}
+
+/**
+  * @brief  Parses Received data. The response is received straight into
+  *         place: its leading "\r\n" into a word on the stack, the payload
+  *         into pdata, and what does not fit there into a small tail. Only
+  *         the end of the response is checked for AT_OK_STRING, the payload
+  *         is never scanned nor copied.
   * @param  Obj: pointer to module handle
   * @param  cmd:command formatted string
-  * @param  pdata: payload
+  * @param  pdata: payload, Reqlen bytes are written at most
   * @param  Reqlen : requested Data length.
   * @param  ReadData : pointer to received data length.
   * @retval Operation Status.
@@ -838,57 +894,139 @@ static ES_WIFI_Status_t AT_RequestSendData(ES_WIFIObject_t *Obj, uint8_t* cmd,
 static ES_WIFI_Status_t AT_RequestReceiveData(ES_WIFIObject_t *Obj, uint8_t *cmd,
                                               char *pdata, uint16_t Reqlen, uint16_t *ReadData)
 {
+  uint16_t head[AT_RECEIVE_HEAD_LEN / 2];
+  uint16_t tail[AT_RECEIVE_TAIL_LEN / 2];
+  const IO_Segment_t segments[3] =
+  {
+    { (uint8_t *)head, AT_RECEIVE_HEAD_LEN },
+    { (uint8_t *)pdata, Reqlen },
+    { (uint8_t *)tail, AT_RECEIVE_TAIL_LEN }
+  };
   int len;
-  uint8_t *p=Obj->CmdData;
 
-  if ((Obj->fops.IO_Send != NULL) && (Obj->fops.IO_Receive != NULL)) {
+  Obj->CommandCount++;
+
+  if ((Obj->fops.IO_Send != NULL) && (Obj->fops.IO_ReceiveSegments != NULL)) {
 
   if (Obj->fops.IO_Send(cmd, (uint16_t)strlen((char *)cmd), Obj->Timeout) > 0)
   {
-    len = Obj->fops.IO_Receive(p, 0, Obj->Timeout);
+    len = Obj->fops.IO_ReceiveSegments(segments, 3, Obj->Timeout);
+
+    if (len == ES_WIFI_ERROR_STUFFING_FOREVER )
+    {
+      AT_ForgetSocketState(Obj);
+      return ES_WIFI_STATUS_MODULE_CRASH;
+    }
 
     /* Check if start at "\r\n". */
-    if ((p[0] != '\r') || (p[1] != '\n'))
+    if ((len < AT_RECEIVE_HEAD_LEN) || (memcmp(head, "\r\n", AT_RECEIVE_HEAD_LEN) != 0))
     {
       return ES_WIFI_STATUS_IO_ERROR;
     }
-    len -= 2;
-    p += 2;
-    if (len >= AT_OK_STRING_LEN)
+
+    /* remove the padding, then find the end of the payload */
+    while ((len > AT_RECEIVE_HEAD_LEN) && (AT_SegmentByte(segments, 3, len - 1) == AT_PADDING_CHAR))
+    {
+      len--;
+    }
+    len -= AT_RECEIVE_HEAD_LEN;
+
+    if (len >= (int)AT_OK_STRING_LEN)
     {
-     while(len && (p[len - 1] == 0x15)) len--;
-     p[len] = '\0';
+      uint16_t end = AT_RECEIVE_HEAD_LEN + len;
+      uint16_t i;
 
-     if (strstr((char *) p + len - AT_OK_STRING_LEN, AT_OK_STRING))
-     {
-       *ReadData = len - AT_OK_STRING_LEN;
-       if (*ReadData > Reqlen)
-       {
-         *ReadData = Reqlen;
-       }
+      for (i = 0; i < AT_OK_STRING_LEN; i++)
+      {
+        if (AT_SegmentByte(segments, 3, end - AT_OK_STRING_LEN + i) != (uint8_t)AT_OK_STRING[i])
+        {
+          break;
+        }
+      }
 
-       memcpy(pdata, p, *ReadData);
-       return ES_WIFI_STATUS_OK;
-     }
-     else if (memcmp((char *)p + len - AT_DELIMETER_LEN, AT_DELIMETER_STRING, AT_DELIMETER_LEN) == 0)
-     {
-       *ReadData = 0;
-       return ES_WIFI_STATUS_UNEXPECTED_CLOSED_SOCKET;
-     }
-
-     *ReadData = 0;
-     return ES_WIFI_STATUS_UNEXPECTED_CLOSED_SOCKET;
-   }
-   if (len == ES_WIFI_ERROR_STUFFING_FOREVER )
-   {
-     return ES_WIFI_STATUS_MODULE_CRASH;
-   }
+      if (i == AT_OK_STRING_LEN)
+      {
+        *ReadData = len - AT_OK_STRING_LEN;
+        if (*ReadData > Reqlen)
+        {
+          *ReadData = Reqlen;
+        }
+        return ES_WIFI_STATUS_OK;
+      }
+
+      *ReadData = 0;
+      return ES_WIFI_STATUS_UNEXPECTED_CLOSED_SOCKET;
+    }
   }
  }
 
   return ES_WIFI_STATUS_IO_ERROR;
 }
 
+/**
+  * @brief  Forget the socket settings the module is known to hold, the next
+  *         send or receive sets them again. Called on a reset, an error, and
+  *         before any other command that selects a socket.
+  * @param  Obj: pointer to module handle
+  * @retval None.
+  */
+static void AT_ForgetSocketState(ES_WIFIObject_t *Obj)
+{
+  Obj->SocketState.Socket = ES_WIFI_STATE_UNKNOWN;
+  Obj->SocketState.SendTimeout = ES_WIFI_STATE_UNKNOWN;
+  Obj->SocketState.ReceiveLength = ES_WIFI_STATE_UNKNOWN;
+  Obj->SocketState.ReceiveTimeout = ES_WIFI_STATE_UNKNOWN;
+}
+
+/**
+  * @brief  Set a socket setting, unless the module already holds the value.
+  * @param  Obj: pointer to module handle
+  * @param  Setter: the command, "P0", "S2", "R1" or "R2"
+  * @param  Held: the value the module holds, updated
+  * @param  Value: the value to set
+  * @retval Operation Status.
+  */
+static ES_WIFI_Status_t AT_SetSocketState(ES_WIFIObject_t *Obj, const char *Setter,
+                                          uint32_t *Held, uint32_t Value)
+{
+  ES_WIFI_Status_t ret;
+
+  if (*Held == Value)
+  {
+    Obj->SkippedCommandCount++;
+    return ES_WIFI_STATUS_OK;
+  }
+
+  sprintf((char*)Obj->CmdData, "%s=%lu\r", Setter, Value);
+  ret = AT_ExecuteCommand(Obj, Obj->CmdData, Obj->CmdData);
+  if (ret == ES_WIFI_STATUS_OK)
+  {
+    *Held = Value;
+  }
+  else
+  {
+    AT_ForgetSocketState(Obj);
+  }
+  return ret;
+}
+
+/**
+  * @brief  Make a socket the current one. Whether the module keeps the send
+  *         and receive settings per socket is not documented, those known
+  *         for the previous socket are not trusted for another one.
+  * @param  Obj: pointer to module handle
+  * @param  Socket: number of the socket
+  * @retval Operation Status.
+  */
+static ES_WIFI_Status_t AT_SelectSocket(ES_WIFIObject_t *Obj, uint8_t Socket)
+{
+  if (Obj->SocketState.Socket != Socket)
+  {
+    AT_ForgetSocketState(Obj);
+  }
+  return AT_SetSocketState(Obj, "P0", &Obj->SocketState.Socket, Socket);
+}
+
 
 /**
   * @brief  Initialize the WIFI module.
@@ -900,6 +1038,7 @@ ES_WIFI_Status_t ES_WIFI_Init(ES_WIFIObject_t *Obj)
   ES_WIFI_Status_t ret = ES_WIFI_STATUS_ERROR;
 
   Obj->Timeout = ES_WIFI_TIMEOUT;
+  AT_ForgetSocketState(Obj);
 
   if (Obj->fops.IO_Init != NULL) {
 
@@ -1051,9 +1190,10 @@ ES_WIFI_Status_t  ES_WIFI_RegisterBusIO(ES_WIFIObject_t *Obj, IO_Init_Func IO_In
                                                               IO_DeInit_Func  IO_DeInit,
                                                               IO_Delay_Func   IO_Delay,
                                                               IO_Send_Func    IO_Send,
-                                                              IO_Receive_Func IO_Receive)
+                                                              IO_Receive_Func IO_Receive,
+                                                              IO_ReceiveSegments_Func IO_ReceiveSegments)
 {
-  if (!Obj || !IO_Init || !IO_DeInit || !IO_Send || !IO_Receive)
+  if (!Obj || !IO_Init || !IO_DeInit || !IO_Send || !IO_Receive || !IO_ReceiveSegments)
   {
     return ES_WIFI_STATUS_ERROR;
   }
@@ -1062,6 +1202,7 @@ ES_WIFI_Status_t  ES_WIFI_RegisterBusIO(ES_WIFIObject_t *Obj, IO_Init_Func IO_In
   Obj->fops.IO_DeInit = IO_DeInit;
   Obj->fops.IO_Send = IO_Send;
   Obj->fops.IO_Receive = IO_Receive;
+  Obj->fops.IO_ReceiveSegments = IO_ReceiveSegments;
   Obj->fops.IO_Delay = IO_Delay;
 
   return ES_WIFI_STATUS_OK;
@@ -1130,6 +1271,7 @@ ES_WIFI_Status_t ES_WIFI_ListAccessPoints(ES_WIFIObject_t *Obj, ES_WIFI_APs_t *A
         }
         if (recv_len == ES_WIFI_ERROR_STUFFING_FOREVER )
         {
+          AT_ForgetSocketState(Obj);
           UNLOCK_WIFI();
           return ES_WIFI_STATUS_MODULE_CRASH;
         }
@@ -1504,6 +1646,8 @@ ES_WIFI_Status_t ES_WIFI_ResetModule(ES_WIFIObject_t *Obj)
 
  LOCK_WIFI();
 
+  AT_ForgetSocketState(Obj);
+
   if ((Obj->fops.IO_Send != NULL) && (Obj->fops.IO_Receive != NULL)) {
 
   sprintf((char*)Obj->CmdData,"ZR\r");
@@ -1533,6 +1677,7 @@ ES_WIFI_Status_t ES_WIFI_HardResetModule(ES_WIFIObject_t *Obj)
   int16_t ret = 0;
 
   LOCK_WIFI();
+  AT_ForgetSocketState(Obj);
   if (Obj->fops.IO_Init != NULL)
   {
     ret = Obj->fops.IO_Init(ES_WIFI_RESET);
@@ -1758,6 +1903,7 @@ ES_WIFI_Status_t ES_WIFI_StartClientConnection(ES_WIFIObject_t *Obj, ES_WIFI_Con
 
   LOCK_WIFI();
 
+  AT_ForgetSocketState(Obj);
   sprintf((char*)Obj->CmdData,"P0=%d\r", conn->Number);
   ret = AT_ExecuteCommand(Obj, Obj->CmdData, Obj->CmdData);
 
@@ -1814,6 +1960,7 @@ ES_WIFI_Status_t ES_WIFI_StopClientConnection(ES_WIFIObject_t *Obj, ES_WIFI_Conn
 
   LOCK_WIFI();
 
+  AT_ForgetSocketState(Obj);
   sprintf((char*)Obj->CmdData,"P0=%d\r", conn->Number);
   ret = AT_ExecuteCommand(Obj, Obj->CmdData, Obj->CmdData);
 
@@ -1840,6 +1987,7 @@ ES_WIFI_Status_t ES_WIFI_StartAWSClientConnection(ES_WIFIObject_t *Obj, ES_WIFI_
   ES_WIFI_Status_t ret;
   LOCK_WIFI();
 
+  AT_ForgetSocketState(Obj);
   sprintf((char*)Obj->CmdData,"P0=%d\r", conn->Number);
   ret = AT_ExecuteCommand(Obj, Obj->CmdData, Obj->CmdData);
 
@@ -1908,6 +2056,7 @@ ES_WIFI_Status_t ES_WIFI_StartServerSingleConn(ES_WIFIObject_t *Obj, ES_WIFI_Con
 
   LOCK_WIFI();
 
+  AT_ForgetSocketState(Obj);
   sprintf((char*)Obj->CmdData,"P0=%d\r", conn->Number);
   ret = AT_ExecuteCommand(Obj, Obj->CmdData, Obj->CmdData);
   if (ret != ES_WIFI_STATUS_OK)
@@ -1987,6 +2136,8 @@ ES_WIFI_Status_t ES_WIFI_WaitServerConnection(ES_WIFIObject_t *Obj, uint32_t tim
     tstart=0;
   }
 
+  LOCK_WIFI();
+
   do
   {
 #if (ES_WIFI_USE_UART == 0)
@@ -2060,6 +2211,9 @@ ES_WIFI_Status_t ES_WIFI_WaitServerConnection(ES_WIFIObject_t *Obj, uint32_t tim
     t = HAL_GetTick();
   }
   while ((timeout==0) || ((t < tlast) || (t < tstart)));
+
+  UNLOCK_WIFI();
+
   return ES_WIFI_STATUS_TIMEOUT;
 }
 
@@ -2076,6 +2230,7 @@ ES_WIFI_Status_t ES_WIFI_CloseServerConnection(ES_WIFIObject_t *Obj, uint8_t soc
 
   LOCK_WIFI();
 
+  AT_ForgetSocketState(Obj);
   sprintf((char*)Obj->CmdData, "P0=%d\r", socket);
   ret = AT_ExecuteCommand(Obj, Obj->CmdData, Obj->CmdData);
   if (ret != ES_WIFI_STATUS_OK)
@@ -2108,6 +2263,7 @@ ES_WIFI_Status_t ES_WIFI_StopServerSingleConn(ES_WIFIObject_t *Obj, uint8_t sock
 
   LOCK_WIFI();
 
+  AT_ForgetSocketState(Obj);
   sprintf((char*)Obj->CmdData,"P0=%d\r", socket);
   ret = AT_ExecuteCommand(Obj, Obj->CmdData, Obj->CmdData);
   if (ret != ES_WIFI_STATUS_OK)
@@ -2147,6 +2303,7 @@ ES_WIFI_Status_t ES_WIFI_StartServerMultiConn(ES_WIFIObject_t *Obj, ES_WIFI_Conn
   ret = AT_ExecuteCommand(Obj, Obj->CmdData, Obj->CmdData);
   if (ret == ES_WIFI_STATUS_OK)
   {
+    AT_ForgetSocketState(Obj);
     sprintf((char*)Obj->CmdData,"P0=%d\r", conn->Number);
     ret = AT_ExecuteCommand(Obj, Obj->CmdData, Obj->CmdData);
     if (ret == ES_WIFI_STATUS_OK)
@@ -2206,6 +2363,7 @@ ES_WIFI_Status_t ES_WIFI_StopServerMultiConn(ES_WIFIObject_t *Obj, ES_WIFI_Conn_
 
  LOCK_WIFI();
 
+  AT_ForgetSocketState(Obj);
   sprintf((char*)Obj->CmdData,"P0=%d\r", conn->Number);
   ret = AT_ExecuteCommand(Obj, Obj->CmdData, Obj->CmdData);
   if (ret != ES_WIFI_STATUS_OK)
@@ -2298,12 +2456,10 @@ ES_WIFI_Status_t ES_WIFI_SendData(ES_WIFIObject_t *Obj, uint8_t Socket,
   }
 
   *SentLen = Reqlen;
-  sprintf((char*)Obj->CmdData,"P0=%d\r", Socket);
-  ret = AT_ExecuteCommand(Obj, Obj->CmdData, Obj->CmdData);
+  ret = AT_SelectSocket(Obj, Socket);
   if (ret == ES_WIFI_STATUS_OK)
   {
-    sprintf((char*)Obj->CmdData,"S2=%lu\r",wkgTimeOut);
-    ret = AT_ExecuteCommand(Obj, Obj->CmdData, Obj->CmdData);
+    ret = AT_SetSocketState(Obj, "S2", &Obj->SocketState.SendTimeout, wkgTimeOut);
 
     if (ret == ES_WIFI_STATUS_OK)
     {
@@ -2338,6 +2494,11 @@ ES_WIFI_Status_t ES_WIFI_SendData(ES_WIFIObject_t *Obj, uint8_t Socket,
     *SentLen = 0;
   }
 
+  if (ret != ES_WIFI_STATUS_OK)
+  {
+    AT_ForgetSocketState(Obj);
+  }
+
   UNLOCK_WIFI();
 
   return ret;
@@ -2362,8 +2523,7 @@ ES_WIFI_Status_t ES_WIFI_SendDataTo(ES_WIFIObject_t *Obj, uint8_t Socket, const
 
   LOCK_WIFI();
 
-  sprintf((char*)Obj->CmdData,"P0=%d\r", Socket);
-  ret = AT_ExecuteCommand(Obj, Obj->CmdData, Obj->CmdData);
+  ret = AT_SelectSocket(Obj, Socket);
 
   if (ret == ES_WIFI_STATUS_OK)
   {
@@ -2394,8 +2554,7 @@ ES_WIFI_Status_t ES_WIFI_SendDataTo(ES_WIFIObject_t *Obj, uint8_t Socket, const
 
   if(ret == ES_WIFI_STATUS_OK)
   {
-    sprintf((char*)Obj->CmdData, "S2=%lu\r", wkgTimeOut);
-    ret = AT_ExecuteCommand(Obj, Obj->CmdData, Obj->CmdData);
+    ret = AT_SetSocketState(Obj, "S2", &Obj->SocketState.SendTimeout, wkgTimeOut);
   }
 
   if(ret == ES_WIFI_STATUS_OK)
@@ -2428,6 +2587,7 @@ ES_WIFI_Status_t ES_WIFI_SendDataTo(ES_WIFIObject_t *Obj, uint8_t Socket, const
   {
     DEBUG("Send error:\n%s\n", Obj->CmdData);
     *SentLen = 0;
+    AT_ForgetSocketState(Obj);
   }
 
   UNLOCK_WIFI();
@@ -2465,17 +2625,14 @@ ES_WIFI_Status_t ES_WIFI_ReceiveData(ES_WIFIObject_t *Obj, uint8_t Socket, uint8
 
   if (Reqlen <= ES_WIFI_PAYLOAD_SIZE)
   {
-    sprintf((char*)Obj->CmdData,"P0=%d\r", Socket);
-    ret = AT_ExecuteCommand(Obj, Obj->CmdData, Obj->CmdData);
+    ret = AT_SelectSocket(Obj, Socket);
 
     if (ret == ES_WIFI_STATUS_OK)
     {
-      sprintf((char*)Obj->CmdData,"R1=%d\r", Reqlen);
-      ret = AT_ExecuteCommand(Obj, Obj->CmdData, Obj->CmdData);
+      ret = AT_SetSocketState(Obj, "R1", &Obj->SocketState.ReceiveLength, Reqlen);
       if (ret == ES_WIFI_STATUS_OK)
       {
-        sprintf((char*)Obj->CmdData,"R2=%lu\r", wkgTimeOut);
-        ret = AT_ExecuteCommand(Obj, Obj->CmdData, Obj->CmdData);
+        ret = AT_SetSocketState(Obj, "R2", &Obj->SocketState.ReceiveTimeout, wkgTimeOut);
         if (ret == ES_WIFI_STATUS_OK)
         {
           sprintf((char*)Obj->CmdData,"R0\r");
@@ -2503,6 +2660,11 @@ ES_WIFI_Status_t ES_WIFI_ReceiveData(ES_WIFIObject_t *Obj, uint8_t Socket, uint8
     }
   }
 
+  if (ret != ES_WIFI_STATUS_OK)
+  {
+    AT_ForgetSocketState(Obj);
+  }
+
   UNLOCK_WIFI();
 
   return ret;
@@ -2532,14 +2694,12 @@ ES_WIFI_Status_t ES_WIFI_ReceiveDataFrom(ES_WIFIObject_t *Obj, uint8_t Socket, u
 
   if (Reqlen <= ES_WIFI_PAYLOAD_SIZE)
   {
-    sprintf((char*)Obj->CmdData, "P0=%d\r", Socket);
-    ret = AT_ExecuteCommand(Obj, Obj->CmdData, Obj->CmdData);
+    ret = AT_SelectSocket(Obj, Socket);
   }
 
   if (ret == ES_WIFI_STATUS_OK)
   {
-    sprintf((char*)Obj->CmdData,"R1=%d\r", Reqlen);
-    ret = AT_ExecuteCommand(Obj, Obj->CmdData, Obj->CmdData);
+    ret = AT_SetSocketState(Obj, "R1", &Obj->SocketState.ReceiveLength, Reqlen);
   }
   else
   {
@@ -2548,8 +2708,7 @@ ES_WIFI_Status_t ES_WIFI_ReceiveDataFrom(ES_WIFIObject_t *Obj, uint8_t Socket, u
 
   if (ret == ES_WIFI_STATUS_OK)
   {
-    sprintf((char*)Obj->CmdData,"R2=%lu\r", wkgTimeOut);
-    ret = AT_ExecuteCommand(Obj, Obj->CmdData, Obj->CmdData);
+    ret = AT_SetSocketState(Obj, "R2", &Obj->SocketState.ReceiveTimeout, wkgTimeOut);
   }
   else
   {
@@ -2597,6 +2756,7 @@ ES_WIFI_Status_t ES_WIFI_ReceiveDataFrom(ES_WIFIObject_t *Obj, uint8_t Socket, u
   {
     DEBUG("Read error:\n%s\n", Obj->CmdData);
     *Receivedlen = 0;
+    AT_ForgetSocketState(Obj);
   }
   UNLOCK_WIFI();
   return ret;
@@ -2611,6 +2771,7 @@ ES_WIFI_Status_t  ES_WIFI_SockInfo(ES_WIFIObject_t *Obj, uint8_t Socket,
 
   LOCK_WIFI();
 
+  AT_ForgetSocketState(Obj);
   sprintf((char*)Obj->CmdData, "P0=%d\r", Socket);
   ret = AT_ExecuteCommand(Obj, Obj->CmdData, Obj->CmdData);
 
@@ -2643,6 +2804,7 @@ ES_WIFI_Status_t ES_WIFI_PeerInfo(ES_WIFIObject_t *Obj, uint8_t Socket,
 
   LOCK_WIFI();
 
+  AT_ForgetSocketState(Obj);
   sprintf((char *)Obj->CmdData, "P0=%d\r", Socket);
   ret = AT_ExecuteCommand(Obj, Obj->CmdData, Obj->CmdData);
 
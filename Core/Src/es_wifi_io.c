@@ -24,9 +24,17 @@
 #include <string.h>
 #include "es_wifi_conf.h"
 #include <core_cm4.h>
+#include "FreeRTOS.h"
+#include "task.h"
+#include "semphr.h"
 
 /* Private define ------------------------------------------------------------*/
 #define MIN(a, b)  ((a) < (b) ? (a) : (b))
+/* Bytes that may be clocked out after CMD/DATA-READY fell, before a DMA
+   receive is stopped: the frame on the wire, the TX FIFO and the EXTI latency */
+#define SPI_WIFI_OVERREAD_MAX      16
+/* Smaller buffers of a scattered receive are read a word at a time */
+#define SPI_WIFI_DMA_MIN_SIZE      32
 /* Private typedef -----------------------------------------------------------*/
 /* Private macro -------------------------------------------------------------*/
 /* Private variables ---------------------------------------------------------*/
@@ -34,6 +42,24 @@ SPI_HandleTypeDef hspi;
 static  int volatile spi_rx_event = 0;
 static  int volatile spi_tx_event = 0;
 static  int volatile cmddata_rdy_rising_event = 0;
+static  SPI_WIFI_Stats_t spi_stats;
+/* held by the task driving the module, see SPI_WIFI_LockBus */
+static  StaticSemaphore_t wifi_bus_mutex_buffer;
+static  SemaphoreHandle_t wifi_bus_mutex = NULL;
+
+#if ES_WIFI_USE_SPI_DMA
+DMA_HandleTypeDef hdma_spi3_rx;
+DMA_HandleTypeDef hdma_spi3_tx;
+/* a DMA receive is in flight, the falling edge of CMD/DATA-READY ends it */
+static  int volatile spi_rx_dma = 0;
+static  int volatile spi_rx_stopped = 0;
+/* a task sleeps on spi_event_sem until the interrupts clear its event */
+static  int volatile spi_task_waiting = 0;
+static  StaticSemaphore_t spi_event_sem_buffer;
+static  SemaphoreHandle_t spi_event_sem = NULL;
+/* word aligned copy of the data that cannot be sent from where it is */
+static  uint8_t spi_tx_buffer[ES_WIFI_PAYLOAD_SIZE + 2] __attribute__((aligned(4)));
+#endif /* ES_WIFI_USE_SPI_DMA */
 
 #ifdef WIFI_USE_CMSIS_OS
 osMutexId es_wifi_mutex;
@@ -60,6 +86,13 @@ static  int wait_cmddata_rdy_rising_event(int timeout);
 static  int wait_spi_tx_event(int timeout);
 static  int wait_spi_rx_event(int timeout);
 static  void SPI_WIFI_DelayUs(uint32_t);
+static  uint32_t spi_cycles_to_us(uint32_t cycles);
+#if ES_WIFI_USE_SPI_DMA
+static  int wait_spi_event_blocking(int volatile *event, int timeout, uint32_t *blocked_cycles);
+static  void spi_signal_waiter(void);
+static  int16_t spi_receive_dma(uint8_t *pData, uint16_t size, uint32_t timeout);
+static  const uint8_t *spi_tx_dma_source(const uint8_t *pdata, uint16_t len);
+#endif /* ES_WIFI_USE_SPI_DMA */
 /* Private functions ---------------------------------------------------------*/
 /*******************************************************************************
                        COM Driver Interface (SPI)
@@ -90,7 +123,12 @@ void SPI_WIFI_MspInit(SPI_HandleTypeDef* hspi)
 
   /* configure Data ready pin */
   GPIO_Init.Pin       = GPIO_PIN_1;
+#if ES_WIFI_USE_SPI_DMA
+  /* the falling edge ends a DMA receive */
+  GPIO_Init.Mode      = GPIO_MODE_IT_RISING_FALLING;
+#else
   GPIO_Init.Mode      = GPIO_MODE_IT_RISING;
+#endif /* ES_WIFI_USE_SPI_DMA */
   GPIO_Init.Pull      = GPIO_NOPULL;
   GPIO_Init.Speed     = GPIO_SPEED_FREQ_LOW;
   HAL_GPIO_Init(GPIOE, &GPIO_Init );
@@ -134,6 +172,37 @@ void SPI_WIFI_MspInit(SPI_HandleTypeDef* hspi)
   GPIO_Init.Speed     = GPIO_SPEED_FREQ_MEDIUM;
   GPIO_Init.Alternate = GPIO_AF6_SPI3;
   HAL_GPIO_Init( GPIOC,&GPIO_Init );
+
+#if ES_WIFI_USE_SPI_DMA
+  __HAL_RCC_DMAMUX1_CLK_ENABLE();
+  __HAL_RCC_DMA2_CLK_ENABLE();
+
+  /* configure SPI RX DMA */
+  hdma_spi3_rx.Instance                 = DMA2_Channel1;
+  hdma_spi3_rx.Init.Request             = DMA_REQUEST_SPI3_RX;
+  hdma_spi3_rx.Init.Direction           = DMA_PERIPH_TO_MEMORY;
+  hdma_spi3_rx.Init.PeriphInc           = DMA_PINC_DISABLE;
+  hdma_spi3_rx.Init.MemInc              = DMA_MINC_ENABLE;
+  hdma_spi3_rx.Init.PeriphDataAlignment = DMA_PDATAALIGN_HALFWORD;
+  hdma_spi3_rx.Init.MemDataAlignment    = DMA_MDATAALIGN_HALFWORD;
+  hdma_spi3_rx.Init.Mode                = DMA_NORMAL;
+  hdma_spi3_rx.Init.Priority            = DMA_PRIORITY_HIGH;
+  HAL_DMA_Init(&hdma_spi3_rx);
+  __HAL_LINKDMA(hspi, hdmarx, hdma_spi3_rx);
+
+  /* configure SPI TX DMA */
+  hdma_spi3_tx.Instance                 = DMA2_Channel2;
+  hdma_spi3_tx.Init.Request             = DMA_REQUEST_SPI3_TX;
+  hdma_spi3_tx.Init.Direction           = DMA_MEMORY_TO_PERIPH;
+  hdma_spi3_tx.Init.PeriphInc           = DMA_PINC_DISABLE;
+  hdma_spi3_tx.Init.MemInc              = DMA_MINC_ENABLE;
+  hdma_spi3_tx.Init.PeriphDataAlignment = DMA_PDATAALIGN_HALFWORD;
+  hdma_spi3_tx.Init.MemDataAlignment    = DMA_MDATAALIGN_HALFWORD;
+  hdma_spi3_tx.Init.Mode                = DMA_NORMAL;
+  hdma_spi3_tx.Init.Priority            = DMA_PRIORITY_MEDIUM;
+  HAL_DMA_Init(&hdma_spi3_tx);
+  __HAL_LINKDMA(hspi, hdmatx, hdma_spi3_tx);
+#endif /* ES_WIFI_USE_SPI_DMA */
 }
 
 /**
@@ -167,6 +236,18 @@ int8_t SPI_WIFI_Init(uint16_t mode)
       return -1;
     }
 
+    /* cycle counter for the transfer statistics */
+    CoreDebug->DEMCR |= CoreDebug_DEMCR_TRCENA_Msk;
+    DWT->CTRL |= DWT_CTRL_CYCCNTENA_Msk;
+
+#if ES_WIFI_USE_SPI_DMA
+    /* Enable Interrupt for SPI DMA rx and tx */
+    HAL_NVIC_SetPriority((IRQn_Type)DMA2_Channel1_IRQn, SPI_INTERFACE_PRIO, 0);
+    HAL_NVIC_EnableIRQ((IRQn_Type)DMA2_Channel1_IRQn);
+    HAL_NVIC_SetPriority((IRQn_Type)DMA2_Channel2_IRQn, SPI_INTERFACE_PRIO, 0);
+    HAL_NVIC_EnableIRQ((IRQn_Type)DMA2_Channel2_IRQn);
+#endif /* ES_WIFI_USE_SPI_DMA */
+
      /* Enable Interrupt for Data Ready pin , GPIO_PIN1 */
      HAL_NVIC_SetPriority((IRQn_Type)EXTI1_IRQn, SPI_INTERFACE_PRIO, 0x00);
      HAL_NVIC_EnableIRQ((IRQn_Type)EXTI1_IRQn);
@@ -242,6 +323,12 @@ int8_t SPI_WIFI_ResetModule(void)
 int8_t SPI_WIFI_DeInit(void)
 {
   HAL_SPI_DeInit( &hspi );
+#if ES_WIFI_USE_SPI_DMA
+  HAL_NVIC_DisableIRQ((IRQn_Type)DMA2_Channel1_IRQn);
+  HAL_NVIC_DisableIRQ((IRQn_Type)DMA2_Channel2_IRQn);
+  HAL_DMA_DeInit(&hdma_spi3_rx);
+  HAL_DMA_DeInit(&hdma_spi3_tx);
+#endif /* ES_WIFI_USE_SPI_DMA */
 #ifdef WIFI_USE_CMSIS_OS
   osMutexDelete(spi_mutex);
   osMutexDelete(es_wifi_mutex);
@@ -279,6 +366,14 @@ static int wait_cmddata_rdy_rising_event(int timeout)
 {
 #ifdef SEM_WAIT
    return SEM_WAIT(cmddata_rdy_rising_sem, timeout);
+#elif ES_WIFI_USE_SPI_DMA
+  uint32_t tickstart = HAL_GetTick();
+  uint32_t blocked_cycles = 0;
+  int rc = wait_spi_event_blocking(&cmddata_rdy_rising_event, timeout, &blocked_cycles);
+
+  spi_stats.ReadyWaitMs += HAL_GetTick() - tickstart;
+  spi_stats.ReadyBlockedMs += spi_cycles_to_us(blocked_cycles) / 1000U;
+  return rc;
 #else
   int tickstart = HAL_GetTick();
   while (cmddata_rdy_rising_event == 1)
@@ -311,6 +406,150 @@ static int wait_spi_rx_event(int timeout)
 }
 
 
+#if ES_WIFI_USE_SPI_DMA
+/**
+  * @brief  Wait for an interrupt to clear an event. Once the scheduler runs
+  *         the calling task sleeps instead of polling.
+  * @param  event : event flag, cleared by the interrupt
+  * @param  timeout : wait timeout in mS
+  * @param  blocked_cycles : incremented by the cycles the task slept
+  * @retval 0 when the event came, -1 on timeout
+  */
+static int wait_spi_event_blocking(int volatile *event, int timeout, uint32_t *blocked_cycles)
+{
+  uint32_t tickstart = HAL_GetTick();
+
+  while (*event == 1)
+  {
+    if (xTaskGetSchedulerState() == taskSCHEDULER_RUNNING)
+    {
+      uint32_t start = DWT->CYCCNT;
+
+      /* not before the scheduler runs: FreeRTOS calls made then leave the
+         interrupts this waits for masked until it starts */
+      if (spi_event_sem == NULL)
+      {
+        spi_event_sem = xSemaphoreCreateBinaryStatic(&spi_event_sem_buffer);
+      }
+
+      spi_task_waiting = 1;
+      if (*event == 1)
+      {
+        xSemaphoreTake(spi_event_sem, pdMS_TO_TICKS(timeout));
+      }
+      spi_task_waiting = 0;
+      *blocked_cycles += DWT->CYCCNT - start;
+    }
+
+    if ((HAL_GetTick() - tickstart) > (uint32_t)timeout)
+    {
+      return (*event == 1) ? -1 : 0;
+    }
+  }
+  return 0;
+}
+
+/**
+  * @brief  Wake the task waiting for an event, from an interrupt
+  * @param  None
+  * @retval None
+  */
+static void spi_signal_waiter(void)
+{
+  BaseType_t woken = pdFALSE;
+
+  if (spi_task_waiting && (spi_event_sem != NULL))
+  {
+    xSemaphoreGiveFromISR(spi_event_sem, &woken);
+    portYIELD_FROM_ISR(woken);
+  }
+}
+
+/**
+  * @brief  Receive in one DMA transfer until the module drops CMD/DATA-READY
+  * @param  pData : half word aligned destination
+  * @param  size : most bytes to receive
+  * @param  timeout : receive timeout in mS
+  * @retval Length of received data, or an ES_WIFI_ERROR code
+  */
+static int16_t spi_receive_dma(uint8_t *pData, uint16_t size, uint32_t timeout)
+{
+  uint16_t words = (size + 1) / 2;
+  uint32_t blocked_cycles = 0;
+  int16_t length;
+
+  spi_rx_stopped = 0;
+  spi_rx_event = 1;
+  spi_rx_dma = 1;
+  if (HAL_SPI_Receive_DMA(&hspi, pData, words) != HAL_OK)
+  {
+    spi_rx_dma = 0;
+    return ES_WIFI_ERROR_SPI_FAILED;
+  }
+
+  if (wait_spi_event_blocking(&spi_rx_event, timeout, &blocked_cycles) < 0)
+  {
+    spi_rx_dma = 0;
+    HAL_SPI_DMAStop(&hspi);
+    HAL_SPIEx_FlushRxFifo(&hspi);
+    return ES_WIFI_ERROR_SPI_FAILED;
+  }
+  spi_stats.BlockedUs += spi_cycles_to_us(blocked_cycles);
+
+  if (!spi_rx_stopped)
+  {
+    return words * 2;
+  }
+
+  /* the frames already clocked out reach memory before the channels stop */
+  uint32_t tickstart = HAL_GetTick();
+  while ((__HAL_SPI_GET_FLAG(&hspi, SPI_FLAG_BSY) || ((hspi.Instance->SR & SPI_SR_FRLVL) != 0U)) &&
+         (__HAL_DMA_GET_COUNTER(hspi.hdmarx) != 0U) && ((HAL_GetTick() - tickstart) < 2U))
+  {
+  }
+  length = (words - __HAL_DMA_GET_COUNTER(hspi.hdmarx)) * 2;
+  HAL_SPI_DMAStop(&hspi);
+  HAL_SPIEx_FlushRxFifo(&hspi);
+
+  /* every response ends with the "> " prompt, what follows it was clocked
+     out after CMD/DATA-READY fell. The word holding the prompt is kept, as
+     the word by word receive does, its last byte may be a 0x15 pad. */
+  for (int16_t i = length - 2; (i >= 0) && (i >= length - SPI_WIFI_OVERREAD_MAX); i--)
+  {
+    if ((pData[i] == '>') && (pData[i + 1] == ' '))
+    {
+      return (i + 3) & ~1;
+    }
+  }
+  return length;
+}
+
+/**
+  * @brief  Where a DMA send reads from: the data itself when it is half word
+  *         aligned and even, else a padded copy of it
+  * @param  pdata : pointer to data
+  * @param  len : Data length
+  * @retval Half word aligned data, NULL when it does not fit the copy
+  */
+static const uint8_t *spi_tx_dma_source(const uint8_t *pdata, uint16_t len)
+{
+  if ((len == 0) || (len > ES_WIFI_PAYLOAD_SIZE))
+  {
+    return NULL;
+  }
+
+  if ((((uint32_t)pdata & 1U) == 0U) && ((len & 1) == 0))
+  {
+    return pdata;
+  }
+
+  memcpy(spi_tx_buffer, pdata, len);
+  spi_tx_buffer[len] = '\n';
+  return spi_tx_buffer;
+}
+#endif /* ES_WIFI_USE_SPI_DMA */
+
+
 static int wait_spi_tx_event(int timeout)
 {
 #ifdef SEM_WAIT
@@ -333,6 +572,7 @@ int16_t SPI_WIFI_ReceiveData(uint8_t *pData, uint16_t len, uint32_t timeout)
 {
   int16_t length = 0;
   uint8_t tmp[2];
+  uint32_t start;
 
   WIFI_DISABLE_NSS();
   UNLOCK_SPI();
@@ -344,8 +584,29 @@ int16_t SPI_WIFI_ReceiveData(uint8_t *pData, uint16_t len, uint32_t timeout)
   }
 
   LOCK_SPI();
+  start = DWT->CYCCNT;
   WIFI_ENABLE_NSS();
   SPI_WIFI_DelayUs(15);
+#if ES_WIFI_USE_SPI_DMA
+  if ((((uint32_t)pData & 1U) == 0U) && WIFI_IS_CMDDATA_READY())
+  {
+    length = spi_receive_dma(pData, len ? MIN(len, ES_WIFI_DATA_SIZE) : ES_WIFI_DATA_SIZE, timeout);
+    if (length < 0)
+    {
+      WIFI_DISABLE_NSS();
+      UNLOCK_SPI();
+      return length;
+    }
+    spi_stats.DmaTransfers++;
+
+    if (length >= ES_WIFI_DATA_SIZE) {
+      WIFI_DISABLE_NSS();
+      SPI_WIFI_ResetModule();
+      UNLOCK_SPI();
+      return ES_WIFI_ERROR_STUFFING_FOREVER;
+    }
+  }
+#endif /* ES_WIFI_USE_SPI_DMA */
   while (WIFI_IS_CMDDATA_READY())
   {
     if ((length < len) || (!len))
@@ -378,6 +639,111 @@ int16_t SPI_WIFI_ReceiveData(uint8_t *pData, uint16_t len, uint32_t timeout)
   }
   WIFI_DISABLE_NSS();
   UNLOCK_SPI();
+  spi_stats.RxTransfers++;
+  spi_stats.RxBytes += length;
+  spi_stats.RxUs += spi_cycles_to_us(DWT->CYCCNT - start);
+  return length;
+}
+
+
+/**
+  * @brief  Receive wifi Data from SPI into consecutive buffers, each one
+  *         filled before the next, until the module has no more data
+  * @param  segments : buffers to fill
+  * @param  count : number of buffers
+  * @param  timeout : receive timeout in mS
+  * @retval Length of received data, or an ES_WIFI_ERROR code when the
+  *         buffers do not hold the response
+  */
+int16_t SPI_WIFI_ReceiveSegments(const IO_Segment_t *segments, uint8_t count, uint32_t timeout)
+{
+  int16_t length = 0;
+  uint8_t tmp[2];
+  uint8_t pending = 0; /* tmp[1] is the first byte of the next buffer */
+  uint32_t start;
+
+  WIFI_DISABLE_NSS();
+  UNLOCK_SPI();
+  SPI_WIFI_DelayUs(3);
+
+  if (wait_cmddata_rdy_rising_event(timeout) < 0)
+  {
+      return ES_WIFI_ERROR_WAITING_DRDY_FALLING;
+  }
+
+  LOCK_SPI();
+  start = DWT->CYCCNT;
+  WIFI_ENABLE_NSS();
+  SPI_WIFI_DelayUs(15);
+  for (uint8_t i = 0; i < count; i++)
+  {
+    uint8_t *p = segments[i].data;
+    uint16_t left = segments[i].len;
+
+    if (pending && (left > 0))
+    {
+      *p++ = tmp[1];
+      left--;
+      length++;
+      pending = 0;
+    }
+
+#if ES_WIFI_USE_SPI_DMA
+    if ((((uint32_t)p & 1U) == 0U) && (left >= SPI_WIFI_DMA_MIN_SIZE) && WIFI_IS_CMDDATA_READY())
+    {
+      int16_t n = spi_receive_dma(p, left & ~1U, timeout);
+      if (n < 0)
+      {
+        WIFI_DISABLE_NSS();
+        UNLOCK_SPI();
+        return n;
+      }
+      spi_stats.DmaTransfers++;
+      p += n;
+      left -= n;
+      length += n;
+    }
+#endif /* ES_WIFI_USE_SPI_DMA */
+
+    while ((left > 0) && WIFI_IS_CMDDATA_READY())
+    {
+      spi_rx_event = 1;
+      if (HAL_SPI_Receive_IT(&hspi, tmp, 1) != HAL_OK) {
+        WIFI_DISABLE_NSS();
+        UNLOCK_SPI();
+        return ES_WIFI_ERROR_SPI_FAILED;
+      }
+
+      wait_spi_rx_event(timeout);
+
+      *p++ = tmp[0];
+      left--;
+      length++;
+      if (left > 0)
+      {
+        *p++ = tmp[1];
+        left--;
+        length++;
+      }
+      else
+      {
+        pending = 1;
+      }
+    }
+  }
+
+  if (pending || WIFI_IS_CMDDATA_READY())
+  {
+    WIFI_DISABLE_NSS();
+    SPI_WIFI_ResetModule();
+    UNLOCK_SPI();
+    return ES_WIFI_ERROR_STUFFING_FOREVER;
+  }
+  WIFI_DISABLE_NSS();
+  UNLOCK_SPI();
+  spi_stats.RxTransfers++;
+  spi_stats.RxBytes += length;
+  spi_stats.RxUs += spi_cycles_to_us(DWT->CYCCNT - start);
   return length;
 }
 
@@ -392,6 +758,7 @@ int16_t SPI_WIFI_ReceiveData(uint8_t *pData, uint16_t len, uint32_t timeout)
 int16_t SPI_WIFI_SendData(const uint8_t *pdata, uint16_t len, uint32_t timeout)
 {
   uint8_t Padding[2];
+  uint32_t start;
 
   if (wait_cmddata_rdy_high(timeout) < 0)
   {
@@ -401,8 +768,32 @@ int16_t SPI_WIFI_SendData(const uint8_t *pdata, uint16_t len, uint32_t timeout)
   /* arm to detect rising event */
   cmddata_rdy_rising_event = 1;
   LOCK_SPI();
+  start = DWT->CYCCNT;
   WIFI_ENABLE_NSS();
   SPI_WIFI_DelayUs(15);
+#if ES_WIFI_USE_SPI_DMA
+  const uint8_t *source = spi_tx_dma_source(pdata, len);
+  if (source != NULL)
+  {
+    uint32_t blocked_cycles = 0;
+
+    spi_tx_event = 1;
+    if (HAL_SPI_Transmit_DMA(&hspi, (uint8_t *)source, (len + 1) / 2) != HAL_OK)
+    {
+      WIFI_DISABLE_NSS();
+      UNLOCK_SPI();
+      return ES_WIFI_ERROR_SPI_FAILED;
+    }
+    wait_spi_event_blocking(&spi_tx_event, timeout, &blocked_cycles);
+
+    spi_stats.DmaTransfers++;
+    spi_stats.BlockedUs += spi_cycles_to_us(blocked_cycles);
+    spi_stats.TxTransfers++;
+    spi_stats.TxBytes += len;
+    spi_stats.TxUs += spi_cycles_to_us(DWT->CYCCNT - start);
+    return len;
+  }
+#endif /* ES_WIFI_USE_SPI_DMA */
   if (len > 1)
   {
     spi_tx_event = 1;
@@ -429,9 +820,64 @@ int16_t SPI_WIFI_SendData(const uint8_t *pdata, uint16_t len, uint32_t timeout)
     }
     wait_spi_tx_event(timeout);
   }
+  spi_stats.TxTransfers++;
+  spi_stats.TxBytes += len;
+  spi_stats.TxUs += spi_cycles_to_us(DWT->CYCCNT - start);
   return len;
 }
 
+/**
+  * @brief  Get the transfer statistics
+  * @param  stats : filled with the counts since the module was initialized
+  * @retval None
+  */
+void SPI_WIFI_GetStats(SPI_WIFI_Stats_t *stats)
+{
+  *stats = spi_stats;
+}
+
+/**
+  * @brief  Take the module for one ES_WIFI command sequence (LOCK_WIFI). The
+  *         sockets of other tasks wait until it is done, a command and its
+  *         socket selection are never interleaved with theirs. Nested calls
+  *         are allowed. Nothing to serialize before the scheduler runs, and
+  *         no FreeRTOS call must raise BASEPRI then.
+  * @param  None
+  * @retval None
+  */
+void SPI_WIFI_LockBus(void)
+{
+  if (xTaskGetSchedulerState() == taskSCHEDULER_NOT_STARTED)
+  {
+    return;
+  }
+
+  taskENTER_CRITICAL();
+  if (wifi_bus_mutex == NULL)
+  {
+    wifi_bus_mutex = xSemaphoreCreateRecursiveMutexStatic(&wifi_bus_mutex_buffer);
+  }
+  taskEXIT_CRITICAL();
+
+  xSemaphoreTakeRecursive(wifi_bus_mutex, portMAX_DELAY);
+}
+
+/**
+  * @brief  Give the module back (UNLOCK_WIFI)
+  * @param  None
+  * @retval None
+  */
+void SPI_WIFI_UnlockBus(void)
+{
+  if (xTaskGetSchedulerState() == taskSCHEDULER_NOT_STARTED
+      || wifi_bus_mutex == NULL)
+  {
+    return;
+  }
+
+  xSemaphoreGiveRecursive(wifi_bus_mutex);
+}
+
 /**
   * @brief  Delay
   * @param  Delay in ms
@@ -472,6 +918,16 @@ void SPI_WIFI_DelayUs(uint32_t n)
   return;
 }
 
+/**
+  * @brief  Convert DWT cycles to us
+  * @param  cycles : core clock cycles
+  * @retval Duration in us
+  */
+static uint32_t spi_cycles_to_us(uint32_t cycles)
+{
+  return cycles / (SystemCoreClock / 1000000UL);
+}
+
 /**
   * @brief Rx Transfer completed callback.
   * @param  hspi: pointer to a SPI_HandleTypeDef structure that contains
@@ -485,6 +941,10 @@ void HAL_SPI_RxCpltCallback(SPI_HandleTypeDef *hspi)
   {
     SEM_SIGNAL(spi_rx_sem);
     spi_rx_event = 0;
+#if ES_WIFI_USE_SPI_DMA
+    spi_rx_dma = 0;
+    spi_signal_waiter();
+#endif /* ES_WIFI_USE_SPI_DMA */
   }
 }
 
@@ -500,6 +960,9 @@ void HAL_SPI_TxCpltCallback(SPI_HandleTypeDef *hspi)
   {
     SEM_SIGNAL(spi_tx_sem);
     spi_tx_event = 0;
+#if ES_WIFI_USE_SPI_DMA
+    spi_signal_waiter();
+#endif /* ES_WIFI_USE_SPI_DMA */
   }
 }
 
@@ -511,10 +974,28 @@ void HAL_SPI_TxCpltCallback(SPI_HandleTypeDef *hspi)
   */
 void    SPI_WIFI_ISR(void)
 {
+#if ES_WIFI_USE_SPI_DMA
+   if (!WIFI_IS_CMDDATA_READY())
+   {
+     if (spi_rx_dma == 1)
+     {
+       /* falling edge: no more frames are clocked, the receive ends */
+       CLEAR_BIT(hspi.Instance->CR2, SPI_CR2_TXDMAEN);
+       spi_rx_dma = 0;
+       spi_rx_stopped = 1;
+       spi_rx_event = 0;
+       spi_signal_waiter();
+     }
+     return;
+   }
+#endif /* ES_WIFI_USE_SPI_DMA */
    if (cmddata_rdy_rising_event == 1)
    {
      SEM_SIGNAL(cmddata_rdy_rising_sem);
      cmddata_rdy_rising_event = 0;
+#if ES_WIFI_USE_SPI_DMA
+     spi_signal_waiter();
+#endif /* ES_WIFI_USE_SPI_DMA */
    }
 }
 
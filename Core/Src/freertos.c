@@ -32,6 +32,12 @@
 
 #include "task_sample_data.h"
 
+#include "task_stsafe.h"
+
+#include "task_entropy.h"
+
+#include "tls_memory.h"
+
 /* USER CODE END Includes */
 
 /* Private typedef -----------------------------------------------------------*/
@@ -60,7 +66,7 @@ GlobalState GLOBAL_STATE =
 osThreadId_t defaultTaskHandle;
 const osThreadAttr_t defaultTask_attributes = {
   .name = "defaultTask",
-  .stack_size = 64 * 4,
+  .stack_size = 128 * 4,
   .priority = (osPriority_t) osPriorityLow,
 };
 /* Definitions for mqttTask */
@@ -74,9 +80,23 @@ const osThreadAttr_t mqttTask_attributes = {
 osThreadId_t sampleDataTaskHandle;
 const osThreadAttr_t sampleDataTask_attributes = {
   .name = "sampleDataTask",
-  .stack_size = 128 * 4,
+  .stack_size = 512 * 4,
   .priority = (osPriority_t) osPriorityNormal,
 };
+/* Definitions for stsafeTask */
+osThreadId_t stsafeTaskHandle;
+const osThreadAttr_t stsafeTask_attributes = {
+  .name = "stsafeTask",
+  .stack_size = 512 * 4,
+  .priority = (osPriority_t) osPriorityAboveNormal,
+};
+/* Definitions for entropyTask */
+osThreadId_t entropyTaskHandle;
+const osThreadAttr_t entropyTask_attributes = {
+  .name = "entropyTask",
+  .stack_size = 256 * 4,
+  .priority = (osPriority_t) osPriorityLow,
+};
 
 /* Private function prototypes -----------------------------------------------*/
 /* USER CODE BEGIN FunctionPrototypes */
@@ -86,6 +106,8 @@ const osThreadAttr_t sampleDataTask_attributes = {
 void StartDefaultTask(void *argument);
 void StartMQTTTask(void *argument);
 void StartSampleDataTask(void *argument);
+void StartSTSAFETask(void *argument);
+void StartEntropyTask(void *argument);
 
 void MX_FREERTOS_Init(void); /* (MISRA C 2004 rule 8.1) */
 
@@ -96,7 +118,8 @@ void MX_FREERTOS_Init(void); /* (MISRA C 2004 rule 8.1) */
   */
 void MX_FREERTOS_Init(void) {
   /* USER CODE BEGIN Init */
-
+	// wolfSSL allocates from its pools from here on, no task may be running
+	TLSMemory_Init();
   /* USER CODE END Init */
 
   /* USER CODE BEGIN RTOS_MUTEX */
@@ -113,6 +136,7 @@ void MX_FREERTOS_Init(void) {
 
   /* USER CODE BEGIN RTOS_QUEUES */
 	/* add queues, ... */
+	stsafe_ServiceInit();
   /* USER CODE END RTOS_QUEUES */
 
   /* Create the thread(s) */
@@ -125,6 +149,12 @@ void MX_FREERTOS_Init(void) {
   /* creation of sampleDataTask */
   sampleDataTaskHandle = osThreadNew(StartSampleDataTask, NULL, &sampleDataTask_attributes);
 
+  /* creation of stsafeTask */
+  stsafeTaskHandle = osThreadNew(StartSTSAFETask, NULL, &stsafeTask_attributes);
+
+  /* creation of entropyTask */
+  entropyTaskHandle = osThreadNew(StartEntropyTask, NULL, &entropyTask_attributes);
+
   /* USER CODE BEGIN RTOS_THREADS */
 	/* add threads, ... */
   /* USER CODE END RTOS_THREADS */
@@ -186,6 +216,38 @@ void StartSampleDataTask(void *argument)
   /* USER CODE END StartSampleDataTask */
 }
 
+/* USER CODE BEGIN Header_StartSTSAFETask */
+/**
+ * @brief Function implementing the stsafeTask thread.
+ * @param argument: Not used
+ * @retval None
+ */
+/* USER CODE END Header_StartSTSAFETask */
+void StartSTSAFETask(void *argument)
+{
+  /* USER CODE BEGIN StartSTSAFETask */
+	/* Infinite loop */
+	GlobalState *state = &GLOBAL_STATE;
+	RunTaskSTSAFE(state);
+  /* USER CODE END StartSTSAFETask */
+}
+
+/* USER CODE BEGIN Header_StartEntropyTask */
+/**
+ * @brief Function implementing the entropyTask thread.
+ * @param argument: Not used
+ * @retval None
+ */
+/* USER CODE END Header_StartEntropyTask */
+void StartEntropyTask(void *argument)
+{
+  /* USER CODE BEGIN StartEntropyTask */
+	/* Infinite loop */
+	GlobalState *state = &GLOBAL_STATE;
+	RunTaskEntropy(state);
+  /* USER CODE END StartEntropyTask */
+}
+
 /* Private application code --------------------------------------------------*/
 /* USER CODE BEGIN Application */
 
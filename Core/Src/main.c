@@ -321,6 +321,19 @@ void SPI3_IRQHandler(void)
 	HAL_SPI_IRQHandler(&hspi);
 }
 
+#if ES_WIFI_USE_SPI_DMA
+// DMA request handlers for the Wifi module SPI receive and send
+void DMA2_Channel1_IRQHandler(void)
+{
+	HAL_DMA_IRQHandler(&hdma_spi3_rx);
+}
+
+void DMA2_Channel2_IRQHandler(void)
+{
+	HAL_DMA_IRQHandler(&hdma_spi3_tx);
+}
+#endif
+
 /* USER CODE END 4 */
 
 /**
@@ -0,0 +1,199 @@
+#include "stsafe_i2c_rtos.h"
+
+#include "main.h"
+#include "FreeRTOS.h"
+#include "task.h"
+
+#include "safea1_conf.h"
+#include "stsafea_service.h"
+
+#if (STSAFEA_USE_RTOS_I2C_BUS == 1U)
+
+// Must not be above configLIBRARY_MAX_SYSCALL_INTERRUPT_PRIORITY, the
+// completion callbacks notify the waiting task
+#define STSAFE_I2C_IRQ_PRIO configLIBRARY_MAX_SYSCALL_INTERRUPT_PRIORITY
+
+// Longest STSAFE frame at 400 kHz is ~15 ms, anything above is a stuck bus
+#define STSAFE_I2C_TRANSFER_TIMEOUT_MS 50U
+
+static TaskHandle_t volatile i2c_waiting_task = NULL;
+static volatile uint32_t i2c_error = HAL_I2C_ERROR_NONE;
+
+static bool stsafe_SchedulerRunning(void)
+{
+	return xTaskGetSchedulerState() == taskSCHEDULER_RUNNING;
+}
+
+static int32_t stsafe_BspToBusStatus(int32_t bspStatus)
+{
+	if (bspStatus == BSP_ERROR_NONE)
+	{
+		return STSAFEA_BUS_OK;
+	}
+
+	return STSAFEA_BUS_ERR;
+}
+
+/*
+ * Waits for the transfer started by the caller to complete and maps the HAL
+ * error to the bus status the service layer expects. A NACK is what the chip
+ * answers while it is still processing a command.
+ */
+static int32_t stsafe_I2C_WaitTransfer(uint16_t DevAddr)
+{
+	uint32_t notified = ulTaskNotifyTake(pdTRUE,
+			pdMS_TO_TICKS(STSAFE_I2C_TRANSFER_TIMEOUT_MS));
+
+	i2c_waiting_task = NULL;
+
+	if (notified == 0)
+	{
+		(void) HAL_I2C_Master_Abort_IT(&hi2c2, DevAddr);
+		return STSAFEA_BUS_ERR;
+	}
+
+	if (i2c_error == HAL_I2C_ERROR_NONE)
+	{
+		return STSAFEA_BUS_OK;
+	}
+
+	if ((i2c_error & HAL_I2C_ERROR_AF) != 0)
+	{
+		return STSAFEA_BUS_NACK;
+	}
+
+	return STSAFEA_BUS_ERR;
+}
+
+static void stsafe_I2C_PrepareTransfer(void)
+{
+	i2c_error = HAL_I2C_ERROR_NONE;
+	// drop a notification left over from an aborted transfer
+	(void) ulTaskNotifyTake(pdTRUE, 0);
+	i2c_waiting_task = xTaskGetCurrentTaskHandle();
+}
+
+int32_t stsafe_I2C_Init(void)
+{
+	int32_t ret = BSP_I2C2_Init();
+
+	if (ret == BSP_ERROR_NONE)
+	{
+		HAL_NVIC_SetPriority(I2C2_EV_IRQn, STSAFE_I2C_IRQ_PRIO, 0);
+		HAL_NVIC_EnableIRQ(I2C2_EV_IRQn);
+		HAL_NVIC_SetPriority(I2C2_ER_IRQn, STSAFE_I2C_IRQ_PRIO, 0);
+		HAL_NVIC_EnableIRQ(I2C2_ER_IRQn);
+	}
+
+	return stsafe_BspToBusStatus(ret);
+}
+
+int32_t stsafe_I2C_DeInit(void)
+{
+	HAL_NVIC_DisableIRQ(I2C2_EV_IRQn);
+	HAL_NVIC_DisableIRQ(I2C2_ER_IRQn);
+
+	return stsafe_BspToBusStatus(BSP_I2C2_DeInit());
+}
+
+int32_t stsafe_I2C_Send(uint16_t DevAddr, uint8_t *pData, uint16_t Length)
+{
+	if (!stsafe_SchedulerRunning())
+	{
+		if (HAL_I2C_Master_Transmit(&hi2c2, DevAddr, pData, Length,
+		BUS_I2C2_POLL_TIMEOUT) == HAL_OK)
+		{
+			return STSAFEA_BUS_OK;
+		}
+		return (HAL_I2C_GetError(&hi2c2) & HAL_I2C_ERROR_AF) != 0 ?
+				STSAFEA_BUS_NACK : STSAFEA_BUS_ERR;
+	}
+
+	stsafe_I2C_PrepareTransfer();
+
+	if (HAL_I2C_Master_Transmit_IT(&hi2c2, DevAddr, pData, Length) != HAL_OK)
+	{
+		i2c_waiting_task = NULL;
+		return STSAFEA_BUS_ERR;
+	}
+
+	return stsafe_I2C_WaitTransfer(DevAddr);
+}
+
+int32_t stsafe_I2C_Recv(uint16_t DevAddr, uint8_t *pData, uint16_t Length)
+{
+	if (!stsafe_SchedulerRunning())
+	{
+		if (HAL_I2C_Master_Receive(&hi2c2, DevAddr, pData, Length,
+		BUS_I2C2_POLL_TIMEOUT) == HAL_OK)
+		{
+			return STSAFEA_BUS_OK;
+		}
+		return (HAL_I2C_GetError(&hi2c2) & HAL_I2C_ERROR_AF) != 0 ?
+				STSAFEA_BUS_NACK : STSAFEA_BUS_ERR;
+	}
+
+	stsafe_I2C_PrepareTransfer();
+
+	if (HAL_I2C_Master_Receive_IT(&hi2c2, DevAddr, pData, Length) != HAL_OK)
+	{
+		i2c_waiting_task = NULL;
+		return STSAFEA_BUS_ERR;
+	}
+
+	return stsafe_I2C_WaitTransfer(DevAddr);
+}
+
+void stsafe_Delay(uint32_t msDelay)
+{
+	if (stsafe_SchedulerRunning())
+	{
+		// Round up so that the chip always gets at least msDelay
+		vTaskDelay(pdMS_TO_TICKS(msDelay) + 1);
+	}
+	else
+	{
+		HAL_Delay(msDelay);
+	}
+}
+
+static void stsafe_I2C_NotifyFromISR(I2C_HandleTypeDef *hi2c, uint32_t error)
+{
+	if (hi2c->Instance != I2C2 || i2c_waiting_task == NULL)
+	{
+		return;
+	}
+
+	BaseType_t higherPriorityTaskWoken = pdFALSE;
+	i2c_error = error;
+	vTaskNotifyGiveFromISR(i2c_waiting_task, &higherPriorityTaskWoken);
+	portYIELD_FROM_ISR(higherPriorityTaskWoken);
+}
+
+void HAL_I2C_MasterTxCpltCallback(I2C_HandleTypeDef *hi2c)
+{
+	stsafe_I2C_NotifyFromISR(hi2c, HAL_I2C_ERROR_NONE);
+}
+
+void HAL_I2C_MasterRxCpltCallback(I2C_HandleTypeDef *hi2c)
+{
+	stsafe_I2C_NotifyFromISR(hi2c, HAL_I2C_ERROR_NONE);
+}
+
+void HAL_I2C_ErrorCallback(I2C_HandleTypeDef *hi2c)
+{
+	stsafe_I2C_NotifyFromISR(hi2c, HAL_I2C_GetError(hi2c));
+}
+
+// I2C2 interruption request handlers for the STSAFE-A110
+void I2C2_EV_IRQHandler(void)
+{
+	HAL_I2C_EV_IRQHandler(&hi2c2);
+}
+
+void I2C2_ER_IRQHandler(void)
+{
+	HAL_I2C_ER_IRQHandler(&hi2c2);
+}
+
+#endif /* STSAFEA_USE_RTOS_I2C_BUS */
@@ -1,32 +1,304 @@
 #include "stsafe_interface.h"
 
+#include "task_stsafe.h"
+
 #include "wolfssl/wolfcrypt/asn_public.h"
+#include "wolfssl/wolfcrypt/asn.h"
 #include "wolfssl/wolfcrypt/ecc.h"
 
-#define STSAFE_A_PROD_CA_01_CERTIFICATE_PEM \
-"-----BEGIN CERTIFICATE-----\n" \
-"MIIBoDCCAUagAwIBAgIBATAKBggqhkjOPQQDAjBPMQswCQYDVQQGEwJOTDEeMBwGA1UECgwVU1RNaWNyb2VsZ\n" \
-"WN0cm9uaWNzIG52MSAwHgYDVQQDDBdTVE0gU1RTQUZFLUEgUFJPRCBDQSAwMTAeFw0xODA3MjcwMDAwMDBaFw\n" \
-"00ODA3MjcwMDAwMDBaME8xCzAJBgNVBAYTAk5MMR4wHAYDVQQKDBVTVE1pY3JvZWxlY3Ryb25pY3MgbnYxIDA\n" \
-"eBgNVBAMMF1NUTSBTVFNBRkUtQSBQUk9EIENBIDAxMFkwEwYHKoZIzj0CAQYIKoZIzj0DAQcDQgAEghlPJsyj\n" \
-"bg6CGVzmZljsZKRmki9YyeZLXeGinn85hj0EJpLkyKx5+W0v7VJ3TVKBlTnyHz7NGTj4PXCu4JzNjaMTMBEwD\n" \
-"wYDVR0TAQH/BAUwAwEB/zAKBggqhkjOPQQDAgNIADBFAiBu5UMyR6xyNPydF1qlHoMnaQGt7B8AXjcfQHNN44\n" \
-"zFLgIhALHZUWqtmj6G0iuOOzvQFG+rubki8EUmNP6Sf/XWNs2Q\n" \
-"-----END CERTIFICATE-----\n"
-
-#define PEM_CERT_MAX_SIZE 1024U
+/* STM STSAFE-A PROD CA 01, DER encoded */
+static const uint8_t STSAFE_A_PROD_CA_01_CERTIFICATE_DER[] =
+{
+	0x30, 0x82, 0x01, 0xA0, 0x30, 0x82, 0x01, 0x46, 0xA0, 0x03, 0x02, 0x01,
+	0x02, 0x02, 0x01, 0x01, 0x30, 0x0A, 0x06, 0x08, 0x2A, 0x86, 0x48, 0xCE,
+	0x3D, 0x04, 0x03, 0x02, 0x30, 0x4F, 0x31, 0x0B, 0x30, 0x09, 0x06, 0x03,
+	0x55, 0x04, 0x06, 0x13, 0x02, 0x4E, 0x4C, 0x31, 0x1E, 0x30, 0x1C, 0x06,
+	0x03, 0x55, 0x04, 0x0A, 0x0C, 0x15, 0x53, 0x54, 0x4D, 0x69, 0x63, 0x72,
+	0x6F, 0x65, 0x6C, 0x65, 0x63, 0x74, 0x72, 0x6F, 0x6E, 0x69, 0x63, 0x73,
+	0x20, 0x6E, 0x76, 0x31, 0x20, 0x30, 0x1E, 0x06, 0x03, 0x55, 0x04, 0x03,
+	0x0C, 0x17, 0x53, 0x54, 0x4D, 0x20, 0x53, 0x54, 0x53, 0x41, 0x46, 0x45,
+	0x2D, 0x41, 0x20, 0x50, 0x52, 0x4F, 0x44, 0x20, 0x43, 0x41, 0x20, 0x30,
+	0x31, 0x30, 0x1E, 0x17, 0x0D, 0x31, 0x38, 0x30, 0x37, 0x32, 0x37, 0x30,
+	0x30, 0x30, 0x30, 0x30, 0x30, 0x5A, 0x17, 0x0D, 0x34, 0x38, 0x30, 0x37,
+	0x32, 0x37, 0x30, 0x30, 0x30, 0x30, 0x30, 0x30, 0x5A, 0x30, 0x4F, 0x31,
+	0x0B, 0x30, 0x09, 0x06, 0x03, 0x55, 0x04, 0x06, 0x13, 0x02, 0x4E, 0x4C,
+	0x31, 0x1E, 0x30, 0x1C, 0x06, 0x03, 0x55, 0x04, 0x0A, 0x0C, 0x15, 0x53,
+	0x54, 0x4D, 0x69, 0x63, 0x72, 0x6F, 0x65, 0x6C, 0x65, 0x63, 0x74, 0x72,
+	0x6F, 0x6E, 0x69, 0x63, 0x73, 0x20, 0x6E, 0x76, 0x31, 0x20, 0x30, 0x1E,
+	0x06, 0x03, 0x55, 0x04, 0x03, 0x0C, 0x17, 0x53, 0x54, 0x4D, 0x20, 0x53,
+	0x54, 0x53, 0x41, 0x46, 0x45, 0x2D, 0x41, 0x20, 0x50, 0x52, 0x4F, 0x44,
+	0x20, 0x43, 0x41, 0x20, 0x30, 0x31, 0x30, 0x59, 0x30, 0x13, 0x06, 0x07,
+	0x2A, 0x86, 0x48, 0xCE, 0x3D, 0x02, 0x01, 0x06, 0x08, 0x2A, 0x86, 0x48,
+	0xCE, 0x3D, 0x03, 0x01, 0x07, 0x03, 0x42, 0x00, 0x04, 0x82, 0x19, 0x4F,
+	0x26, 0xCC, 0xA3, 0x6E, 0x0E, 0x82, 0x19, 0x5C, 0xE6, 0x66, 0x58, 0xEC,
+	0x64, 0xA4, 0x66, 0x92, 0x2F, 0x58, 0xC9, 0xE6, 0x4B, 0x5D, 0xE1, 0xA2,
+	0x9E, 0x7F, 0x39, 0x86, 0x3D, 0x04, 0x26, 0x92, 0xE4, 0xC8, 0xAC, 0x79,
+	0xF9, 0x6D, 0x2F, 0xED, 0x52, 0x77, 0x4D, 0x52, 0x81, 0x95, 0x39, 0xF2,
+	0x1F, 0x3E, 0xCD, 0x19, 0x38, 0xF8, 0x3D, 0x70, 0xAE, 0xE0, 0x9C, 0xCD,
+	0x8D, 0xA3, 0x13, 0x30, 0x11, 0x30, 0x0F, 0x06, 0x03, 0x55, 0x1D, 0x13,
+	0x01, 0x01, 0xFF, 0x04, 0x05, 0x30, 0x03, 0x01, 0x01, 0xFF, 0x30, 0x0A,
+	0x06, 0x08, 0x2A, 0x86, 0x48, 0xCE, 0x3D, 0x04, 0x03, 0x02, 0x03, 0x48,
+	0x00, 0x30, 0x45, 0x02, 0x20, 0x6E, 0xE5, 0x43, 0x32, 0x47, 0xAC, 0x72,
+	0x34, 0xFC, 0x9D, 0x17, 0x5A, 0xA5, 0x1E, 0x83, 0x27, 0x69, 0x01, 0xAD,
+	0xEC, 0x1F, 0x00, 0x5E, 0x37, 0x1F, 0x40, 0x73, 0x4D, 0xE3, 0x8C, 0xC5,
+	0x2E, 0x02, 0x21, 0x00, 0xB1, 0xD9, 0x51, 0x6A, 0xAD, 0x9A, 0x3E, 0x86,
+	0xD2, 0x2B, 0x8E, 0x3B, 0x3B, 0xD0, 0x14, 0x6F, 0xAB, 0xB9, 0xB9, 0x22,
+	0xF0, 0x45, 0x26, 0x34, 0xFE, 0x92, 0x7F, 0xF5, 0xD6, 0x36, 0xCD, 0x90
+};
 
 #define STSAFE_MAX_KEY_LEN ((uint32_t)48) /* for up to 384-bit keys */
 #define STSAFE_MAX_PUBKEY_RAW_LEN ((uint32_t)STSAFE_MAX_KEY_LEN * 2) /* x/y */
 #define STSAFE_MAX_SIG_LEN ((uint32_t)STSAFE_MAX_KEY_LEN * 2) /* r/s */
 
-static uint8_t cert_read_buffer[STSAFEA_MAX_CERTIFICATE_SIZE];
+#define STSAFE_ENVELOPE_KEY_SLOT STSAFEA_KEY_SLOT_0
+#define STSAFE_ENVELOPE_KEY_TYPE STSAFEA_KEY_TYPE_AES_128
+
+#define STSAFE_EPHEMERAL_KEY_CURVE STSAFEA_NIST_P_256
+#define STSAFE_EPHEMERAL_KEY_AUTH_FLAGS \
+	(STSAFEA_PRVKEY_MODOPER_AUTHFLAG_CMD_RESP_SIGNEN | \
+	STSAFEA_PRVKEY_MODOPER_AUTHFLAG_MSG_DGST_SIGNEN | \
+	STSAFEA_PRVKEY_MODOPER_AUTHFLAG_KEY_ESTABLISHEN)
+
+/*
+ * Client certificate chain as handed to wolfSSL: the zone 0 leaf followed by
+ * STSAFE_A_PROD_CA_01, both DER. Filled once per boot by the first
+ * stsafea_load_client_cert and reused by every reconnect.
+ */
+typedef struct
+{
+	bool valid;
+	size_t chainSize;
+	uint8_t chain[STSAFEA_MAX_CERTIFICATE_SIZE
+			+ sizeof(STSAFE_A_PROD_CA_01_CERTIFICATE_DER)];
+} ClientCertCache_t;
+
+static ClientCertCache_t client_cert_cache =
+{ 0 };
+
+/*
+ * Ephemeral key readiness state. The EPHEMERAL slot has a use limit of 1, so a
+ * ready key is consumed by exactly one EstablishKey. Only the STSAFE task
+ * changes it, other tasks just read the flags and the stats.
+ */
+typedef struct
+{
+	volatile bool ready; // the EPHEMERAL slot holds an unused key pair
+	volatile bool issued; // its public key went out in a TLS 1.3 key share
+	volatile bool requestPending; // a pre-generation request is queued
+	StsafeRequest_t request;
+	uint8_t pubKeyX[STSAFE_MAX_KEY_LEN];
+	uint8_t pubKeyY[STSAFE_MAX_KEY_LEN];
+	uint32_t generationTimeMs; // time spent generating the cached key
+	EphemeralKeyStats_t stats;
+} EphemeralKeyState_t;
+
+static EphemeralKeyState_t ephemeral_key =
+{ 0 };
+
+/*
+ * Boot benchmark vector: a P-256 public key (SubjectPublicKeyInfo), the
+ * SHA-256 of "STSAFE dispatch benchmark" and a valid DER signature over it.
+ */
+static const uint8_t DISPATCH_BENCHMARK_KEY_DER[] =
+{
+	0x30, 0x59, 0x30, 0x13, 0x06, 0x07, 0x2A, 0x86, 0x48, 0xCE, 0x3D, 0x02,
+	0x01, 0x06, 0x08, 0x2A, 0x86, 0x48, 0xCE, 0x3D, 0x03, 0x01, 0x07, 0x03,
+	0x42, 0x00, 0x04, 0xA7, 0xC8, 0x53, 0x13, 0x68, 0xAD, 0x43, 0xC0, 0xDA,
+	0xBE, 0xD5, 0xB4, 0x95, 0xFE, 0xBF, 0x60, 0xAB, 0x10, 0xF6, 0x6F, 0x54,
+	0xEF, 0x2B, 0xC0, 0xCE, 0x59, 0x45, 0xCA, 0x29, 0x16, 0x34, 0x67, 0xFC,
+	0xA0, 0xD3, 0x89, 0x6F, 0xEC, 0x68, 0x1E, 0x65, 0x13, 0x81, 0xF2, 0xA0,
+	0x1F, 0xEE, 0x3F, 0x4D, 0xDC, 0x3E, 0x4E, 0x43, 0xD0, 0x43, 0xEB, 0x03,
+	0x20, 0x38, 0x6D, 0x83, 0xE9, 0x8A, 0x95
+};
+
+static const uint8_t DISPATCH_BENCHMARK_DIGEST[] =
+{
+	0xB7, 0x55, 0x62, 0xFF, 0x03, 0x62, 0x73, 0x33, 0xEF, 0x2D, 0xA9, 0xA3,
+	0xC3, 0x87, 0x0E, 0x66, 0x1C, 0xFB, 0xE8, 0x88, 0x95, 0xEA, 0x56, 0xF5,
+	0x98, 0x4F, 0xD6, 0x98, 0xAF, 0x04, 0xC3, 0x2A
+};
+
+static const uint8_t DISPATCH_BENCHMARK_SIGNATURE_DER[] =
+{
+	0x30, 0x46, 0x02, 0x21, 0x00, 0xC4, 0xB8, 0x65, 0xDE, 0x8B, 0x82, 0x44,
+	0xA1, 0x9E, 0x89, 0xD8, 0xC3, 0x86, 0x81, 0xF5, 0x2D, 0x6A, 0xBE, 0x28,
+	0xA4, 0x76, 0x75, 0x1E, 0xC6, 0x38, 0x88, 0xB9, 0x8F, 0x5B, 0x79, 0xF6,
+	0x78, 0x02, 0x21, 0x00, 0xDD, 0x55, 0xC5, 0xC4, 0xB8, 0xAB, 0x39, 0x86,
+	0x2A, 0x08, 0x1F, 0x6D, 0x4E, 0xA5, 0xB4, 0x2F, 0xBE, 0xF2, 0x1F, 0x0D,
+	0x08, 0xCD, 0x7D, 0xD8, 0x96, 0x4B, 0xE9, 0xEB, 0xAF, 0x10, 0x6D, 0xD3
+};
+
+#define DISPATCH_BENCHMARK_RUNS 4
+
+/*
+ * Routing state of the crypto dispatcher. Verification of peer signatures
+ * only involves public data, so it may run on either engine; everything that
+ * uses a chip private key stays on the chip. Until the boot benchmark has run
+ * verification stays on the chip, as it always was.
+ */
+typedef struct
+{
+	bool calibrated;
+	CryptoDispatchStats_t stats;
+} CryptoDispatchState_t;
+
+static CryptoDispatchState_t crypto_dispatch =
+{ .calibrated = false, .stats =
+{ .verifyEngine = CRYPTO_ENGINE_STSAFE } };
+
+static PkCallStats_t pk_call_stats =
+{ 0 };
+
+/* Arguments of the operations the PK callbacks run in the STSAFE task */
+
+typedef struct
+{
+	StSafeA_ProductDataBuffer_t productData;
+	uint16_t certificateSize;
+} ClientCertReadArgs_t;
+
+typedef struct
+{
+	StSafeA_LVBuffer_t PubX;
+	StSafeA_LVBuffer_t PubY;
+	StSafeA_LVBuffer_t SignatureR;
+	StSafeA_LVBuffer_t SignatureS;
+	StSafeA_LVBuffer_t Digest;
+	StSafeA_VerifySignatureBuffer_t Result;
+} VerifySignatureArgs_t;
+
+typedef struct
+{
+	StSafeA_LVBuffer_t OtherKeyX;
+	StSafeA_LVBuffer_t OtherKeyY;
+	bool useIssuedKey; // TLS 1.3, the key pair was made by stsafe_KeyGenCb
+	uint8_t pubKeyX[STSAFE_MAX_KEY_LEN];
+	uint8_t pubKeyY[STSAFE_MAX_KEY_LEN];
+	StSafeA_SharedSecretBuffer_t SharedSecret;
+} EstablishKeyArgs_t;
+
+typedef struct
+{
+	uint8_t pubKeyX[STSAFE_MAX_KEY_LEN];
+	uint8_t pubKeyY[STSAFE_MAX_KEY_LEN];
+} IssueKeyArgs_t;
+
+typedef struct
+{
+	const uint8_t *Digest;
+	StSafeA_LVBuffer_t SignR;
+	StSafeA_LVBuffer_t SignS;
+} GenerateSignatureArgs_t;
+
+typedef struct
+{
+	const uint8_t *Input;
+	uint16_t InputLength;
+	StSafeA_LVBuffer_t Output;
+} EnvelopeArgs_t;
+
+// Only the STSAFE task uses it, set once the envelope key is known to exist
+static bool envelope_key_present = false;
+
+// Adds a finished operation, started at start, to the dispatch stats
+static void stsafe_DispatchRecord(CryptoOperation_t operation, uint32_t start)
+{
+	uint32_t elapsedMs = HAL_GetTick() - start;
+	CryptoOperationStats_t *stats = &crypto_dispatch.stats.operations[operation];
+
+	// recorded from the MQTT and the sample data tasks
+	taskENTER_CRITICAL();
+	stats->count++;
+	stats->totalMs += elapsedMs;
+	if (elapsedMs > stats->maxMs)
+	{
+		stats->maxMs = elapsedMs;
+	}
+	taskEXIT_CRITICAL();
+}
+
+/*
+ * Runs a handshake request without holding the connecting task for all of it.
+ * wolfSSL here has no async crypt backend, so the callback cannot hand
+ * WC_PENDING_E back and be re-entered later. Instead, while the chip works,
+ * the rest of the server flight is read into the connection's read-ahead
+ * (the WiFi module is on SPI, the STSAFE on I2C). Once the socket has nothing
+ * more the task blocks until the chip is done.
+ */
+static StSafeA_ResponseCode_t stsafe_PkCall(NetworkContext_t *NetworkContext,
+		StsafeOperation_t operation, void *args)
+{
+	StsafeRequest_t request;
+
+	uint32_t start = HAL_GetTick();
+	if (!stsafe_ServiceStart(STSAFE_PRIORITY_HANDSHAKE, &request, operation,
+			args))
+	{
+		return STSAFEA_UNEXPECTED_ERROR;
+	}
+
+	if (NetworkContext != NULL)
+	{
+		int32_t prefetched = 0;
+		while (!stsafe_ServiceIsDone(&request)
+				&& (prefetched = TLSHandshakePrefetch(NetworkContext)) > 0)
+		{
+			pk_call_stats.prefetchedBytes += (uint32_t) prefetched;
+		}
+	}
+	uint32_t overlapEnd = HAL_GetTick();
+
+	StSafeA_ResponseCode_t result = stsafe_ServiceWait(&request);
+	uint32_t end = HAL_GetTick();
+
+	pk_call_stats.calls++;
+	pk_call_stats.chipMs += end - start;
+	pk_call_stats.overlappedMs += overlapEnd - start;
+	pk_call_stats.blockedMs += end - overlapEnd;
+
+	return result;
+}
+
+void stsafe_ResetPkCallStats(void)
+{
+	memset(&pk_call_stats, 0, sizeof(pk_call_stats));
+}
+
+void stsafe_GetPkCallStats(PkCallStats_t *stats)
+{
+	*stats = pk_call_stats;
+}
+
+/*
+ * Generates a new key pair in the EPHEMERAL slot and returns its public point.
+ * Runs in the STSAFE task.
+ */
+static StSafeA_ResponseCode_t stsafe_GenerateEphemeralKey(
+		StSafeA_Handle_t *stsafeHandle, uint8_t *pubKeyX_data,
+		uint8_t *pubKeyY_data)
+{
+	memset(pubKeyX_data, 0, STSAFE_MAX_KEY_LEN);
+	memset(pubKeyY_data, 0, STSAFE_MAX_KEY_LEN);
+	StSafeA_LVBuffer_t PubKeyX =
+	{ .Data = pubKeyX_data, .Length = STSAFE_MAX_KEY_LEN };
+	StSafeA_LVBuffer_t PubKeyY =
+	{ .Data = pubKeyY_data, .Length = STSAFE_MAX_KEY_LEN };
+
+	uint8_t PointRepresentationId = 0;
 
-static uint8_t cert_chain_buffer[PEM_CERT_MAX_SIZE + sizeof(STSAFE_A_PROD_CA_01_CERTIFICATE_PEM)];
+	return StSafeA_GenerateKeyPair(stsafeHandle, STSAFEA_KEY_SLOT_EPHEMERAL,
+			0xFFFF, STSAFEA_FLAG_FALSE, STSAFE_EPHEMERAL_KEY_AUTH_FLAGS,
+			STSAFE_EPHEMERAL_KEY_CURVE, STSAFE_MAX_KEY_LEN,
+			&PointRepresentationId, &PubKeyX, &PubKeyY, STSAFEA_MAC_NONE);
+}
 
+/* Called by the STSAFE task before it serves any request */
 bool stsafea_init(StSafeA_Handle_t *stsafea_handle,
 		uint8_t *a_rx_tx_stsafea_data)
 {
+	/* Whatever the EPHEMERAL slot held before (re)initialization is gone */
+	stsafe_EphemeralKeyInvalidate();
+
 	StSafeA_ResponseCode_t init_status = STSAFEA_UNEXPECTED_ERROR;
 	init_status = StSafeA_Init(stsafea_handle, a_rx_tx_stsafea_data);
 	if (init_status == STSAFEA_OK)
@@ -67,10 +339,148 @@ bool stsafea_init(StSafeA_Handle_t *stsafea_handle,
 	return true;
 }
 
-bool stsafea_load_client_cert(StSafeA_Handle_t *stsafea_handle,
-		NetworkCredentials_t *NetworkCredentials)
+void stsafe_EphemeralKeyInvalidate(void)
 {
-	printf("Reading leaf stsafe-a cert from zone 0....\r\n");
+	if (ephemeral_key.ready)
+	{
+		ephemeral_key.stats.invalidated++;
+	}
+	ephemeral_key.ready = false;
+	ephemeral_key.issued = false;
+	ephemeral_key.generationTimeMs = 0;
+}
+
+static StSafeA_ResponseCode_t stsafe_EphemeralKeyGenerateOp(
+		StSafeA_Handle_t *stsafeHandle, void *args)
+{
+	// a handshake may have run between the post and now, or be waiting for
+	// the server's key share with the key in the slot
+	if (ephemeral_key.ready || ephemeral_key.issued)
+	{
+		return STSAFEA_OK;
+	}
+
+	uint32_t start = HAL_GetTick();
+	StSafeA_ResponseCode_t generateKeyPairResponse =
+			stsafe_GenerateEphemeralKey(stsafeHandle, ephemeral_key.pubKeyX,
+					ephemeral_key.pubKeyY);
+
+	if (generateKeyPairResponse == STSAFEA_OK)
+	{
+		ephemeral_key.generationTimeMs = HAL_GetTick() - start;
+		ephemeral_key.ready = true;
+		ephemeral_key.stats.pregenerated++;
+	}
+	else
+	{
+		printf(
+				"EphemeralKeyPrepare: Got error from StSafeA_GenerateKeyPair: %d\r\n",
+				generateKeyPairResponse);
+	}
+
+	return generateKeyPairResponse;
+}
+
+static void stsafe_EphemeralKeyGenerated(StsafeRequest_t *request)
+{
+	ephemeral_key.requestPending = false;
+}
+
+bool stsafe_EphemeralKeyPrepare(void)
+{
+	if (ephemeral_key.ready || ephemeral_key.requestPending)
+	{
+		return ephemeral_key.ready;
+	}
+
+	ephemeral_key.requestPending = true;
+	ephemeral_key.request.operation = stsafe_EphemeralKeyGenerateOp;
+	ephemeral_key.request.args = NULL;
+	ephemeral_key.request.onComplete = stsafe_EphemeralKeyGenerated;
+	ephemeral_key.request.waitingTask = NULL;
+
+	if (!stsafe_ServicePost(STSAFE_PRIORITY_BACKGROUND, &ephemeral_key.request))
+	{
+		ephemeral_key.requestPending = false;
+	}
+
+	return false;
+}
+
+// The public key went out, the slot must not serve another handshake
+static StSafeA_ResponseCode_t stsafe_EphemeralKeyAbandonOp(
+		StSafeA_Handle_t *stsafeHandle, void *args)
+{
+	ephemeral_key.issued = false;
+
+	return STSAFEA_OK;
+}
+
+void stsafe_EphemeralKeyAbandon(void)
+{
+	if (!ephemeral_key.issued)
+	{
+		return;
+	}
+
+	stsafe_ServiceCall(STSAFE_PRIORITY_HANDSHAKE, stsafe_EphemeralKeyAbandonOp,
+	NULL);
+	stsafe_EphemeralKeyPrepare();
+}
+
+void stsafe_GetEphemeralKeyStats(EphemeralKeyStats_t *stats)
+{
+	*stats = ephemeral_key.stats;
+}
+
+/*
+ * The serial number of the ST provisioned leaf certificate is the chip's ST
+ * number. Parsing the certificate also rejects a zone 0 that does not hold a
+ * well-formed certificate.
+ */
+static bool stsafea_cert_matches_serial(const uint8_t *certDer,
+		uint16_t certSize, const uint8_t *stNumber)
+{
+	DecodedCert cert;
+	wc_InitDecodedCert(&cert, certDer, certSize, NULL);
+
+	int parseResult = wc_ParseCert(&cert, CERT_TYPE, NO_VERIFY, NULL);
+	bool matches = parseResult == 0
+			&& cert.serialSz >= (int) STSAFEA_ST_NUMBER_LENGTH
+			&& memcmp(&cert.serial[cert.serialSz - STSAFEA_ST_NUMBER_LENGTH],
+					stNumber, STSAFEA_ST_NUMBER_LENGTH) == 0;
+
+	if (parseResult != 0)
+	{
+		printf("Could not parse zone 0 certificate. Error: %d\r\n",
+				parseResult);
+	}
+
+	wc_FreeDecodedCert(&cert);
+
+	return matches;
+}
+
+/* Reads the product data and the zone 0 certificate into the cache */
+static StSafeA_ResponseCode_t stsafea_read_client_cert(
+		StSafeA_Handle_t *stsafea_handle, void *args)
+{
+	ClientCertReadArgs_t *readArgs = (ClientCertReadArgs_t*) args;
+
+	StSafeA_ResponseCode_t productDataStatus = StSafeA_ProductDataQuery(
+			stsafea_handle, &readArgs->productData, STSAFEA_MAC_NONE);
+
+	if (productDataStatus != STSAFEA_OK)
+	{
+		printf("Product data query failed. Error code: %d\r\n",
+				productDataStatus);
+		return productDataStatus;
+	}
+	if (readArgs->productData.STNumberLength != STSAFEA_ST_NUMBER_LENGTH)
+	{
+		printf("Product data query returned an invalid ST number\r\n");
+		return STSAFEA_INVALID_RESP_LENGTH;
+	}
 
 	StSafeA_LVBuffer_t sts_cert_size_read;
 	uint8_t data_sts_cert_size_read[STSAFEA_NUMBER_OF_BYTES_TO_GET_CERTIFICATE_SIZE];
@@ -87,7 +497,7 @@ bool stsafea_load_client_cert(StSafeA_Handle_t *stsafea_handle,
 	if (readCertSizeStatus != STSAFEA_OK)
 	{
 		printf("Read cert size failed. Error code: %d\r\n", readCertSizeStatus);
-		return false;
+		return readCertSizeStatus;
 	}
 
 	uint16_t CertificateSize = 0;
@@ -110,17 +520,17 @@ bool stsafea_load_client_cert(StSafeA_Handle_t *stsafea_handle,
 		break;
 	}
 
-	if (CertificateSize == 0)
+	if (CertificateSize == 0 || CertificateSize > STSAFEA_MAX_CERTIFICATE_SIZE)
 	{
 		printf("Could not retrieve certificate size\r\n");
-		return false;
+		return STSAFEA_INVALID_RESP_LENGTH;
 	}
 
 	printf("Got certificate size: %u\r\n", CertificateSize);
 
 	StSafeA_LVBuffer_t sts_cert_read;
 	sts_cert_read.Length = CertificateSize;
-	sts_cert_read.Data = (uint8_t*) cert_read_buffer;
+	sts_cert_read.Data = client_cert_cache.chain;
 
 	StSafeA_ResponseCode_t readCertStatus = STSAFEA_UNEXPECTED_ERROR;
 	readCertStatus = StSafeA_Read(stsafea_handle, 0, 0, STSAFEA_AC_ALWAYS, 0, 0,
@@ -129,55 +539,85 @@ bool stsafea_load_client_cert(StSafeA_Handle_t *stsafea_handle,
 
 	if (readCertStatus != STSAFEA_OK)
 	{
-		printf("Read cert failed. Error code: %d\r\n", readCertSizeStatus);
-		return false;
+		printf("Read cert failed. Error code: %d\r\n", readCertStatus);
+		return readCertStatus;
 	}
 
-	uint8_t pemCert[PEM_CERT_MAX_SIZE];
-	memset(pemCert, 0, PEM_CERT_MAX_SIZE);
+	readArgs->certificateSize = CertificateSize;
+
+	return STSAFEA_OK;
+}
 
-	int convert_result_size = wc_DerToPem(cert_read_buffer, CertificateSize, pemCert,
-	PEM_CERT_MAX_SIZE, CERT_TYPE);
+static bool stsafea_fill_client_cert_cache(void)
+{
+	printf("Reading leaf stsafe-a cert from zone 0....\r\n");
 
-	if (convert_result_size < 0)
+	ClientCertReadArgs_t readArgs =
+	{ 0 };
+	if (stsafe_ServiceCall(STSAFE_PRIORITY_HANDSHAKE, stsafea_read_client_cert,
+			&readArgs) != STSAFEA_OK)
 	{
-		printf(
-				"Could not convert cert to PEM format. Error: %d\r\n",
-				convert_result_size);
 		return false;
 	}
 
-	printf("\r\nSTSAFE-A110 Leaf Certificate:\r\n");
-	// Just add '\r' on new lines
-	for (int i = 0; i < convert_result_size; ++i)
+	// checked here, the certificate parse needs more stack than the STSAFE task has
+	if (!stsafea_cert_matches_serial(client_cert_cache.chain,
+			readArgs.certificateSize, readArgs.productData.STNumber))
 	{
-		if (pemCert[i] == '\n')
-		{
-			putchar('\r');
-		}
-		putchar(pemCert[i]);
+		printf("Zone 0 certificate does not belong to this chip\r\n");
+		return false;
 	}
-	printf("\r\n");
 
-	// concatenate the stsafe-a built-in certificate with the st root certificate
-	memset(cert_chain_buffer, 0, sizeof(cert_chain_buffer));
-	memcpy(cert_chain_buffer, pemCert, convert_result_size);
-	memcpy(&cert_chain_buffer[convert_result_size], STSAFE_A_PROD_CA_01_CERTIFICATE_PEM, sizeof(STSAFE_A_PROD_CA_01_CERTIFICATE_PEM));
-	size_t chainSize = convert_result_size + sizeof(STSAFE_A_PROD_CA_01_CERTIFICATE_PEM);
+	// the stsafe-a leaf certificate followed by the st root certificate
+	memcpy(&client_cert_cache.chain[readArgs.certificateSize],
+			STSAFE_A_PROD_CA_01_CERTIFICATE_DER,
+			sizeof(STSAFE_A_PROD_CA_01_CERTIFICATE_DER));
+	client_cert_cache.chainSize = readArgs.certificateSize
+			+ sizeof(STSAFE_A_PROD_CA_01_CERTIFICATE_DER);
+	client_cert_cache.valid = true;
+
+	return true;
+}
+
+bool stsafea_load_client_cert(NetworkCredentials_t *NetworkCredentials)
+{
+	if (!client_cert_cache.valid && !stsafea_fill_client_cert_cache())
+	{
+		return false;
+	}
 
-	NetworkCredentials->pClientCert = cert_chain_buffer;
-	NetworkCredentials->clientCertSize = chainSize;
+	NetworkCredentials->pClientCert = client_cert_cache.chain;
+	NetworkCredentials->clientCertSize = client_cert_cache.chainSize;
 
 	return true;
 }
 
-int stsafe_VerifyPeerCertCb(WOLFSSL *ssl, const unsigned char *sig,
-		unsigned int sigSz, const unsigned char *hash, unsigned int hashSz,
-		const unsigned char *keyDer, unsigned int keySz, int *result, void *ctx)
+static StSafeA_ResponseCode_t stsafe_VerifySignatureOp(
+		StSafeA_Handle_t *stsafeHandle, void *args)
 {
-	NetworkContext_t *netCtx = (NetworkContext_t*) ctx;
-	StSafeA_Handle_t *stsafeHandle = &(netCtx->sslContext.stsafea_handle);
+	VerifySignatureArgs_t *verifyArgs = (VerifySignatureArgs_t*) args;
 
+	return StSafeA_VerifyMessageSignature(stsafeHandle, STSAFEA_NIST_P_256,
+			&verifyArgs->PubX, &verifyArgs->PubY, &verifyArgs->SignatureR,
+			&verifyArgs->SignatureS, &verifyArgs->Digest, &verifyArgs->Result,
+			STSAFEA_MAC_NONE);
+}
+
+/* Left pads a big-endian integer to size bytes, the chip wants fixed lengths */
+static void stsafe_PadToKeySize(uint8_t *value, unsigned int length,
+		unsigned int size)
+{
+	if (length < size)
+	{
+		memmove(&value[size - length], value, length);
+		memset(value, 0, size - length);
+	}
+}
+
+static int stsafe_VerifyOnChip(NetworkContext_t *NetworkContext,
+		ecc_key *key, const unsigned char *sig, unsigned int sigSz,
+		const unsigned char *hash, unsigned int hashSz, int *result)
+{
 	int err = 0;
 
 	uint8_t pubKeyX[STSAFE_MAX_PUBKEY_RAW_LEN / 2];
@@ -195,119 +635,321 @@ int stsafe_VerifyPeerCertCb(WOLFSSL *ssl, const unsigned char *sig,
 	unsigned int sigRLen = sizeof(sigR);
 	unsigned int sigSLen = sizeof(sigS);
 
-	ecc_key key;
-	err = wc_ecc_init(&key);
+	err = wc_ecc_export_public_raw(key, pubKeyX, &pubKeyXLen, pubKeyY,
+			&pubKeyYLen);
 	if (err != 0)
 	{
-		goto ret;
+		return err;
 	}
 
-	word32 inOutIdx = 0;
-	err = wc_EccPublicKeyDecode(keyDer, &inOutIdx, &key, keySz);
+	err = wc_ecc_sig_to_rs(sig, sigSz, sigR, &sigRLen, sigS, &sigSLen);
 	if (err != 0)
 	{
-		goto ret;
-	}
-	err = wc_ecc_export_public_raw(&key, pubKeyX, &pubKeyXLen, pubKeyY,
-			&pubKeyYLen);
-	if (err != 0)
-	{
-		goto ret;
+		return err;
 	}
 
-	err = wc_ecc_sig_to_rs(sig, sigSz, sigS, &sigSLen, sigR, &sigRLen);
-	if (err != 0)
+	// r and s come out of the DER without leading zeros
+	unsigned int keySize = (unsigned int) wc_ecc_size(key);
+	if (sigRLen > keySize || sigSLen > keySize)
 	{
-		goto ret;
+		return ECC_BAD_ARG_E;
 	}
+	stsafe_PadToKeySize(sigR, sigRLen, keySize);
+	stsafe_PadToKeySize(sigS, sigSLen, keySize);
 
-	StSafeA_LVBuffer_t PubX =
-	{ .Data = pubKeyX, .Length = (uint16_t) pubKeyXLen };
-	StSafeA_LVBuffer_t PubY =
-	{ .Data = pubKeyY, .Length = (uint16_t) pubKeyYLen };
-	StSafeA_LVBuffer_t SignatureR =
-	{ .Data = sigR, .Length = (uint16_t) sigRLen };
-	StSafeA_LVBuffer_t SignatureS =
-	{ .Data = sigS, .Length = (uint16_t) sigSLen };
-
-	StSafeA_LVBuffer_t InDigest =
-	{ .Data = (uint8_t*) hash, .Length = (uint16_t) hashSz };
-
-	StSafeA_VerifySignatureBuffer_t verificationResultBuffer =
+	VerifySignatureArgs_t verifyArgs =
 	{ 0 };
-
-	StSafeA_ResponseCode_t verifySignatureResult = STSAFEA_UNEXPECTED_ERROR;
-	verifySignatureResult = StSafeA_VerifyMessageSignature(stsafeHandle,
-			STSAFEA_NIST_P_256, &PubX, &PubY, &SignatureR, &SignatureS,
-			&InDigest, &verificationResultBuffer, STSAFEA_MAC_NONE);
+	verifyArgs.PubX = (StSafeA_LVBuffer_t )
+			{ .Data = pubKeyX, .Length = (uint16_t) pubKeyXLen };
+	verifyArgs.PubY = (StSafeA_LVBuffer_t )
+			{ .Data = pubKeyY, .Length = (uint16_t) pubKeyYLen };
+	verifyArgs.SignatureR = (StSafeA_LVBuffer_t )
+			{ .Data = sigR, .Length = (uint16_t) keySize };
+	verifyArgs.SignatureS = (StSafeA_LVBuffer_t )
+			{ .Data = sigS, .Length = (uint16_t) keySize };
+	verifyArgs.Digest = (StSafeA_LVBuffer_t )
+			{ .Data = (uint8_t*) hash, .Length = (uint16_t) hashSz };
+
+	StSafeA_ResponseCode_t verifySignatureResult = stsafe_PkCall(
+			NetworkContext, stsafe_VerifySignatureOp, &verifyArgs);
 
 	if (verifySignatureResult != STSAFEA_OK)
 	{
 		printf(
 				"VerifyPeerCertCb: Got error from StSafeA_VerifyMessageSignature: %d\r\n",
 				verifySignatureResult);
-		err = -verifySignatureResult;
 		*result = 0;
-		goto ret;
+		return -verifySignatureResult;
 	}
 
-	err = 0;
-	*result = 1;
+	// the command succeeds for a wrong signature too
+	*result = verifyArgs.Result.SignatureValidity != 0;
 
-	ret:
+	return 0;
+}
+
+static int stsafe_VerifyWithEngine(CryptoEngine_t engine,
+		NetworkContext_t *NetworkContext, const unsigned char *sig,
+		unsigned int sigSz, const unsigned char *hash, unsigned int hashSz,
+		const unsigned char *keyDer, unsigned int keySz, int *result)
+{
+	*result = 0;
+
+	ecc_key key;
+	int err = wc_ecc_init(&key);
+	if (err != 0)
+	{
+		return err;
+	}
+
+	word32 inOutIdx = 0;
+	err = wc_EccPublicKeyDecode(keyDer, &inOutIdx, &key, keySz);
+	if (err == 0)
+	{
+		if (engine == CRYPTO_ENGINE_HOST)
+		{
+			err = wc_ecc_verify_hash(sig, sigSz, hash, hashSz, result, &key);
+		}
+		else
+		{
+			err = stsafe_VerifyOnChip(NetworkContext, &key, sig, sigSz, hash,
+					hashSz, result);
+		}
+	}
 
 	wc_ecc_free(&key);
 	return err;
 }
 
-int stsafe_SharedSecretCb(WOLFSSL *ssl, ecc_key *otherKey,
-		unsigned char *pubKeyDer, unsigned int *pubKeySz, unsigned char *out,
-		unsigned int *outlen, int side, void *ctx)
+int stsafe_VerifyPeerCertCb(WOLFSSL *ssl, const unsigned char *sig,
+		unsigned int sigSz, const unsigned char *hash, unsigned int hashSz,
+		const unsigned char *keyDer, unsigned int keySz, int *result, void *ctx)
 {
-	if (side != WOLFSSL_CLIENT_END)
+	CryptoEngine_t engine = crypto_dispatch.stats.verifyEngine;
+
+	uint32_t start = HAL_GetTick();
+	int err = stsafe_VerifyWithEngine(engine, (NetworkContext_t*) ctx, sig,
+			sigSz, hash, hashSz, keyDer, keySz, result);
+	stsafe_DispatchRecord(
+			engine == CRYPTO_ENGINE_HOST ?
+					CRYPTO_OP_VERIFY_HOST : CRYPTO_OP_VERIFY_STSAFE, start);
+
+	return err;
+}
+
+/* Average time of one verification of the benchmark vector, 0 if it failed */
+static uint32_t stsafe_BenchmarkVerify(CryptoEngine_t engine)
+{
+	uint32_t start = HAL_GetTick();
+
+	for (int i = 0; i < DISPATCH_BENCHMARK_RUNS; i++)
 	{
-		printf("SharedSecretCb: only supports WOLFSSL_CLIENT_END\r\n");
-		return -1;
+		int valid = 0;
+		int err = stsafe_VerifyWithEngine(engine, NULL,
+				DISPATCH_BENCHMARK_SIGNATURE_DER,
+				sizeof(DISPATCH_BENCHMARK_SIGNATURE_DER),
+				DISPATCH_BENCHMARK_DIGEST, sizeof(DISPATCH_BENCHMARK_DIGEST),
+				DISPATCH_BENCHMARK_KEY_DER, sizeof(DISPATCH_BENCHMARK_KEY_DER),
+				&valid);
+		if (err != 0 || valid != 1)
+		{
+			printf("Dispatch benchmark: %s verify failed. Error: %d\r\n",
+					engine == CRYPTO_ENGINE_HOST ? "host" : "STSAFE", err);
+			return 0;
+		}
 	}
 
-	NetworkContext_t *netCtx = (NetworkContext_t*) ctx;
-	StSafeA_Handle_t *stsafeHandle = &(netCtx->sslContext.stsafea_handle);
+	// rounded up, a sub-tick verify still counts as 1 ms
+	return (HAL_GetTick() - start + DISPATCH_BENCHMARK_RUNS - 1)
+			/ DISPATCH_BENCHMARK_RUNS;
+}
 
-	int err = 0;
+void stsafe_DispatchCalibrate(void)
+{
+	if (crypto_dispatch.calibrated)
+	{
+		return;
+	}
+	crypto_dispatch.calibrated = true;
 
-	/* ----- Generate a new key pair in the EPHEMERAL key slot ----- */
+	uint32_t hostMs = stsafe_BenchmarkVerify(CRYPTO_ENGINE_HOST);
+	uint32_t stsafeMs = stsafe_BenchmarkVerify(CRYPTO_ENGINE_STSAFE);
 
-	const uint8_t keyslot = STSAFEA_KEY_SLOT_EPHEMERAL;
-	const StSafeA_CurveId_t keyCurveId = STSAFEA_NIST_P_256;
-	const uint8_t keyAuthFlags =
-			(STSAFEA_PRVKEY_MODOPER_AUTHFLAG_CMD_RESP_SIGNEN |
-			STSAFEA_PRVKEY_MODOPER_AUTHFLAG_MSG_DGST_SIGNEN |
-			STSAFEA_PRVKEY_MODOPER_AUTHFLAG_KEY_ESTABLISHEN);
+	crypto_dispatch.stats.hostVerifyMs = hostMs;
+	crypto_dispatch.stats.stsafeVerifyMs = stsafeMs;
 
-	uint8_t pubKeyX_data[STSAFE_MAX_KEY_LEN];
-	uint8_t pubKeyY_data[STSAFE_MAX_KEY_LEN];
-	memset(pubKeyX_data, 0, sizeof(pubKeyX_data));
-	memset(pubKeyY_data, 0, sizeof(pubKeyY_data));
-	StSafeA_LVBuffer_t PubKeyX =
-	{ .Data = pubKeyX_data, .Length = sizeof(pubKeyX_data) };
-	StSafeA_LVBuffer_t PubKeyY =
-	{ .Data = pubKeyY_data, .Length = sizeof(pubKeyY_data) };
+	// an engine that got the vector wrong is never picked
+	if (hostMs != 0 && (stsafeMs == 0 || hostMs < stsafeMs))
+	{
+		crypto_dispatch.stats.verifyEngine = CRYPTO_ENGINE_HOST;
+	}
+	else
+	{
+		crypto_dispatch.stats.verifyEngine = CRYPTO_ENGINE_STSAFE;
+	}
 
-	uint8_t PointRepresentationId = 0;
+	printf("Dispatch benchmark: verify host %lu ms, STSAFE %lu ms -> %s\r\n",
+			hostMs, stsafeMs,
+			crypto_dispatch.stats.verifyEngine == CRYPTO_ENGINE_HOST ?
+					"host" : "STSAFE");
+}
 
-	StSafeA_ResponseCode_t generateKeyPairResponse = STSAFEA_UNEXPECTED_ERROR;
-	generateKeyPairResponse = StSafeA_GenerateKeyPair(stsafeHandle, keyslot,
-			0xFFFF, STSAFEA_FLAG_FALSE, keyAuthFlags, keyCurveId,
-			STSAFE_MAX_KEY_LEN, &PointRepresentationId, &PubKeyX, &PubKeyY,
-			STSAFEA_MAC_NONE);
-	if (generateKeyPairResponse != STSAFEA_OK)
+void stsafe_GetDispatchStats(CryptoDispatchStats_t *stats)
+{
+	taskENTER_CRITICAL();
+	*stats = crypto_dispatch.stats;
+	taskEXIT_CRITICAL();
+}
+
+/*
+ * Uses the pre-generated EPHEMERAL key pair, or generates one now, and runs
+ * EstablishKey with it. Both happen in one request so that nothing can take
+ * the slot in between.
+ */
+static StSafeA_ResponseCode_t stsafe_EstablishKeyOp(
+		StSafeA_Handle_t *stsafeHandle, void *args)
+{
+	EstablishKeyArgs_t *keyArgs = (EstablishKeyArgs_t*) args;
+
+	if (keyArgs->useIssuedKey)
 	{
-		printf("SharedSecretCb: Got error from StSafeA_GenerateKeyPair: %d\r\n",
-				generateKeyPairResponse);
-		err = -generateKeyPairResponse;
-		return err;
+		if (!ephemeral_key.issued)
+		{
+			printf("SharedSecretCb: no key share key in the EPHEMERAL slot\r\n");
+			return STSAFEA_UNEXPECTED_ERROR;
+		}
+		ephemeral_key.issued = false;
+	}
+	else if (ephemeral_key.ready)
+	{
+		memcpy(keyArgs->pubKeyX, ephemeral_key.pubKeyX,
+				sizeof(keyArgs->pubKeyX));
+		memcpy(keyArgs->pubKeyY, ephemeral_key.pubKeyY,
+				sizeof(keyArgs->pubKeyY));
+
+		ephemeral_key.stats.hits++;
+		ephemeral_key.stats.savedMs += ephemeral_key.generationTimeMs;
+		printf(
+				"SharedSecretCb: used pre-generated ephemeral key, saved %lu ms (total %lu ms)\r\n",
+				ephemeral_key.generationTimeMs, ephemeral_key.stats.savedMs);
+	}
+	else
+	{
+		ephemeral_key.stats.misses++;
+
+		StSafeA_ResponseCode_t generateKeyPairResponse =
+				stsafe_GenerateEphemeralKey(stsafeHandle, keyArgs->pubKeyX,
+						keyArgs->pubKeyY);
+		if (generateKeyPairResponse != STSAFEA_OK)
+		{
+			printf(
+					"SharedSecretCb: Got error from StSafeA_GenerateKeyPair: %d\r\n",
+					generateKeyPairResponse);
+			return generateKeyPairResponse;
+		}
+	}
+
+	StSafeA_ResponseCode_t sharedSecretResult = StSafeA_EstablishKey(
+			stsafeHandle, STSAFEA_KEY_SLOT_EPHEMERAL, &keyArgs->OtherKeyX,
+			&keyArgs->OtherKeyY, STSAFEA_XYRS_ECDSA_SHA256_LENGTH,
+			&keyArgs->SharedSecret, STSAFEA_MAC_NONE, STSAFEA_ENCRYPTION_NONE);
+
+	/* The slot's single use is spent (or its state unknown on error). A key
+	 * share key is gone too when the server fell back to TLS 1.2. */
+	ephemeral_key.ready = false;
+	ephemeral_key.issued = false;
+	ephemeral_key.generationTimeMs = 0;
+
+	if (sharedSecretResult != STSAFEA_OK)
+	{
+		printf("SharedSecretCb: Got error from StSafeA_EstablishKey: %d\r\n",
+				sharedSecretResult);
+	}
+
+	return sharedSecretResult;
+}
+
+/*
+ * Hands out the pre-generated EPHEMERAL key pair, or generates one now, for a
+ * TLS 1.3 key share. The slot is kept for the EstablishKey that follows the
+ * ServerHello.
+ */
+static StSafeA_ResponseCode_t stsafe_IssueKeyOp(StSafeA_Handle_t *stsafeHandle,
+		void *args)
+{
+	IssueKeyArgs_t *issueArgs = (IssueKeyArgs_t*) args;
+
+	if (ephemeral_key.ready)
+	{
+		memcpy(issueArgs->pubKeyX, ephemeral_key.pubKeyX,
+				sizeof(issueArgs->pubKeyX));
+		memcpy(issueArgs->pubKeyY, ephemeral_key.pubKeyY,
+				sizeof(issueArgs->pubKeyY));
+
+		ephemeral_key.stats.hits++;
+		ephemeral_key.stats.savedMs += ephemeral_key.generationTimeMs;
+	}
+	else
+	{
+		ephemeral_key.stats.misses++;
+
+		StSafeA_ResponseCode_t generateKeyPairResponse =
+				stsafe_GenerateEphemeralKey(stsafeHandle, issueArgs->pubKeyX,
+						issueArgs->pubKeyY);
+		if (generateKeyPairResponse != STSAFEA_OK)
+		{
+			printf("KeyGenCb: Got error from StSafeA_GenerateKeyPair: %d\r\n",
+					generateKeyPairResponse);
+			return generateKeyPairResponse;
+		}
+	}
+
+	// a HelloRetryRequest asks for a new key share and replaces the old one
+	ephemeral_key.ready = false;
+	ephemeral_key.generationTimeMs = 0;
+	ephemeral_key.issued = true;
+
+	return STSAFEA_OK;
+}
+
+int stsafe_KeyGenCb(WOLFSSL *ssl, ecc_key *key, unsigned int keySz,
+		int ecc_curve, void *ctx)
+{
+	// the EPHEMERAL slot is generated on P-256, wolfSSL passes the curve id
+	if (ecc_curve != ECC_SECP256R1)
+	{
+		printf("KeyGenCb: only supports P-256\r\n");
+		return ECC_CURVE_OID_E;
+	}
+
+	IssueKeyArgs_t issueArgs;
+
+	uint32_t start = HAL_GetTick();
+	StSafeA_ResponseCode_t issueResult = stsafe_PkCall(
+			(NetworkContext_t*) ctx, stsafe_IssueKeyOp, &issueArgs);
+	stsafe_DispatchRecord(CRYPTO_OP_KEYGEN, start);
+	if (issueResult != STSAFEA_OK)
+	{
+		return -issueResult;
+	}
+
+	// public point only, the private key stays in the slot
+	return wc_ecc_import_unsigned(key, issueArgs.pubKeyX, issueArgs.pubKeyY,
+	NULL, ECC_SECP256R1);
+}
+
+int stsafe_SharedSecretCb(WOLFSSL *ssl, ecc_key *otherKey,
+		unsigned char *pubKeyDer, unsigned int *pubKeySz, unsigned char *out,
+		unsigned int *outlen, int side, void *ctx)
+{
+	if (side != WOLFSSL_CLIENT_END)
+	{
+		printf("SharedSecretCb: only supports WOLFSSL_CLIENT_END\r\n");
+		return -1;
 	}
 
+	int err = 0;
+
 	/* ----- Parse otherKey ----- */
 
 	uint8_t otherKeyX[STSAFE_MAX_KEY_LEN];
@@ -324,40 +966,48 @@ int stsafe_SharedSecretCb(WOLFSSL *ssl, ecc_key *otherKey,
 		return 0;
 	}
 
-	StSafeA_LVBuffer_t OtherKeyX =
-	{ .Data = otherKeyX, .Length = otherKeyXLen };
-	StSafeA_LVBuffer_t OtherKeyY =
-	{ .Data = otherKeyY, .Length = otherKeyYLen };
+	uint8_t sharedSecret_buf[STSAFE_MAX_PUBKEY_RAW_LEN];
+	memset(sharedSecret_buf, 0, sizeof(sharedSecret_buf));
+
+	EstablishKeyArgs_t keyArgs =
+	{ 0 };
+	keyArgs.OtherKeyX = (StSafeA_LVBuffer_t )
+			{ .Data = otherKeyX, .Length = otherKeyXLen };
+	keyArgs.OtherKeyY = (StSafeA_LVBuffer_t )
+			{ .Data = otherKeyY, .Length = otherKeyYLen };
+	keyArgs.SharedSecret.SharedKey = (StSafeA_LVBuffer_t )
+			{ .Data = sharedSecret_buf, .Length = sizeof(sharedSecret_buf) };
+	// in TLS 1.3 our public key already went out in the ClientHello
+	keyArgs.useIssuedKey = wolfSSL_version(ssl) == TLS1_3_VERSION;
 
 	/* ----- Generate Shared Secret via STSAFE-A ----- */
 
-	uint8_t sharedSecret_buf[STSAFE_MAX_PUBKEY_RAW_LEN];
-	memset(sharedSecret_buf, 0, sizeof(sharedSecret_buf));
-	StSafeA_LVBuffer_t sharedSecret =
-	{ .Data = sharedSecret_buf, .Length = sizeof(sharedSecret_buf) };
-	StSafeA_SharedSecretBuffer_t OutSharedSecret =
-	{ .Length = 0, .SharedKey = sharedSecret };
-
-	StSafeA_ResponseCode_t sharedSecretResult = STSAFEA_UNEXPECTED_ERROR;
-	sharedSecretResult = StSafeA_EstablishKey(stsafeHandle, keyslot, &OtherKeyX,
-			&OtherKeyY, STSAFEA_XYRS_ECDSA_SHA256_LENGTH, &OutSharedSecret,
-			STSAFEA_MAC_NONE, STSAFEA_ENCRYPTION_NONE);
+	uint32_t start = HAL_GetTick();
+	StSafeA_ResponseCode_t sharedSecretResult = stsafe_PkCall(
+			(NetworkContext_t*) ctx, stsafe_EstablishKeyOp, &keyArgs);
+	stsafe_DispatchRecord(CRYPTO_OP_ECDH, start);
 	if (sharedSecretResult != STSAFEA_OK)
 	{
-		printf("SharedSecretCb: Got error from StSafeA_EstablishKey: %d\r\n",
-				sharedSecretResult);
 		err = -sharedSecretResult;
 		return err;
 	}
 
 	/* ----- Parse and return public key ----- */
 
+	if (keyArgs.useIssuedKey)
+	{
+		memcpy(out, keyArgs.SharedSecret.SharedKey.Data,
+				keyArgs.SharedSecret.SharedKey.Length);
+		*outlen = (unsigned int) (keyArgs.SharedSecret.SharedKey.Length);
+		return 0;
+	}
+
 	ecc_key tmpKey;
 	bool tmpKeyFreed = false;
 	err = wc_ecc_init(&tmpKey);
 	if (err == 0)
 	{
-		err = wc_ecc_import_unsigned(&tmpKey, pubKeyX_data, pubKeyY_data,
+		err = wc_ecc_import_unsigned(&tmpKey, keyArgs.pubKeyX, keyArgs.pubKeyY,
 		NULL, ECC_SECP256R1);
 		if (err == 0)
 		{
@@ -378,35 +1028,43 @@ int stsafe_SharedSecretCb(WOLFSSL *ssl, ecc_key *otherKey,
 	}
 
 	/* ----- Return shared secret ----- */
-	memcpy(out, OutSharedSecret.SharedKey.Data,
-			OutSharedSecret.SharedKey.Length);
-	*outlen = (unsigned int) (OutSharedSecret.SharedKey.Length);
+	memcpy(out, keyArgs.SharedSecret.SharedKey.Data,
+			keyArgs.SharedSecret.SharedKey.Length);
+	*outlen = (unsigned int) (keyArgs.SharedSecret.SharedKey.Length);
 
 	return 0;
 }
 
+static StSafeA_ResponseCode_t stsafe_GenerateSignatureOp(
+		StSafeA_Handle_t *stsafeHandle, void *args)
+{
+	GenerateSignatureArgs_t *signArgs = (GenerateSignatureArgs_t*) args;
+
+	return StSafeA_GenerateSignature(stsafeHandle, STSAFEA_KEY_SLOT_0,
+			signArgs->Digest, STSAFEA_SHA_256,
+			STSAFEA_XYRS_ECDSA_SHA256_LENGTH, &signArgs->SignR,
+			&signArgs->SignS, STSAFEA_MAC_NONE, STSAFEA_ENCRYPTION_NONE);
+}
+
 int stsafe_SignCertificateCb(WOLFSSL *ssl, const unsigned char *in,
 		unsigned int inSz, unsigned char *out, unsigned int *outSz,
 		const unsigned char *key, unsigned int keySz, void *ctx)
 {
-	NetworkContext_t *netCtx = (NetworkContext_t*) ctx;
-	StSafeA_Handle_t *stsafeHandle = &(netCtx->sslContext.stsafea_handle);
-
 	uint8_t OutSignR_data[STSAFEA_XYRS_ECDSA_SHA256_LENGTH];
 	memset(OutSignR_data, 0, sizeof(OutSignR_data));
-	StSafeA_LVBuffer_t OutSignR =
-	{ .Data = OutSignR_data, .Length = sizeof(OutSignR_data) };
 
 	uint8_t OutSignS_data[STSAFEA_XYRS_ECDSA_SHA256_LENGTH];
 	memset(OutSignS_data, 0, sizeof(OutSignS_data));
-	StSafeA_LVBuffer_t OutSignS =
-	{ .Data = OutSignS_data, .Length = sizeof(OutSignR_data) };
 
-	StSafeA_ResponseCode_t generateSignatureResult = STSAFEA_UNEXPECTED_ERROR;
-	generateSignatureResult = StSafeA_GenerateSignature(stsafeHandle,
-	STSAFEA_KEY_SLOT_0, in, STSAFEA_SHA_256,
-	STSAFEA_XYRS_ECDSA_SHA256_LENGTH, &OutSignR, &OutSignS,
-	STSAFEA_MAC_NONE, STSAFEA_ENCRYPTION_NONE);
+	GenerateSignatureArgs_t signArgs =
+	{ .Digest = in, .SignR =
+	{ .Data = OutSignR_data, .Length = sizeof(OutSignR_data) }, .SignS =
+	{ .Data = OutSignS_data, .Length = sizeof(OutSignS_data) } };
+
+	uint32_t start = HAL_GetTick();
+	StSafeA_ResponseCode_t generateSignatureResult = stsafe_PkCall(
+			(NetworkContext_t*) ctx, stsafe_GenerateSignatureOp, &signArgs);
+	stsafe_DispatchRecord(CRYPTO_OP_SIGN, start);
 
 	if (generateSignatureResult != STSAFEA_OK)
 	{
@@ -416,8 +1074,8 @@ int stsafe_SignCertificateCb(WOLFSSL *ssl, const unsigned char *in,
 		return -generateSignatureResult;
 	}
 
-	int err = wc_ecc_rs_raw_to_sig(OutSignR.Data, OutSignR.Length,
-			OutSignS.Data, OutSignS.Length, out, outSz);
+	int err = wc_ecc_rs_raw_to_sig(signArgs.SignR.Data, signArgs.SignR.Length,
+			signArgs.SignS.Data, signArgs.SignS.Length, out, outSz);
 	if (err != 0)
 	{
 		printf(
@@ -428,11 +1086,187 @@ int stsafe_SignCertificateCb(WOLFSSL *ssl, const unsigned char *in,
 	return err;
 }
 
+bool stsafe_SignDigest(const uint8_t *digest, uint8_t *signatureR,
+		uint8_t *signatureS)
+{
+	GenerateSignatureArgs_t signArgs =
+	{ .Digest = digest, .SignR =
+	{ .Data = signatureR, .Length = STSAFEA_XYRS_ECDSA_SHA256_LENGTH }, .SignS =
+	{ .Data = signatureS, .Length = STSAFEA_XYRS_ECDSA_SHA256_LENGTH } };
+
+	// Not on a handshake path, a handshake waiting for the chip goes first
+	uint32_t start = HAL_GetTick();
+	StSafeA_ResponseCode_t generateSignatureResult = stsafe_ServiceCall(
+			STSAFE_PRIORITY_BACKGROUND, stsafe_GenerateSignatureOp, &signArgs);
+	stsafe_DispatchRecord(CRYPTO_OP_SIGN, start);
+
+	if (generateSignatureResult != STSAFEA_OK)
+	{
+		printf("SignDigest: Got error from StSafeA_GenerateSignature: %d\r\n",
+				generateSignatureResult);
+		return false;
+	}
+
+	return true;
+}
+
+static StSafeA_ResponseCode_t stsafe_GenerateRandomOp(
+		StSafeA_Handle_t *stsafeHandle, void *args)
+{
+	StSafeA_LVBuffer_t *random = (StSafeA_LVBuffer_t*) args;
+
+	return StSafeA_GenerateRandom(stsafeHandle, STSAFEA_EPHEMERAL_RND,
+			(uint8_t) random->Length, random, STSAFEA_MAC_NONE);
+}
+
+bool stsafe_GenerateRandom(uint8_t *output, uint8_t length)
+{
+	StSafeA_LVBuffer_t random =
+	{ .Data = output, .Length = length };
+
+	StSafeA_ResponseCode_t generateRandomResult = stsafe_ServiceCall(
+			STSAFE_PRIORITY_BACKGROUND, stsafe_GenerateRandomOp, &random);
+
+	if (generateRandomResult != STSAFEA_OK)
+	{
+		printf("GenerateRandom: Got error from StSafeA_GenerateRandom: %d\r\n",
+				generateRandomResult);
+		return false;
+	}
+
+	return random.Length == length;
+}
+
+static StSafeA_ResponseCode_t stsafe_EnsureEnvelopeKey(
+		StSafeA_Handle_t *stsafeHandle)
+{
+	if (envelope_key_present)
+	{
+		return STSAFEA_OK;
+	}
+
+	StSafeA_LocalEnvelopeKeyTableBuffer_t keyTable;
+	StSafeA_LocalEnvelopeKeyInformationRecordBuffer_t slot0;
+	StSafeA_LocalEnvelopeKeyInformationRecordBuffer_t slot1;
+
+	StSafeA_ResponseCode_t queryResult = StSafeA_LocalEnvelopeKeySlotQuery(
+			stsafeHandle, &keyTable, &slot0, &slot1, STSAFEA_MAC_NONE);
+	if (queryResult != STSAFEA_OK)
+	{
+		printf("Envelope: Got error from StSafeA_LocalEnvelopeKeySlotQuery: %d\r\n",
+				queryResult);
+		return queryResult;
+	}
+
+	// generated once, a new key would make every stored envelope unreadable
+	if (slot0.PresenceFlag == 0U)
+	{
+		printf("Envelope: generating the local envelope key\r\n");
+		StSafeA_ResponseCode_t generateResult =
+				StSafeA_GenerateLocalEnvelopeKey(stsafeHandle,
+						STSAFE_ENVELOPE_KEY_SLOT, STSAFE_ENVELOPE_KEY_TYPE, NULL,
+						0, STSAFEA_MAC_NONE);
+		if (generateResult != STSAFEA_OK)
+		{
+			printf(
+					"Envelope: Got error from StSafeA_GenerateLocalEnvelopeKey: %d\r\n",
+					generateResult);
+			return generateResult;
+		}
+	}
+
+	envelope_key_present = true;
+
+	return STSAFEA_OK;
+}
+
+static StSafeA_ResponseCode_t stsafe_WrapEnvelopeOp(
+		StSafeA_Handle_t *stsafeHandle, void *args)
+{
+	EnvelopeArgs_t *envelopeArgs = (EnvelopeArgs_t*) args;
+
+	StSafeA_ResponseCode_t keyResult = stsafe_EnsureEnvelopeKey(stsafeHandle);
+	if (keyResult != STSAFEA_OK)
+	{
+		return keyResult;
+	}
+
+	return StSafeA_WrapLocalEnvelope(stsafeHandle, STSAFE_ENVELOPE_KEY_SLOT,
+			(uint8_t*) envelopeArgs->Input, envelopeArgs->InputLength,
+			&envelopeArgs->Output, STSAFEA_MAC_NONE, STSAFEA_ENCRYPTION_NONE);
+}
+
+static StSafeA_ResponseCode_t stsafe_UnwrapEnvelopeOp(
+		StSafeA_Handle_t *stsafeHandle, void *args)
+{
+	EnvelopeArgs_t *envelopeArgs = (EnvelopeArgs_t*) args;
+
+	return StSafeA_UnwrapLocalEnvelope(stsafeHandle, STSAFE_ENVELOPE_KEY_SLOT,
+			(uint8_t*) envelopeArgs->Input, envelopeArgs->InputLength,
+			&envelopeArgs->Output, STSAFEA_MAC_NONE, STSAFEA_ENCRYPTION_NONE);
+}
+
+bool stsafe_WrapEnvelope(const uint8_t *data, uint16_t length,
+		uint8_t *envelope)
+{
+	if (length == 0 || length > STSAFE_ENVELOPE_MAX_DATA_SIZE
+			|| (length % 8U) != 0)
+	{
+		return false;
+	}
+
+	EnvelopeArgs_t envelopeArgs =
+	{ .Input = data, .InputLength = length, .Output =
+	{ .Data = envelope, .Length = length + STSAFE_ENVELOPE_OVERHEAD } };
+
+	StSafeA_ResponseCode_t wrapResult = stsafe_ServiceCall(
+			STSAFE_PRIORITY_BACKGROUND, stsafe_WrapEnvelopeOp, &envelopeArgs);
+
+	if (wrapResult != STSAFEA_OK)
+	{
+		printf("WrapEnvelope: Got error from StSafeA_WrapLocalEnvelope: %d\r\n",
+				wrapResult);
+		return false;
+	}
+
+	return envelopeArgs.Output.Length == length + STSAFE_ENVELOPE_OVERHEAD;
+}
+
+bool stsafe_UnwrapEnvelope(const uint8_t *envelope, uint16_t length,
+		uint8_t *data)
+{
+	if (length <= STSAFE_ENVELOPE_OVERHEAD
+			|| length > STSAFE_ENVELOPE_MAX_DATA_SIZE + STSAFE_ENVELOPE_OVERHEAD
+			|| (length % 8U) != 0)
+	{
+		return false;
+	}
+
+	EnvelopeArgs_t envelopeArgs =
+	{ .Input = envelope, .InputLength = length, .Output =
+	{ .Data = data, .Length = length - STSAFE_ENVELOPE_OVERHEAD } };
+
+	// on the connect path, ahead of background work
+	StSafeA_ResponseCode_t unwrapResult = stsafe_ServiceCall(
+			STSAFE_PRIORITY_HANDSHAKE, stsafe_UnwrapEnvelopeOp, &envelopeArgs);
+
+	if (unwrapResult != STSAFEA_OK)
+	{
+		printf(
+				"UnwrapEnvelope: Got error from StSafeA_UnwrapLocalEnvelope: %d\r\n",
+				unwrapResult);
+		return false;
+	}
+
+	return envelopeArgs.Output.Length == length - STSAFE_ENVELOPE_OVERHEAD;
+}
+
 void stsafe_SetupPkCallbacks(NetworkContext_t *NetworkContext)
 {
 	WOLFSSL_CTX *ctx = NetworkContext->sslContext.ctx;
 
 	wolfSSL_CTX_SetEccVerifyCb(ctx, stsafe_VerifyPeerCertCb);
+	wolfSSL_CTX_SetEccKeyGenCb(ctx, stsafe_KeyGenCb);
 	wolfSSL_CTX_SetEccSharedSecretCb(ctx, stsafe_SharedSecretCb);
 	wolfSSL_CTX_SetEccSignCb(ctx, stsafe_SignCertificateCb);
 	wolfSSL_CTX_SetDevId(ctx, 0);
@@ -443,6 +1277,7 @@ void stsafe_SetupPkCallbacksContext(NetworkContext_t *NetworkContext)
 	WOLFSSL *ssl = NetworkContext->sslContext.ssl;
 
 	wolfSSL_SetEccVerifyCtx(ssl, NetworkContext);
+	wolfSSL_SetEccKeyGenCtx(ssl, NetworkContext);
 	wolfSSL_SetEccSharedSecretCtx(ssl, NetworkContext);
 	wolfSSL_SetEccSignCtx(ssl, NetworkContext);
 }
@@ -5,11 +5,20 @@
 #include "task.h"
 #include "cmsis_os.h"
 
+#include "task_mqtt_agent.h"
+#include "stsafe_interface.h"
+
 void RunDefaultTask(GlobalState *globalState)
 {
 	HAL_GPIO_TogglePin(GPIOB, GPIO_PIN_14);
 	osDelay(1);
 	HAL_GPIO_TogglePin(GPIOB, GPIO_PIN_14);
 
+#if TASK_MQTT_AGENT_USE_TLS
+	// The chip is idle whenever this task runs, so get the next handshake's
+	// ephemeral key pair ready ahead of time
+	stsafe_EphemeralKeyPrepare();
+#endif
+
 	osDelay(1000);
 }
@@ -0,0 +1,212 @@
+#include "task_entropy.h"
+
+#include <string.h>
+
+#include "main.h"
+#include "FreeRTOS.h"
+#include "task.h"
+#include "rng.h"
+
+#include "wolfssl/wolfcrypt/sha256.h"
+#include "wolfssl/wolfcrypt/error-crypt.h"
+
+#include "stsafe_interface.h"
+#include "task_stsafe.h"
+
+#define ENTROPY_POOL_MASK (ENTROPY_POOL_SIZE - 1U)
+
+// Bytes added per refill step, one SHA-256 output
+#define ENTROPY_BLOCK_SIZE 32U
+
+// Readers wake the entropy task once the pool drops below this
+#define ENTROPY_LOW_WATERMARK (ENTROPY_POOL_SIZE / 2U)
+
+#define ENTROPY_REFILL_PERIOD_MS 1000
+
+/*
+ * Free-running indices, the fill level is write - read. Only the entropy task
+ * moves write; readers claim bytes by moving read with a compare-and-swap, so
+ * the bytes they copied can not have been overwritten if the swap succeeds.
+ */
+static uint8_t entropy_pool[ENTROPY_POOL_SIZE];
+static uint32_t pool_write = 0;
+static uint32_t pool_read = 0;
+
+static TaskHandle_t entropy_task = NULL;
+static uint32_t block_counter = 0;
+
+static EntropyStats_t entropy_stats =
+{ .minFillLevel = ENTROPY_POOL_SIZE };
+
+static uint32_t entropy_FillLevel(void)
+{
+	return __atomic_load_n(&pool_write, __ATOMIC_ACQUIRE)
+			- __atomic_load_n(&pool_read, __ATOMIC_ACQUIRE);
+}
+
+static void entropy_CountAdd(uint32_t *counter, uint32_t value)
+{
+	__atomic_fetch_add(counter, value, __ATOMIC_RELAXED);
+}
+
+static bool entropy_ReadHardwareRng(uint8_t *output, size_t length)
+{
+	for (size_t i = 0; i < length; i += sizeof(uint32_t))
+	{
+		uint32_t word = 0;
+
+		// the HAL handle is shared by the entropy task and starved readers
+		vTaskSuspendAll();
+		HAL_StatusTypeDef status = HAL_RNG_GenerateRandomNumber(&hrng, &word);
+		(void) xTaskResumeAll();
+
+		if (status != HAL_OK)
+		{
+			return false;
+		}
+
+		size_t chunk = length - i;
+		if (chunk > sizeof(word))
+		{
+			chunk = sizeof(word);
+		}
+		memcpy(&output[i], &word, chunk);
+	}
+
+	return true;
+}
+
+/*
+ * SHA-256 over a block counter, STM32 RNG output and, when the chip is up,
+ * STSAFE output. Either source alone is enough to keep the block
+ * unpredictable.
+ */
+static bool entropy_ProduceBlock(uint8_t *block)
+{
+	uint8_t rngBytes[ENTROPY_BLOCK_SIZE];
+	uint8_t stsafeBytes[ENTROPY_BLOCK_SIZE];
+
+	if (!entropy_ReadHardwareRng(rngBytes, sizeof(rngBytes)))
+	{
+		entropy_CountAdd(&entropy_stats.rngFailures, 1);
+		return false;
+	}
+
+	bool haveStsafeBytes = stsafe_ServiceWaitReady(0)
+			&& stsafe_GenerateRandom(stsafeBytes, sizeof(stsafeBytes));
+	if (!haveStsafeBytes)
+	{
+		entropy_CountAdd(&entropy_stats.stsafeFailures, 1);
+	}
+
+	wc_Sha256 sha;
+	wc_InitSha256(&sha);
+	wc_Sha256Update(&sha, (const byte*) &block_counter, sizeof(block_counter));
+	wc_Sha256Update(&sha, rngBytes, sizeof(rngBytes));
+	if (haveStsafeBytes)
+	{
+		wc_Sha256Update(&sha, stsafeBytes, sizeof(stsafeBytes));
+	}
+	wc_Sha256Final(&sha, block);
+	wc_Sha256Free(&sha);
+
+	block_counter++;
+
+	return true;
+}
+
+static void entropy_PoolWrite(const uint8_t *block, uint32_t length)
+{
+	uint32_t write = pool_write;
+
+	for (uint32_t i = 0; i < length; i++)
+	{
+		entropy_pool[(write + i) & ENTROPY_POOL_MASK] = block[i];
+	}
+
+	// the bytes must be visible before the index that hands them out
+	__atomic_store_n(&pool_write, write + length, __ATOMIC_RELEASE);
+	entropy_CountAdd(&entropy_stats.produced, length);
+}
+
+static bool entropy_PoolTake(uint8_t *output, uint32_t length)
+{
+	uint32_t read = __atomic_load_n(&pool_read, __ATOMIC_ACQUIRE);
+
+	do
+	{
+		uint32_t write = __atomic_load_n(&pool_write, __ATOMIC_ACQUIRE);
+		if (write - read < length)
+		{
+			return false;
+		}
+
+		for (uint32_t i = 0; i < length; i++)
+		{
+			output[i] = entropy_pool[(read + i) & ENTROPY_POOL_MASK];
+		}
+	} while (!__atomic_compare_exchange_n(&pool_read, &read, read + length,
+			false, __ATOMIC_ACQ_REL, __ATOMIC_ACQUIRE));
+
+	return true;
+}
+
+void RunTaskEntropy(GlobalState *globalState)
+{
+	entropy_task = xTaskGetCurrentTaskHandle();
+
+	uint8_t block[ENTROPY_BLOCK_SIZE];
+
+	// main loop
+	for (;;)
+	{
+		while (ENTROPY_POOL_SIZE - entropy_FillLevel() >= ENTROPY_BLOCK_SIZE)
+		{
+			if (!entropy_ProduceBlock(block))
+			{
+				break;
+			}
+			entropy_PoolWrite(block, sizeof(block));
+		}
+
+		// woken early by a reader that took the pool below the watermark
+		ulTaskNotifyTake(pdTRUE, pdMS_TO_TICKS(ENTROPY_REFILL_PERIOD_MS));
+	}
+}
+
+bool entropy_Read(uint8_t *output, size_t length)
+{
+	bool fromPool = length <= ENTROPY_POOL_SIZE
+			&& entropy_PoolTake(output, (uint32_t) length);
+
+	uint32_t fillLevel = entropy_FillLevel();
+	if (fillLevel < entropy_stats.minFillLevel)
+	{
+		entropy_stats.minFillLevel = fillLevel;
+	}
+	if (fillLevel < ENTROPY_LOW_WATERMARK && entropy_task != NULL)
+	{
+		xTaskNotifyGive(entropy_task);
+	}
+
+	if (fromPool)
+	{
+		entropy_CountAdd(&entropy_stats.consumed, (uint32_t) length);
+		return true;
+	}
+
+	// never wait for a refill, the STM32 RNG answers within microseconds
+	entropy_CountAdd(&entropy_stats.starvations, 1);
+	return entropy_ReadHardwareRng(output, length);
+}
+
+void entropy_GetStats(EntropyStats_t *stats)
+{
+	*stats = entropy_stats;
+	stats->fillLevel = entropy_FillLevel();
+}
+
+int entropy_GenerateSeed(unsigned char *output, unsigned int sz)
+{
+	return entropy_Read(output, sz) ? 0 : RAN_BLOCK_E;
+}
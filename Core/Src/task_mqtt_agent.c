@@ -8,6 +8,7 @@
 
 #include "FreeRTOS.h"
 #include "queue.h"
+#include "semphr.h"
 #include "task.h"
 
 #include "core_mqtt.h"
@@ -47,7 +48,54 @@ static uint8_t MQTT_BROKER_ENDPOINT_IP[] =
 #define CONNACK_RECV_TIMEOUT_MS           ( 2000U )
 #define KEEP_ALIVE_INTERVAL_SECONDS       ( 60U )
 
-static NetworkContext_t xNetworkContext;
+#if TASK_MQTT_AGENT_USE_STANDBY
+/**
+ * @brief Interval of the planned reconnects, which open the new connection
+ * on a spare module socket while the agent keeps serving the old one. In
+ * seconds, pdMS_TO_TICKS() overflows for intervals this long. 0 reconnects
+ * only when RequestMQTTReconnect() is called.
+ */
+#define PLANNED_RECONNECT_INTERVAL_S      ( 12U * 60U * 60U )
+
+/**
+ * @brief Wait for a PINGRESP after which the link counts as degraded and a
+ * standby connection is opened, before MQTT_PINGRESP_TIMEOUT_MS drops the
+ * current one.
+ */
+#define STANDBY_PINGRESP_LATE_MS          ( MQTT_PINGRESP_TIMEOUT_MS / 2U )
+
+/**
+ * @brief Stack of the task opening the spare connection, a TLS handshake
+ * needs as much as the agent task.
+ */
+#define STANDBY_TASK_STACK_WORDS          ( 2048U )
+#endif
+
+#if TASK_MQTT_AGENT_USE_STANDBY
+/* The connection the agent uses and the spare one, they swap roles on every
+ * planned reconnect. */
+static NetworkContext_t xNetworkContexts[2];
+#else
+static NetworkContext_t xNetworkContexts[1];
+#endif
+static NetworkContext_t *pxActiveNetworkContext = &xNetworkContexts[0];
+
+/* Connected by the standby task, waiting for the agent to switch to it. */
+static NetworkContext_t *volatile pxStandbyNetworkContext = NULL;
+
+/* Held while a connection is opened or the agent switches to another. */
+static SemaphoreHandle_t xConnectMutex = NULL;
+static StaticSemaphore_t xConnectMutexBuffer;
+
+#if TASK_MQTT_AGENT_USE_STANDBY
+/* Given by RequestMQTTReconnect(). Not a task notification, the TLS handshake
+ * of the standby task waits for the STSAFE on those. */
+static SemaphoreHandle_t xStandbyRequest = NULL;
+static StaticSemaphore_t xStandbyRequestBuffer;
+
+static StaticTask_t xStandbyTaskBuffer;
+static StackType_t xStandbyTaskStack[STANDBY_TASK_STACK_WORDS];
+#endif
 
 static uint32_t ulGlobalEntryTimeMs;
 MQTTAgentContext_t xGlobalMqttAgentContext;
@@ -119,6 +167,57 @@ static BaseType_t prvSocketDisconnect(NetworkContext_t *pxNetworkContext);
  */
 static bool ConnectToMQTTBroker(void);
 
+/**
+ * @brief Initializes a network context and connects it to the broker on a
+ * socket from the pool.
+ *
+ * @param[in] pxNetworkContext Network context.
+ *
+ * @return `true` if the connection is up, else `false`.
+ */
+static bool prvOpenNetworkContext(NetworkContext_t *pxNetworkContext);
+
+/**
+ * @brief Points the MQTT context at another connection, before an MQTT
+ * CONNECT on it. A partial packet of the previous connection is dropped.
+ *
+ * @param[in] pxNetworkContext Network context, connected.
+ */
+static void prvUseNetworkContext(NetworkContext_t *pxNetworkContext);
+
+/**
+ * @brief Closes the active connection, connects it again and resumes the MQTT
+ * session on it. Called with xConnectMutex held.
+ */
+static void prvReconnect(void);
+
+#if TASK_MQTT_AGENT_USE_STANDBY
+/**
+ * @brief Switches the agent to the connection the standby task opened: the
+ * packets already received on the old one are processed, the session is
+ * resumed with an MQTT CONNECT on the new one and the old socket is closed.
+ * Falls back to prvReconnect() if the CONNECT fails. Agent task only.
+ */
+static void prvSwitchToStandby(void);
+
+/**
+ * @brief The agent's receive function. Between two commands, it switches to a
+ * standby connection that is ready, or has one opened when the PINGRESP is
+ * late, then waits for the next command.
+ */
+static bool prvAgentMessageReceive(MQTTAgentMessageContext_t *pMsgCtx,
+		MQTTAgentCommand_t **pReceivedCommand, uint32_t blockTimeMs);
+
+/**
+ * @brief Opens the spare connection when a reconnect is requested or planned.
+ * The TLS handshake runs here, the agent keeps serving the old connection on
+ * its own socket until prvAgentMessageReceive() switches over.
+ *
+ * @param[in] pvParameters Not used.
+ */
+static void prvStandbyConnectTask(void *pvParameters);
+#endif
+
 /**
  * @brief Function to attempt to resubscribe to the topics already present in the
  * subscription list.
@@ -169,6 +268,7 @@ void ConnectAndStartMQTTAgentTask(GlobalState *globalState)
 {
 	/* Miscellaneous initialization. */
 	ulGlobalEntryTimeMs = prvGetTimeMs();
+	xConnectMutex = xSemaphoreCreateMutexStatic(&xConnectMutexBuffer);
 
 	do
 	{
@@ -192,6 +292,15 @@ void ConnectAndStartMQTTAgentTask(GlobalState *globalState)
 		globalState->MQTTConnected = connResult;
 	} while (!(globalState->MQTTConnected));
 
+#if TASK_MQTT_AGENT_USE_STANDBY
+	/* Below the agent, the handshake of a spare connection runs while the
+	 * agent is idle. */
+	xStandbyRequest = xSemaphoreCreateBinaryStatic(&xStandbyRequestBuffer);
+	(void) xTaskCreateStatic(prvStandbyConnectTask, "mqttStandby",
+			STANDBY_TASK_STACK_WORDS, NULL, uxTaskPriorityGet(NULL) - 1U,
+			xStandbyTaskStack, &xStandbyTaskBuffer);
+#endif
+
 	/* This task has nothing left to do, so rather than create the MQTT
 	 * agent as a separate thread, it simply calls the function that implements
 	 * the agent - in effect turning itself into the agent. */
@@ -202,11 +311,25 @@ void ConnectAndStartMQTTAgentTask(GlobalState *globalState)
 	configASSERT(0);
 }
 
+#if TASK_MQTT_AGENT_USE_STANDBY
+bool RequestMQTTReconnect(void)
+{
+	if (xStandbyRequest == NULL)
+	{
+		return false;
+	}
+
+	/* Requests made before the standby task takes it count as one. */
+	(void) xSemaphoreGive(xStandbyRequest);
+
+	return true;
+}
+#endif
+
 static void prvMQTTAgentTask(void *pvParameters)
 {
 	BaseType_t xNetworkResult = pdFAIL;
-	MQTTStatus_t xMQTTStatus = MQTTSuccess, xConnectStatus = MQTTSuccess;
-	MQTTContext_t *pMqttContext = &(xGlobalMqttAgentContext.mqttContext);
+	MQTTStatus_t xMQTTStatus = MQTTSuccess;
 
 	(void) pvParameters;
 
@@ -223,25 +346,192 @@ static void prvMQTTAgentTask(void *pvParameters)
 		 * be disconnected. */
 		if (xMQTTStatus == MQTTSuccess)
 		{
-			/* MQTT Disconnect. Disconnect the socket. */
-			xNetworkResult = prvSocketDisconnect(&xNetworkContext);
+			/* MQTT Disconnect. Disconnect the socket, and the standby one. */
+			xSemaphoreTake(xConnectMutex, portMAX_DELAY);
+			xNetworkResult = prvSocketDisconnect(pxActiveNetworkContext);
+			if (pxStandbyNetworkContext != NULL)
+			{
+				xNetworkResult = prvSocketDisconnect(pxStandbyNetworkContext);
+				pxStandbyNetworkContext = NULL;
+			}
+			xSemaphoreGive(xConnectMutex);
 		}
-		/* Error. */
 		else
 		{
-			/* Reconnect TCP. */
-			xNetworkResult = prvSocketDisconnect(&xNetworkContext);
-			configASSERT(xNetworkResult == pdPASS);
-			xNetworkResult = prvSocketConnect(&xNetworkContext);
-			configASSERT(xNetworkResult == pdPASS);
-			pMqttContext->connectStatus = MQTTNotConnected;
-			/* MQTT Connect with a persistent session. */
-			xConnectStatus = prvMQTTConnect( false);
-			configASSERT(xConnectStatus == MQTTSuccess);
+			/* Error. A standby connection that is ready saves the handshake.
+			 * Checked under the mutex: the standby task may be finishing one. */
+			xSemaphoreTake(xConnectMutex, portMAX_DELAY);
+#if TASK_MQTT_AGENT_USE_STANDBY
+			if (pxStandbyNetworkContext != NULL)
+			{
+				xSemaphoreGive(xConnectMutex);
+				prvSwitchToStandby();
+			}
+			else
+#endif
+			{
+				prvReconnect();
+				xSemaphoreGive(xConnectMutex);
+			}
 		}
 	} while (xMQTTStatus != MQTTSuccess);
+
+	(void) xNetworkResult;
+}
+
+static void prvUseNetworkContext(NetworkContext_t *pxNetworkContext)
+{
+	MQTTContext_t *pMqttContext = &(xGlobalMqttAgentContext.mqttContext);
+
+	pxActiveNetworkContext = pxNetworkContext;
+#if TASK_MQTT_AGENT_USE_TLS
+	InitTLSTransport(pxNetworkContext, &(pMqttContext->transportInterface));
+#else
+	InitPlainTextTransport(pxNetworkContext,
+			&(pMqttContext->transportInterface));
+#endif
+	pMqttContext->index = 0;
+	pMqttContext->connectStatus = MQTTNotConnected;
 }
 
+static void prvReconnect(void)
+{
+	BaseType_t xNetworkResult;
+	MQTTStatus_t xConnectStatus;
+
+	/* Reconnect TCP. */
+	xNetworkResult = prvSocketDisconnect(pxActiveNetworkContext);
+	configASSERT(xNetworkResult == pdPASS);
+	xNetworkResult = prvSocketConnect(pxActiveNetworkContext);
+	configASSERT(xNetworkResult == pdPASS);
+	prvUseNetworkContext(pxActiveNetworkContext);
+	/* MQTT Connect with a persistent session. */
+	xConnectStatus = prvMQTTConnect( false);
+	configASSERT(xConnectStatus == MQTTSuccess);
+
+	(void) xNetworkResult;
+	(void) xConnectStatus;
+}
+
+#if TASK_MQTT_AGENT_USE_STANDBY
+static void prvSwitchToStandby(void)
+{
+	MQTTContext_t *pMqttContext = &(xGlobalMqttAgentContext.mqttContext);
+	MQTTStatus_t xStatus = MQTTSuccess;
+
+	xSemaphoreTake(xConnectMutex, portMAX_DELAY);
+
+	NetworkContext_t *pxOldNetworkContext = pxActiveNetworkContext;
+	NetworkContext_t *pxNewNetworkContext = pxStandbyNetworkContext;
+	pxStandbyNetworkContext = NULL;
+
+	if (pxNewNetworkContext == NULL)
+	{
+		xSemaphoreGive(xConnectMutex);
+		return;
+	}
+
+	uint32_t ulOldSocket = pxOldNetworkContext->socket;
+	uint32_t ulStartMs = prvGetTimeMs();
+
+	/* Drain what the broker already sent on the old connection. */
+	while (pMqttContext->connectStatus == MQTTConnected
+			&& (xStatus == MQTTSuccess || xStatus == MQTTNeedMoreBytes))
+	{
+		xGlobalMqttAgentContext.packetReceivedInLoop = false;
+		xStatus = MQTT_ProcessLoop(pMqttContext);
+		if (!xGlobalMqttAgentContext.packetReceivedInLoop)
+		{
+			break;
+		}
+	}
+
+	/* The broker hands the session over to the new connection and drops the
+	 * old one, the old socket is closed once the CONNACK is in. */
+	prvUseNetworkContext(pxNewNetworkContext);
+	xStatus = prvMQTTConnect( false);
+	prvSocketDisconnect(pxOldNetworkContext);
+
+	if (xStatus == MQTTSuccess)
+	{
+		LogInfo(
+				( "Switched from socket %lu to socket %lu, %lu ms without a connection to the broker", ulOldSocket, pxNewNetworkContext->socket, prvGetTimeMs() - ulStartMs ));
+	}
+	else
+	{
+		LogError(
+				( "MQTT CONNECT on the standby connection failed with %s, reconnecting", MQTT_Status_strerror(xStatus) ));
+		prvReconnect();
+	}
+
+	xSemaphoreGive(xConnectMutex);
+}
+
+static bool prvAgentMessageReceive(MQTTAgentMessageContext_t *pMsgCtx,
+		MQTTAgentCommand_t **pReceivedCommand, uint32_t blockTimeMs)
+{
+	MQTTContext_t *pMqttContext = &(xGlobalMqttAgentContext.mqttContext);
+
+	if (pxStandbyNetworkContext != NULL)
+	{
+		prvSwitchToStandby();
+	}
+	/* The broker is slow to answer, have a spare connection ready before the
+	 * keep-alive gives up on this one. */
+	else if (pMqttContext->waitingForPingResp
+			&& prvGetTimeMs() - pMqttContext->pingReqSendTimeMs
+					>= STANDBY_PINGRESP_LATE_MS)
+	{
+		(void) RequestMQTTReconnect();
+	}
+
+	return Agent_MessageReceive(pMsgCtx, pReceivedCommand, blockTimeMs);
+}
+
+static void prvStandbyConnectTask(void *pvParameters)
+{
+	const TickType_t xInterval =
+			PLANNED_RECONNECT_INTERVAL_S == 0U ?
+					portMAX_DELAY :
+					(TickType_t) PLANNED_RECONNECT_INTERVAL_S * configTICK_RATE_HZ;
+
+	(void) pvParameters;
+
+	for (;;)
+	{
+		(void) xSemaphoreTake(xStandbyRequest, xInterval);
+
+		xSemaphoreTake(xConnectMutex, portMAX_DELAY);
+
+		if (pxStandbyNetworkContext == NULL)
+		{
+			NetworkContext_t *pxSpare =
+					pxActiveNetworkContext == &xNetworkContexts[0] ?
+							&xNetworkContexts[1] : &xNetworkContexts[0];
+			uint32_t ulStartMs = prvGetTimeMs();
+
+			LogInfo(( "Opening a standby connection to the broker" ));
+
+			if (prvOpenNetworkContext(pxSpare))
+			{
+				LogInfo(
+						( "Standby connection on socket %lu ready in %lu ms", pxSpare->socket, prvGetTimeMs() - ulStartMs ));
+				pxStandbyNetworkContext = pxSpare;
+			}
+			else
+			{
+				LogError(( "Standby connection failed, the agent keeps the current one" ));
+			}
+
+			/* A late PINGRESP keeps asking while the handshake runs. */
+			(void) xSemaphoreTake(xStandbyRequest, 0U);
+		}
+
+		xSemaphoreGive(xConnectMutex);
+	}
+}
+#endif
+
 static MQTTStatus_t prvMQTTInit(void)
 {
 	TransportInterface_t xTransport;
@@ -252,7 +542,12 @@ static MQTTStatus_t prvMQTTInit(void)
 			* sizeof(MQTTAgentCommand_t*)];
 	static StaticQueue_t staticQueueStructure;
 	MQTTAgentMessageInterface_t messageInterface =
-	{ .pMsgCtx = NULL, .send = Agent_MessageSend, .recv = Agent_MessageReceive,
+	{ .pMsgCtx = NULL, .send = Agent_MessageSend, .recv =
+#if TASK_MQTT_AGENT_USE_STANDBY
+			prvAgentMessageReceive,
+#else
+			Agent_MessageReceive,
+#endif
 			.getCommand = Agent_GetCommand, .releaseCommand =
 					Agent_ReleaseCommand };
 
@@ -267,9 +562,9 @@ static MQTTStatus_t prvMQTTInit(void)
 	Agent_InitializePool();
 
 #if TASK_MQTT_AGENT_USE_TLS
-	InitTLSTransport(&xNetworkContext, &xTransport);
+	InitTLSTransport(pxActiveNetworkContext, &xTransport);
 #else
-	InitPlainTextTransport(&xNetworkContext, &xTransport);
+	InitPlainTextTransport(pxActiveNetworkContext, &xTransport);
 #endif
 
 	/* Initialize MQTT library. */
@@ -518,23 +813,26 @@ static BaseType_t prvSocketDisconnect(NetworkContext_t *pxNetworkContext)
 	return pdPASS;
 }
 
-static bool ConnectToMQTTBroker(void)
+static bool prvOpenNetworkContext(NetworkContext_t *pxNetworkContext)
 {
-	BaseType_t xNetworkStatus = pdFAIL;
-	MQTTStatus_t xMQTTStatus;
-
 #if TASK_MQTT_AGENT_USE_TLS
 	bool net_context_use_ssl = true;
 #else
 	bool net_context_use_ssl = false;
 #endif
-	if(!InitNetworkContext(&xNetworkContext, net_context_use_ssl)) {
+	if(!InitNetworkContext(pxNetworkContext, net_context_use_ssl)) {
 		return false;
 	}
 
 	/* Connect a TCP socket to the broker. */
-	xNetworkStatus = prvSocketConnect(&xNetworkContext);
-	if (xNetworkStatus != pdPASS)
+	return prvSocketConnect(pxNetworkContext) == pdPASS;
+}
+
+static bool ConnectToMQTTBroker(void)
+{
+	MQTTStatus_t xMQTTStatus;
+
+	if (!prvOpenNetworkContext(pxActiveNetworkContext))
 	{
 		return false;
 	}
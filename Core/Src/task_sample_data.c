@@ -11,15 +11,42 @@
 #include "core_mqtt_agent.h"
 #include "core_mqtt_config.h"
 
+#include "telemetry_signing.h"
+
 extern MQTTAgentContext_t xGlobalMqttAgentContext;
 
 #define TELEMETRY_TOPIC "v1/devices/me/telemetry"
 
 #define MESSAGE_BUFFER_SIZE 1000
 
+// Publish a signed Merkle root and inclusion proofs for every batch of
+// telemetry messages, see telemetry_signing.h
+#define TELEMETRY_SIGNING 1
+
+#define SIGNING_MESSAGE_BUFFER_SIZE 400
+#define SIGNING_PUBLISH_TIMEOUT_MS 5000
+
 static int CURRENT_MESSAGE_SIZE = 0;
 static uint8_t MESSAGE_BUFFER[MESSAGE_BUFFER_SIZE];
 
+#if TELEMETRY_SIGNING
+struct MQTTAgentCommandContext
+{
+	TaskHandle_t taskToNotify;
+	volatile bool complete;
+	MQTTStatus_t returnStatus;
+};
+
+static TelemetryBatch_t TELEMETRY_BATCH;
+static uint32_t NEXT_BATCH_ID = 0;
+
+static uint8_t SIGNING_MESSAGE_BUFFER[SIGNING_MESSAGE_BUFFER_SIZE];
+// Outlives a timed out publish, the agent may still complete it later
+static MQTTAgentCommandContext_t SIGNING_PUBLISH_CONTEXT;
+
+static void PublishTelemetryBatch();
+#endif
+
 static void ClearMessageBuffer();
 static void UpdateTelemetryMessage();
 static void PublishTelemetryMessage();
@@ -34,6 +61,9 @@ void RunTaskSampleData(GlobalState *globalState)
 
 	// initialization
 	ClearMessageBuffer();
+#if TELEMETRY_SIGNING
+	TelemetryBatch_Init(&TELEMETRY_BATCH, NEXT_BATCH_ID++);
+#endif
 
 	// main loop
 	for (;;)
@@ -47,8 +77,15 @@ void RunTaskSampleData(GlobalState *globalState)
 static void UpdateTelemetryMessage()
 {
 	ClearMessageBuffer();
+#if TELEMETRY_SIGNING
+	// batch and seq tie the message to its signed root and inclusion proof
+	CURRENT_MESSAGE_SIZE = snprintf((char*) MESSAGE_BUFFER, 1000,
+			"{ticks:%lu,batch:%lu,seq:%u}", xTaskGetTickCount(),
+			TELEMETRY_BATCH.batchId, TELEMETRY_BATCH.count);
+#else
 	CURRENT_MESSAGE_SIZE = snprintf((char*) MESSAGE_BUFFER, 1000, "{ticks:%lu}",
 			xTaskGetTickCount());
+#endif
 }
 
 static void PublishTelemetryMessage()
@@ -71,7 +108,137 @@ static void PublishTelemetryMessage()
 	publishInfo.payloadLength = CURRENT_MESSAGE_SIZE;
 
 	MQTTAgent_Publish(&xGlobalMqttAgentContext, &publishInfo, &commandInfo);
+
+#if TELEMETRY_SIGNING
+	if (TelemetryBatch_Add(&TELEMETRY_BATCH, MESSAGE_BUFFER,
+			CURRENT_MESSAGE_SIZE))
+	{
+		PublishTelemetryBatch();
+		TelemetryBatch_Init(&TELEMETRY_BATCH, NEXT_BATCH_ID++);
+	}
+#endif
+}
+
+#if TELEMETRY_SIGNING
+static void SigningPublishComplete(MQTTAgentCommandContext_t *context,
+		MQTTAgentReturnInfo_t *returnInfo)
+{
+	context->returnStatus = returnInfo->returnCode;
+	context->complete = true;
+	xTaskNotifyGive(context->taskToNotify);
+}
+
+/*
+ * Publishes SIGNING_MESSAGE_BUFFER and waits for the agent to be done with it,
+ * so that the buffer can be reused for the next message.
+ */
+static bool PublishSigningMessage(size_t length)
+{
+	MQTTPublishInfo_t publishInfo =
+	{ 0UL };
+	publishInfo.qos = MQTTQoS1;
+	publishInfo.pTopicName = TELEMETRY_TOPIC;
+	publishInfo.topicNameLength = sizeof(TELEMETRY_TOPIC) - 1;
+	publishInfo.pPayload = SIGNING_MESSAGE_BUFFER;
+	publishInfo.payloadLength = length;
+
+	SIGNING_PUBLISH_CONTEXT.taskToNotify = xTaskGetCurrentTaskHandle();
+	SIGNING_PUBLISH_CONTEXT.complete = false;
+	SIGNING_PUBLISH_CONTEXT.returnStatus = MQTTSendFailed;
+
+	MQTTAgentCommandInfo_t commandInfo =
+	{ 0UL };
+	commandInfo.blockTimeMs = 500;
+	commandInfo.cmdCompleteCallback = SigningPublishComplete;
+	commandInfo.pCmdCompleteCallbackContext = &SIGNING_PUBLISH_CONTEXT;
+
+	if (MQTTAgent_Publish(&xGlobalMqttAgentContext, &publishInfo, &commandInfo)
+			!= MQTTSuccess)
+	{
+		return false;
+	}
+
+	TickType_t start = xTaskGetTickCount();
+	while (!SIGNING_PUBLISH_CONTEXT.complete)
+	{
+		TickType_t elapsed = xTaskGetTickCount() - start;
+		if (elapsed >= pdMS_TO_TICKS(SIGNING_PUBLISH_TIMEOUT_MS))
+		{
+			return false;
+		}
+		ulTaskNotifyTake(pdTRUE,
+				pdMS_TO_TICKS(SIGNING_PUBLISH_TIMEOUT_MS) - elapsed);
+	}
+
+	return SIGNING_PUBLISH_CONTEXT.returnStatus == MQTTSuccess;
+}
+
+static size_t WriteHex(char *out, const uint8_t *data, size_t length)
+{
+	static const char digits[] = "0123456789abcdef";
+
+	for (size_t i = 0; i < length; i++)
+	{
+		out[2 * i] = digits[data[i] >> 4];
+		out[2 * i + 1] = digits[data[i] & 0x0F];
+	}
+	out[2 * length] = '\0';
+
+	return 2 * length;
+}
+
+/*
+ * Signs the batch root with the STSAFE and publishes it, followed by the
+ * inclusion proof of every message in the batch.
+ */
+static void PublishTelemetryBatch()
+{
+	if (!TelemetryBatch_Seal(&TELEMETRY_BATCH))
+	{
+		LogError(("Could not sign telemetry batch %lu", TELEMETRY_BATCH.batchId));
+		return;
+	}
+
+	char root[2 * TELEMETRY_SIGNING_HASH_SIZE + 1];
+	char signature[4 * TELEMETRY_SIGNING_HASH_SIZE + 1];
+	WriteHex(root, TELEMETRY_BATCH.root, TELEMETRY_SIGNING_HASH_SIZE);
+	size_t signatureLength = WriteHex(signature, TELEMETRY_BATCH.signatureR,
+	TELEMETRY_SIGNING_HASH_SIZE);
+	WriteHex(&signature[signatureLength], TELEMETRY_BATCH.signatureS,
+	TELEMETRY_SIGNING_HASH_SIZE);
+
+	int length = snprintf((char*) SIGNING_MESSAGE_BUFFER,
+			SIGNING_MESSAGE_BUFFER_SIZE,
+			"{batch:%lu,count:%u,root:\"%s\",sig:\"%s\"}",
+			TELEMETRY_BATCH.batchId, TELEMETRY_BATCH.count, root, signature);
+	if (!PublishSigningMessage(length))
+	{
+		LogError(("Could not publish root of telemetry batch %lu", TELEMETRY_BATCH.batchId));
+		return;
+	}
+
+	uint8_t proof[TELEMETRY_SIGNING_MAX_PROOF_LENGTH][TELEMETRY_SIGNING_HASH_SIZE];
+	char proofHex[2 * sizeof(proof) + 1];
+	for (uint8_t seq = 0; seq < TELEMETRY_BATCH.count; seq++)
+	{
+		uint8_t proofLength = TelemetryBatch_Proof(&TELEMETRY_BATCH, seq,
+				proof);
+		WriteHex(proofHex, &proof[0][0],
+				proofLength * TELEMETRY_SIGNING_HASH_SIZE);
+
+		length = snprintf((char*) SIGNING_MESSAGE_BUFFER,
+				SIGNING_MESSAGE_BUFFER_SIZE, "{batch:%lu,seq:%u,proof:\"%s\"}",
+				TELEMETRY_BATCH.batchId, seq, proofHex);
+		if (!PublishSigningMessage(length))
+		{
+			LogError(("Could not publish proofs of telemetry batch %lu", TELEMETRY_BATCH.batchId));
+			return;
+		}
+	}
+
+	LogInfo(("Published signed root and %u proofs of telemetry batch %lu", TELEMETRY_BATCH.count, TELEMETRY_BATCH.batchId));
 }
+#endif
 
 static void ClearMessageBuffer()
 {
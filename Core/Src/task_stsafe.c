@@ -0,0 +1,183 @@
+#include "task_stsafe.h"
+
+#include "main.h"
+#include "FreeRTOS.h"
+#include "task.h"
+#include "queue.h"
+#include "semphr.h"
+#include "event_groups.h"
+#include "cmsis_os.h"
+
+#include "stsafe_interface.h"
+
+#define STSAFE_HANDSHAKE_QUEUE_LENGTH 4
+#define STSAFE_BACKGROUND_QUEUE_LENGTH 8
+
+#define STSAFE_INIT_RETRY_DELAY_MS 1000
+
+#define STSAFE_SERVICE_READY_BIT (1 << 0)
+
+// Owned by the STSAFE task, one I/O buffer for every connection and feature
+static StSafeA_Handle_t stsafea_handle;
+static uint8_t a_rx_tx_stsafea_data[STSAFEA_BUFFER_MAX_SIZE];
+
+static QueueHandle_t handshake_queue = NULL;
+static QueueHandle_t background_queue = NULL;
+
+// Counts queued requests across both queues. The task cannot wait on a
+// notification for new work, the I2C binding uses its notification to wait
+// for transfer completion.
+static SemaphoreHandle_t pending_requests = NULL;
+
+static EventGroupHandle_t service_events = NULL;
+static TaskHandle_t service_task = NULL;
+
+void stsafe_ServiceInit(void)
+{
+	static uint8_t handshakeQueueStorageArea[STSAFE_HANDSHAKE_QUEUE_LENGTH
+			* sizeof(StsafeRequest_t*)];
+	static StaticQueue_t handshakeQueueStructure;
+	static uint8_t backgroundQueueStorageArea[STSAFE_BACKGROUND_QUEUE_LENGTH
+			* sizeof(StsafeRequest_t*)];
+	static StaticQueue_t backgroundQueueStructure;
+	static StaticSemaphore_t pendingRequestsStructure;
+	static StaticEventGroup_t serviceEventsStructure;
+
+	handshake_queue = xQueueCreateStatic(STSAFE_HANDSHAKE_QUEUE_LENGTH,
+			sizeof(StsafeRequest_t*), handshakeQueueStorageArea,
+			&handshakeQueueStructure);
+	background_queue = xQueueCreateStatic(STSAFE_BACKGROUND_QUEUE_LENGTH,
+			sizeof(StsafeRequest_t*), backgroundQueueStorageArea,
+			&backgroundQueueStructure);
+	pending_requests = xSemaphoreCreateCountingStatic(
+	STSAFE_HANDSHAKE_QUEUE_LENGTH + STSAFE_BACKGROUND_QUEUE_LENGTH, 0,
+			&pendingRequestsStructure);
+	service_events = xEventGroupCreateStatic(&serviceEventsStructure);
+}
+
+static StsafeRequest_t* stsafe_NextRequest(void)
+{
+	StsafeRequest_t *request = NULL;
+
+	if (xQueueReceive(handshake_queue, &request, 0) == pdPASS)
+	{
+		return request;
+	}
+	if (xQueueReceive(background_queue, &request, 0) == pdPASS)
+	{
+		return request;
+	}
+
+	return NULL;
+}
+
+void RunTaskSTSAFE(GlobalState *globalState)
+{
+	service_task = xTaskGetCurrentTaskHandle();
+
+	// Requests queued while the chip comes up are served once it is ready
+	while (!stsafea_init(&stsafea_handle, a_rx_tx_stsafea_data))
+	{
+		osDelay(STSAFE_INIT_RETRY_DELAY_MS);
+	}
+	xEventGroupSetBits(service_events, STSAFE_SERVICE_READY_BIT);
+
+	// main loop
+	for (;;)
+	{
+		xSemaphoreTake(pending_requests, portMAX_DELAY);
+
+		StsafeRequest_t *request = stsafe_NextRequest();
+		if (request == NULL)
+		{
+			continue;
+		}
+
+		request->done = false;
+		request->result = request->operation(&stsafea_handle, request->args);
+
+		// The request may be reused as soon as the requester hears back
+		TaskHandle_t waitingTask = request->waitingTask;
+		if (request->onComplete != NULL)
+		{
+			request->onComplete(request);
+		}
+		request->done = true;
+		if (waitingTask != NULL)
+		{
+			xTaskNotifyGive(waitingTask);
+		}
+	}
+}
+
+bool stsafe_ServiceWaitReady(uint32_t timeoutMs)
+{
+	EventBits_t bits = xEventGroupWaitBits(service_events,
+	STSAFE_SERVICE_READY_BIT, pdFALSE, pdTRUE, pdMS_TO_TICKS(timeoutMs));
+
+	return (bits & STSAFE_SERVICE_READY_BIT) != 0;
+}
+
+bool stsafe_ServicePost(StsafePriority_t priority, StsafeRequest_t *request)
+{
+	QueueHandle_t queue =
+			priority == STSAFE_PRIORITY_HANDSHAKE ?
+					handshake_queue : background_queue;
+
+	if (xQueueSend(queue, &request, portMAX_DELAY) != pdPASS)
+	{
+		return false;
+	}
+	xSemaphoreGive(pending_requests);
+
+	return true;
+}
+
+bool stsafe_ServiceStart(StsafePriority_t priority, StsafeRequest_t *request,
+		StsafeOperation_t operation, void *args)
+{
+	// Would wait on itself forever
+	configASSERT(xTaskGetCurrentTaskHandle() != service_task);
+
+	*request = (StsafeRequest_t )
+			{ .operation = operation, .args = args, .onComplete = NULL,
+					.waitingTask = xTaskGetCurrentTaskHandle(), .result =
+							STSAFEA_UNEXPECTED_ERROR, .done = false };
+
+	if (!stsafe_ServicePost(priority, request))
+	{
+		request->done = true;
+		return false;
+	}
+
+	return true;
+}
+
+bool stsafe_ServiceIsDone(const StsafeRequest_t *request)
+{
+	return request->done;
+}
+
+StSafeA_ResponseCode_t stsafe_ServiceWait(StsafeRequest_t *request)
+{
+	// A notification meant for something else must not end the wait early
+	while (!request->done)
+	{
+		ulTaskNotifyTake(pdTRUE, portMAX_DELAY);
+	}
+
+	return request->result;
+}
+
+StSafeA_ResponseCode_t stsafe_ServiceCall(StsafePriority_t priority,
+		StsafeOperation_t operation, void *args)
+{
+	StsafeRequest_t request;
+
+	if (!stsafe_ServiceStart(priority, &request, operation, args))
+	{
+		return STSAFEA_UNEXPECTED_ERROR;
+	}
+
+	return stsafe_ServiceWait(&request);
+}
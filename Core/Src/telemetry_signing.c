@@ -0,0 +1,122 @@
+#include "telemetry_signing.h"
+
+#include <string.h>
+
+#include "wolfssl/wolfcrypt/sha256.h"
+
+#include "stsafe_interface.h"
+
+#define TELEMETRY_SIGNING_LEAF_PREFIX 0x00
+#define TELEMETRY_SIGNING_NODE_PREFIX 0x01
+
+// Tree levels are rebuilt here, only used from the sample data task
+static uint8_t scratch[TELEMETRY_SIGNING_BATCH_SIZE][TELEMETRY_SIGNING_HASH_SIZE];
+
+static void telemetry_HashNode(const uint8_t *left, const uint8_t *right,
+		uint8_t *out)
+{
+	const uint8_t prefix = TELEMETRY_SIGNING_NODE_PREFIX;
+	wc_Sha256 sha;
+
+	wc_InitSha256(&sha);
+	wc_Sha256Update(&sha, &prefix, sizeof(prefix));
+	wc_Sha256Update(&sha, left, TELEMETRY_SIGNING_HASH_SIZE);
+	wc_Sha256Update(&sha, right, TELEMETRY_SIGNING_HASH_SIZE);
+	wc_Sha256Final(&sha, out);
+	wc_Sha256Free(&sha);
+}
+
+// Replaces the nodes of a level with their parents, returns the parent count
+static uint8_t telemetry_NextLevel(
+		uint8_t level[][TELEMETRY_SIGNING_HASH_SIZE], uint8_t count)
+{
+	uint8_t parents = 0;
+
+	for (uint8_t i = 0; i < count; i += 2)
+	{
+		if (i + 1 < count)
+		{
+			telemetry_HashNode(level[i], level[i + 1], level[parents]);
+		}
+		else
+		{
+			// no sibling, carried up unchanged
+			memcpy(level[parents], level[i], TELEMETRY_SIGNING_HASH_SIZE);
+		}
+		parents++;
+	}
+
+	return parents;
+}
+
+void TelemetryBatch_Init(TelemetryBatch_t *batch, uint32_t batchId)
+{
+	memset(batch, 0, sizeof(*batch));
+	batch->batchId = batchId;
+}
+
+bool TelemetryBatch_Add(TelemetryBatch_t *batch, const uint8_t *payload,
+		size_t payloadLength)
+{
+	if (batch->count >= TELEMETRY_SIGNING_BATCH_SIZE)
+	{
+		return true;
+	}
+
+	const uint8_t prefix = TELEMETRY_SIGNING_LEAF_PREFIX;
+	wc_Sha256 sha;
+
+	wc_InitSha256(&sha);
+	wc_Sha256Update(&sha, &prefix, sizeof(prefix));
+	wc_Sha256Update(&sha, payload, payloadLength);
+	wc_Sha256Final(&sha, batch->leaves[batch->count]);
+	wc_Sha256Free(&sha);
+
+	batch->count++;
+
+	return batch->count == TELEMETRY_SIGNING_BATCH_SIZE;
+}
+
+bool TelemetryBatch_Seal(TelemetryBatch_t *batch)
+{
+	if (batch->count == 0)
+	{
+		return false;
+	}
+
+	uint8_t count = batch->count;
+	memcpy(scratch, batch->leaves, count * TELEMETRY_SIGNING_HASH_SIZE);
+	while (count > 1)
+	{
+		count = telemetry_NextLevel(scratch, count);
+	}
+	memcpy(batch->root, scratch[0], TELEMETRY_SIGNING_HASH_SIZE);
+
+	// the root is a SHA-256 output, so it is signed as the digest directly
+	return stsafe_SignDigest(batch->root, batch->signatureR,
+			batch->signatureS);
+}
+
+uint8_t TelemetryBatch_Proof(const TelemetryBatch_t *batch, uint8_t index,
+		uint8_t proof[TELEMETRY_SIGNING_MAX_PROOF_LENGTH][TELEMETRY_SIGNING_HASH_SIZE])
+{
+	uint8_t length = 0;
+	uint8_t count = batch->count;
+
+	memcpy(scratch, batch->leaves, count * TELEMETRY_SIGNING_HASH_SIZE);
+	while (count > 1)
+	{
+		uint8_t sibling = index ^ 1;
+		if (sibling < count)
+		{
+			memcpy(proof[length], scratch[sibling],
+			TELEMETRY_SIGNING_HASH_SIZE);
+			length++;
+		}
+
+		count = telemetry_NextLevel(scratch, count);
+		index /= 2;
+	}
+
+	return length;
+}
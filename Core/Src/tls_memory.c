@@ -0,0 +1,310 @@
+#include "tls_memory.h"
+
+#include <stdio.h>
+
+#include "wolfssl/wolfcrypt/memory.h"
+
+#include "tls_memory_buckets.h"
+
+#if TLS_MEMORY_TRACE
+/*
+ * Roomy layouts to record a trace with, the tool picks the real ones from it.
+ * The session sizes are 16 bytes larger so a bucket size names its pool. The
+ * blocks cover the peaks of a Tools/tls_memory_trace run with room to spare
+ * and fit the TLSPOOL region next to the I/O pool.
+ */
+#define GENERAL_POOL_BUCKETS 64, 128, 256, 512, 1024, 2048, 4096, 8192, 16128
+#define GENERAL_POOL_DIST 8, 8, 8, 28, 28, 4, 3, 1, 1
+#define GENERAL_POOL_BLOCKS_SIZE (91392U + 89U * TLS_MEMORY_BUCKET_PADDING)
+#define SESSION_POOL_BUCKETS 80, 144, 272, 528, 1040, 2064, 4112, 8208
+#define SESSION_POOL_DIST 48, 20, 8, 10, 8, 8, 3, 1
+#define SESSION_POOL_BLOCKS_SIZE (59552U + 106U * TLS_MEMORY_BUCKET_PADDING)
+#else
+#define GENERAL_POOL_BUCKETS TLS_MEMORY_GENERAL_BUCKETS
+#define GENERAL_POOL_DIST TLS_MEMORY_GENERAL_DIST
+#define GENERAL_POOL_BLOCKS_SIZE TLS_MEMORY_GENERAL_BLOCKS_SIZE
+#define SESSION_POOL_BUCKETS TLS_MEMORY_SESSION_BUCKETS
+#define SESSION_POOL_DIST TLS_MEMORY_SESSION_DIST
+#define SESSION_POOL_BLOCKS_SIZE TLS_MEMORY_SESSION_BLOCKS_SIZE
+#endif
+
+// The heap structures at the start of a pool and the bytes lost aligning the
+// first block
+#define POOL_OVERHEAD (sizeof(WOLFSSL_HEAP) + sizeof(WOLFSSL_HEAP_HINT) \
+		+ WOLFSSL_STATIC_ALIGN)
+
+// An input and an output record buffer per connection. With a negotiated
+// TLS_MAX_FRAGMENT_LENGTH the record buffers fit session buckets instead.
+#if TLS_MAX_FRAGMENT_LENGTH
+#define IO_POOL_BUFFERS 0U
+#else
+#define IO_POOL_BUFFERS (2U * TLS_MEMORY_MAX_CONNECTIONS)
+#endif
+#define IO_POOL_SIZE (IO_POOL_BUFFERS \
+		* (WOLFMEM_IO_SZ + TLS_MEMORY_BUCKET_PADDING) + WOLFSSL_STATIC_ALIGN)
+
+// The TLSPOOL region of the linker script, not zeroed at startup
+#define TLS_POOL_SECTION \
+	__attribute__((section(".tls_pool"), aligned(WOLFSSL_STATIC_ALIGN)))
+
+static uint8_t general_pool[GENERAL_POOL_BLOCKS_SIZE + POOL_OVERHEAD] TLS_POOL_SECTION;
+static uint8_t session_pool[SESSION_POOL_BLOCKS_SIZE + POOL_OVERHEAD] TLS_POOL_SECTION;
+#if IO_POOL_BUFFERS
+static uint8_t io_pool[IO_POOL_SIZE] TLS_POOL_SECTION;
+#endif
+
+typedef struct
+{
+	const char *name;
+	char tag; // names the pool in trace lines
+	uint8_t *buffer;
+	uint32_t bufferSize;
+	unsigned int sizes[WOLFMEM_MAX_BUCKETS];
+	unsigned int dist[WOLFMEM_MAX_BUCKETS];
+	WOLFSSL_HEAP_HINT *hint;
+	// Counted by the debug callback, under the mutex of the pool
+	uint32_t blocks[WOLFMEM_MAX_BUCKETS];
+	uint32_t inUse[WOLFMEM_MAX_BUCKETS];
+	uint32_t peak[WOLFMEM_MAX_BUCKETS];
+} TLSMemoryPool_t;
+
+enum
+{
+	POOL_GENERAL, POOL_SESSION, POOL_COUNT
+};
+
+static TLSMemoryPool_t memory_pools[POOL_COUNT] =
+{
+	{ .name = "general", .tag = 'G', .buffer = general_pool, .bufferSize =
+			sizeof(general_pool), .sizes =
+	{ GENERAL_POOL_BUCKETS }, .dist =
+	{ GENERAL_POOL_DIST } },
+	{ .name = "session", .tag = 'S', .buffer = session_pool, .bufferSize =
+			sizeof(session_pool), .sizes =
+	{ SESSION_POOL_BUCKETS }, .dist =
+	{ SESSION_POOL_DIST } } };
+
+static bool memory_initialized = false;
+static uint32_t alloc_failures = 0;
+
+static bool memory_FindBucket(uint32_t bucketSize, TLSMemoryPool_t **pool,
+		uint32_t *index)
+{
+	for (uint32_t p = 0; p < POOL_COUNT; p++)
+	{
+		for (uint32_t i = 0; i < WOLFMEM_MAX_BUCKETS; i++)
+		{
+			if (memory_pools[p].sizes[i] == bucketSize)
+			{
+				*pool = &memory_pools[p];
+				*index = i;
+				return true;
+			}
+		}
+	}
+
+	return false;
+}
+
+/*
+ * Called by wolfSSL under the mutex of the pool. Fixed I/O buffers are not in
+ * the bucket lists and are left out. A realloc frees the old block
+ * without reporting the new one, in use counts never go below zero.
+ */
+static void memory_DebugCb(size_t sz, int bucketSz, byte st, int type)
+{
+	if (st == WOLFSSL_DEBUG_MEMORY_FAIL)
+	{
+		__atomic_fetch_add(&alloc_failures, 1, __ATOMIC_RELAXED);
+#if TLS_MEMORY_TRACE
+		printf("MEMTRACE ? X %u %d\r\n", (unsigned int) sz, type);
+#endif
+		return;
+	}
+	if (st != WOLFSSL_DEBUG_MEMORY_ALLOC && st != WOLFSSL_DEBUG_MEMORY_FREE)
+	{
+		return;
+	}
+
+	TLSMemoryPool_t *pool;
+	uint32_t index;
+	if (!memory_FindBucket((uint32_t) bucketSz, &pool, &index))
+	{
+		return;
+	}
+
+	if (st == WOLFSSL_DEBUG_MEMORY_ALLOC)
+	{
+		pool->inUse[index]++;
+		if (pool->inUse[index] > pool->peak[index])
+		{
+			pool->peak[index] = pool->inUse[index];
+		}
+	}
+	else if (pool->inUse[index] > 0)
+	{
+		pool->inUse[index]--;
+	}
+
+#if TLS_MEMORY_TRACE
+	// With WOLFSSL_DEBUG_MEMORY frees report the size that was asked for
+	printf("MEMTRACE %c %c %u %d\r\n", pool->tag,
+			st == WOLFSSL_DEBUG_MEMORY_ALLOC ? 'A' : 'F', (unsigned int) sz,
+			type);
+#else
+	(void) sz;
+	(void) type;
+#endif
+}
+
+// A pool too small for its layout still works, with fewer blocks
+static void memory_CountBlocks(TLSMemoryPool_t *pool)
+{
+	WOLFSSL_MEM_STATS stats;
+	wolfSSL_GetMemStats(pool->hint->memory, &stats);
+
+	for (uint32_t i = 0; i < WOLFMEM_MAX_BUCKETS; i++)
+	{
+		pool->blocks[i] = stats.avaBlock[i];
+
+		if (pool->blocks[i] < pool->dist[i])
+		{
+			printf("TLSMemory: %s pool holds %lu of %u blocks of %u bytes\r\n",
+					pool->name, pool->blocks[i], pool->dist[i], pool->sizes[i]);
+		}
+	}
+}
+
+// Usage is counted per bucket size, a size in both pools is counted for the
+// general one
+static void memory_CheckLayouts(void)
+{
+	for (uint32_t i = 0; i < WOLFMEM_MAX_BUCKETS; i++)
+	{
+		for (uint32_t j = 0; j < WOLFMEM_MAX_BUCKETS; j++)
+		{
+			if (memory_pools[POOL_SESSION].sizes[i] != 0
+					&& memory_pools[POOL_SESSION].sizes[i]
+							== memory_pools[POOL_GENERAL].sizes[j])
+			{
+				printf(
+						"TLSMemory: %u byte buckets in both pools, their usage is not told apart\r\n",
+						memory_pools[POOL_SESSION].sizes[i]);
+			}
+		}
+	}
+}
+
+static bool memory_LoadPool(TLSMemoryPool_t *pool, int flag, int max)
+{
+	if (wc_LoadStaticMemory_ex(&pool->hint, WOLFMEM_MAX_BUCKETS, pool->sizes,
+			pool->dist, pool->buffer, pool->bufferSize, flag, max) != 0)
+	{
+		printf("TLSMemory: failed to load the %s pool\r\n", pool->name);
+		return false;
+	}
+
+	return true;
+}
+
+bool TLSMemory_Init(void)
+{
+	if (memory_initialized)
+	{
+		return true;
+	}
+
+	TLSMemoryPool_t *general = &memory_pools[POOL_GENERAL];
+	TLSMemoryPool_t *session = &memory_pools[POOL_SESSION];
+
+	if (wolfSSL_MemoryPaddingSz() != (int) TLS_MEMORY_BUCKET_PADDING)
+	{
+		printf("TLSMemory: blocks take %d bytes of padding, the layout expects %u\r\n",
+				wolfSSL_MemoryPaddingSz(), TLS_MEMORY_BUCKET_PADDING);
+	}
+
+	if (!memory_LoadPool(general, WOLFMEM_GENERAL, 0)
+			|| !memory_LoadPool(session, WOLFMEM_GENERAL | WOLFMEM_TRACK_STATS,
+					TLS_MEMORY_MAX_CONNECTIONS))
+	{
+		return false;
+	}
+
+#if IO_POOL_BUFFERS
+	// The fixed I/O buffers join the session heap
+	if (wc_LoadStaticMemory_ex(&session->hint, WOLFMEM_MAX_BUCKETS,
+			session->sizes, session->dist, io_pool, sizeof(io_pool),
+			WOLFMEM_IO_POOL_FIXED, TLS_MEMORY_MAX_CONNECTIONS) != 0)
+	{
+		printf("TLSMemory: failed to load the I/O pool\r\n");
+		return false;
+	}
+#endif
+
+	memory_CountBlocks(general);
+	memory_CountBlocks(session);
+	memory_CheckLayouts();
+
+	wolfSSL_SetDebugMemoryCb(memory_DebugCb);
+	wolfSSL_SetGlobalHeapHint(general->hint);
+	memory_initialized = true;
+
+	printf("TLSMemory: general pool %u bytes, session pool %u bytes, I/O pool %u bytes\r\n",
+			(unsigned int) sizeof(general_pool),
+			(unsigned int) sizeof(session_pool),
+			IO_POOL_BUFFERS ? (unsigned int) IO_POOL_SIZE : 0U);
+
+	return true;
+}
+
+WOLFSSL_HEAP_HINT* TLSMemory_SessionHeap(void)
+{
+	return memory_initialized ? memory_pools[POOL_SESSION].hint : NULL;
+}
+
+void TLSMemory_LogConnection(WOLFSSL *ssl)
+{
+	WOLFSSL_MEM_CONN_STATS stats =
+	{ 0 };
+
+	if (ssl == NULL || wolfSSL_is_static_memory(ssl, &stats) != 1)
+	{
+		return;
+	}
+
+	printf(
+			"TLSMemory: connection peak %u bytes in %u blocks with its record buffers, %u allocations\r\n",
+			stats.peakMem, stats.peakAlloc, stats.totalAlloc);
+}
+
+void TLSMemory_LogUsage(void)
+{
+	if (!memory_initialized)
+	{
+		return;
+	}
+
+	for (uint32_t p = 0; p < POOL_COUNT; p++)
+	{
+		const TLSMemoryPool_t *pool = &memory_pools[p];
+
+		for (uint32_t i = 0; i < WOLFMEM_MAX_BUCKETS; i++)
+		{
+			if (pool->blocks[i] == 0)
+			{
+				continue;
+			}
+
+			printf(
+					"TLSMemory: %s %5u byte buckets: %2lu blocks, peak %2lu in use, %2lu now\r\n",
+					pool->name, pool->sizes[i], pool->blocks[i], pool->peak[i],
+					pool->inUse[i]);
+		}
+	}
+
+	if (alloc_failures != 0)
+	{
+		printf("TLSMemory: %lu allocations found no free block\r\n",
+				alloc_failures);
+	}
+}
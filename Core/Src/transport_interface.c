@@ -1,18 +1,22 @@
 #include "transport_interface.h"
 
+#include <string.h>
+
 #include "main.h"
 
 #include "es_wifi.h"
 #include "wifi.h"
 
 #include "wifi_utils.h"
+#include "transport_socket.h"
 
 // implemented in transport_interface_tls.c
 extern bool InitSSLContext(NetworkContext_t *NetworkContext);
 
 bool InitNetworkContext(NetworkContext_t *NetworkContext, bool useSSL)
 {
-	NetworkContext->socket = 0;
+	// the socket is taken from the pool when the connection opens
+	NetworkContext->socket = SOCKET_POOL_NONE;
 	NetworkContext->isSSL = useSSL;
 
 	if (useSSL)
@@ -26,21 +30,36 @@ bool InitNetworkContext(NetworkContext_t *NetworkContext, bool useSSL)
 bool PlaintextWiFiConnect(NetworkContext_t *NetworkContext,
 		const uint8_t *ipaddr, uint16_t port)
 {
+	NetworkContext->socket = SocketPool_Allocate("MQTT_CLIENT");
+	if (NetworkContext->socket == SOCKET_POOL_NONE)
+	{
+		return false;
+	}
+
 	WIFI_Status_t ret = WIFI_OpenClientConnection(NetworkContext->socket,
 			WIFI_TCP_PROTOCOL, "MQTT_CLIENT", ipaddr, port, 0);
 
 	if (ret != WIFI_STATUS_OK)
 	{
-		WIFI_CloseClientConnection(NetworkContext->socket);
+		PlaintextWifiDisconnect(NetworkContext);
 		return false;
 	}
+	SocketPool_SetConnected(NetworkContext->socket, true);
+	ReadAhead_Reset(&NetworkContext->readAhead);
 
 	return true;
 }
 
 void PlaintextWifiDisconnect(NetworkContext_t *NetworkContext)
 {
+	if (NetworkContext->socket == SOCKET_POOL_NONE)
+	{
+		return;
+	}
+
 	WIFI_CloseClientConnection(NetworkContext->socket);
+	SocketPool_Release(NetworkContext->socket);
+	NetworkContext->socket = SOCKET_POOL_NONE;
 }
 
 int32_t PlaintextSend(NetworkContext_t *NetworkContext, const void *Buffer,
@@ -70,8 +89,9 @@ int32_t PlaintextRecv(NetworkContext_t *NetworkContext, void *Buffer,
 		Timeout = 0;
 	}
 
-	WIFI_Status_t ret = WIFI_ReceiveData(NetworkContext->socket,
-			(uint8_t*) Buffer, bytesToRecv, &ReceivedDataSize, Timeout);
+	WIFI_Status_t ret = ReadAhead_Receive(&NetworkContext->readAhead,
+			NetworkContext->socket, (uint8_t*) Buffer, bytesToRecv,
+			&ReceivedDataSize, Timeout);
 
 	if (ret != WIFI_STATUS_OK)
 	{
@@ -86,13 +106,50 @@ int32_t PlaintextRecv(NetworkContext_t *NetworkContext, void *Buffer,
 	return (int32_t) ReceivedDataSize;
 }
 
+size_t WritevGather(NetworkContext_t *NetworkContext,
+		const TransportOutVector_t *pIoVec, size_t ioVecCount)
+{
+	const size_t size = sizeof(NetworkContext->writevBuffer);
+	size_t length = 0;
+
+	for (size_t i = 0; i < ioVecCount && length < size; i++)
+	{
+		size_t chunk = pIoVec[i].iov_len;
+		if (chunk > size - length)
+		{
+			chunk = size - length;
+		}
+
+		memcpy(&NetworkContext->writevBuffer[length], pIoVec[i].iov_base, chunk);
+		length += chunk;
+	}
+
+	return length;
+}
+
+// One AT send for the whole packet, coreMQTT sends what is left if it did not
+// fit the buffer
+int32_t PlaintextWritev(NetworkContext_t *NetworkContext,
+		TransportOutVector_t *pIoVec, size_t ioVecCount)
+{
+	if (ioVecCount == 1)
+	{
+		return PlaintextSend(NetworkContext, pIoVec[0].iov_base,
+				pIoVec[0].iov_len);
+	}
+
+	size_t length = WritevGather(NetworkContext, pIoVec, ioVecCount);
+
+	return PlaintextSend(NetworkContext, NetworkContext->writevBuffer, length);
+}
+
 void InitPlainTextTransport(NetworkContext_t *NetworkContext,
 		TransportInterface_t *Transport)
 {
 	Transport->send = PlaintextSend;
 	Transport->recv = PlaintextRecv;
 	Transport->pNetworkContext = NetworkContext;
-	Transport->writev = NULL;
+	Transport->writev = PlaintextWritev;
 }
 
 bool NetworkIsUp()
@@ -10,10 +10,57 @@
 
 #include "TESTING_KEYS.h"
 
+#include "wolfssl/error-ssl.h"
+// Connection fields without an accessor in this configuration
+#include "wolfssl/internal.h"
+
 #include "stsafe_interface.h"
+#include "task_stsafe.h"
+#include "transport_session.h"
+#include "transport_pin.h"
+#include "tls_memory.h"
+#include "transport_socket.h"
 
 #define TLS_TRANSPORT_USE_STSAFEA 1
 
+// Offers TLS 1.3 and falls back to TLS 1.2 with a server that does not have it.
+// On TLS 1.3, resumptions with a ticket that allows it carry the first MQTT
+// packets as 0-RTT data. 0 negotiates TLS 1.2 only.
+#define TLS_TRANSPORT_USE_TLS13 1
+
+// Full handshakes within the pin lifetime check the broker's key against the
+// one of its last validated chain instead of validating the chain again
+#define TLS_TRANSPORT_USE_PINNING 1
+
+// The max_fragment_length code of TLS_MAX_FRAGMENT_LENGTH from the wolfSSL
+// configuration. record_size_limit is not in this wolfSSL version.
+#if TLS_MAX_FRAGMENT_LENGTH == 512
+#define TLS_MFL_CODE WOLFSSL_MFL_2_9
+#elif TLS_MAX_FRAGMENT_LENGTH == 1024
+#define TLS_MFL_CODE WOLFSSL_MFL_2_10
+#elif TLS_MAX_FRAGMENT_LENGTH == 2048
+#define TLS_MFL_CODE WOLFSSL_MFL_2_11
+#elif TLS_MAX_FRAGMENT_LENGTH == 4096
+#define TLS_MFL_CODE WOLFSSL_MFL_2_12
+#elif TLS_MAX_FRAGMENT_LENGTH != 0
+#error "TLS_MAX_FRAGMENT_LENGTH must be 0, 512, 1024, 2048 or 4096"
+#endif
+
+#if TLS_MAX_FRAGMENT_LENGTH
+// Header, nonce, tag and padding of a record sealed by any suite offered
+#define TLS_RECORD_OVERHEAD 64U
+
+_Static_assert(TLS_MAX_FRAGMENT_LENGTH + TLS_RECORD_OVERHEAD <= ES_WIFI_PAYLOAD_SIZE,
+		"a record must fit one AT send");
+#endif
+
+// Covers the STSAFE task's first init attempts after boot
+#define STSAFE_SERVICE_READY_TIMEOUT_MS 5000
+
+// Built on the first connect and kept until reboot, shared by every connection
+static WOLFSSL_CTX *shared_ctx = NULL;
+static bool tls_initialized = false;
+
 // Adapted from https://github.com/FreeRTOS/FreeRTOS/blob/main/FreeRTOS-Plus/Source/Application-Protocols/network_transport/transport_wolfSSL.c
 
 /**
@@ -42,7 +89,7 @@ static TlsTransportStatus_t initTLS(void);
  *  @param[in] ssl WOLFSSL object.
  *  @param[in] buf Buffer for received data
  *  @param[in] sz  Size to receive
- *  @param[in] context Socket to be received from
+ *  @param[in] context NetworkContext_t of the connection
  *
  *  @return received size( > 0 ), #WOLFSSL_CBIO_ERR_CONN_CLOSE, #WOLFSSL_CBIO_ERR_WANT_READ.
  */
@@ -54,7 +101,7 @@ static int wolfSSL_IORecvGlue(WOLFSSL *ssl, char *buf, int sz, void *context);
  *  @param[in] ssl WOLFSSL object.
  *  @param[in] buf Buffer for data to be sent
  *  @param[in] sz  Size to send
- *  @param[in] context Socket to be sent to
+ *  @param[in] context NetworkContext_t of the connection
  *
  *  @return received size( > 0 ), #WOLFSSL_CBIO_ERR_CONN_CLOSE, #WOLFSSL_CBIO_ERR_WANT_WRITE.
  */
@@ -73,15 +120,83 @@ static TlsTransportStatus_t loadCredentials(NetworkContext_t *pNetCtx,
 
 // IMPLEMENTATIONS
 
+// Sends everything staged, true once it is all out
+static bool tlsFlushSends(NetworkContext_t *NetworkContext)
+{
+	SSLContext_t *sslContext = &NetworkContext->sslContext;
+	uint16_t sent = 0;
+
+	while (sent < sslContext->sendStagingLength)
+	{
+		uint16_t SentDataSize = 0;
+
+		WIFI_Status_t ret = WIFI_SendData(NetworkContext->socket,
+				&sslContext->sendStaging[sent],
+				sslContext->sendStagingLength - sent, &SentDataSize,
+				WIFI_SEND_TIMEOUT);
+		sslContext->handshakeSends++;
+
+		if (ret != WIFI_STATUS_OK || SentDataSize == 0)
+		{
+			sslContext->sendStagingLength = 0;
+			return false;
+		}
+		sent += SentDataSize;
+	}
+	sslContext->sendStagingLength = 0;
+
+	return true;
+}
+
+/*
+ * wolfSSL writes each handshake message of a flight on its own. Until the
+ * handshake is done they are staged and leave together when wolfSSL next
+ * reads, when the staging buffer is full or from the flush after connect.
+ * Application data is never held back.
+ */
 static int wolfSSL_IOSendGlue(WOLFSSL *ssl, char *buf, int sz, void *context)
 {
-	(void) ssl; /* to prevent unused warning*/
+	NetworkContext_t *NetworkContext = (NetworkContext_t*) context;
+	SSLContext_t *sslContext = &NetworkContext->sslContext;
+
+	if (!wolfSSL_is_init_finished(ssl))
+	{
+		sslContext->handshakeWrites++;
 
-	uint32_t socket = *((uint32_t*) context);
+		if (sz > (int) sizeof(sslContext->sendStaging)
+						- sslContext->sendStagingLength
+				&& !tlsFlushSends(NetworkContext))
+		{
+			return WOLFSSL_CBIO_ERR_GENERAL;
+		}
+
+		if (sz <= (int) sizeof(sslContext->sendStaging))
+		{
+			memcpy(&sslContext->sendStaging[sslContext->sendStagingLength],
+					buf, (size_t) sz);
+			sslContext->sendStagingLength += (uint16_t) sz;
+			return sz;
+		}
+	}
+	// keeps the records in order
+	else if (!tlsFlushSends(NetworkContext))
+	{
+		return WOLFSSL_CBIO_ERR_GENERAL;
+	}
+
+	uint32_t socket = NetworkContext->socket;
 	uint16_t SentDataSize = 0;
 
 	WIFI_Status_t ret = WIFI_SendData(socket, (const uint8_t*) buf,
 			(uint16_t) sz, &SentDataSize, WIFI_SEND_TIMEOUT);
+	if (!wolfSSL_is_init_finished(ssl))
+	{
+		sslContext->handshakeSends++;
+	}
+	else
+	{
+		sslContext->appSends++;
+	}
 
 	if (ret != WIFI_STATUS_OK)
 	{
@@ -94,14 +209,19 @@ static int wolfSSL_IORecvGlue(WOLFSSL *ssl, char *buf, int sz, void *context)
 {
 	(void) ssl; /* to prevent unused warning*/
 
-	uint32_t socket = *((uint32_t*) context);
+	NetworkContext_t *NetworkContext = (NetworkContext_t*) context;
 	uint16_t ReceivedDataSize = 0;
 
-	WIFI_Status_t ret = WIFI_ReceiveData(socket, (uint8_t*) buf, (uint16_t) sz,
-			&ReceivedDataSize, WIFI_RECV_TIMEOUT);
+	// the server answers a flight once it has all of it
+	if (!tlsFlushSends(NetworkContext))
+	{
+		return WOLFSSL_CBIO_ERR_GENERAL;
+	}
 
-	printf("wolfssl_IORecv: Req: %d bytes, Recved: %u bytes, ret = %d\r\n", sz,
-			ReceivedDataSize, ret);
+	// the record header and body usually come out of one module receive
+	WIFI_Status_t ret = ReadAhead_Receive(&NetworkContext->readAhead,
+			NetworkContext->socket, (uint8_t*) buf, (uint16_t) sz,
+			&ReceivedDataSize, WIFI_RECV_TIMEOUT);
 
 	if (ret != WIFI_STATUS_OK)
 	{
@@ -124,6 +244,81 @@ static int wolfSSL_IORecvGlue(WOLFSSL *ssl, char *buf, int sz, void *context)
 	return (int) ReceivedDataSize;
 }
 
+int32_t TLSHandshakePrefetch(NetworkContext_t *NetworkContext)
+{
+	return ReadAhead_Fill(&NetworkContext->readAhead, NetworkContext->socket);
+}
+
+#if TLS_TRANSPORT_USE_STSAFEA
+static void tlsLogHandshakeTiming(uint32_t handshakeMs)
+{
+	PkCallStats_t pkStats;
+	stsafe_GetPkCallStats(&pkStats);
+
+	LogInfo(
+			( "TLS handshake took %lu ms, STSAFE busy %lu ms over %lu calls: %lu ms reading ahead (%lu bytes), %lu ms blocked with the CPU free for other tasks", handshakeMs, pkStats.chipMs, pkStats.calls, pkStats.overlappedMs, pkStats.prefetchedBytes, pkStats.blockedMs ));
+}
+#endif
+
+// A free block count that keeps growing across reconnects means fragmentation
+static void tlsLogHeap(void)
+{
+	HeapStats_t heapStats;
+	vPortGetHeapStats(&heapStats);
+
+	LogInfo(
+			( "Heap after TLS disconnect: %u bytes free in %u blocks, largest %u bytes", heapStats.xAvailableHeapSpaceInBytes, heapStats.xNumberOfFreeBlocks, heapStats.xSizeOfLargestFreeBlockInBytes ));
+}
+
+static void tlsLogWrites(const SSLContext_t *sslContext)
+{
+	if (sslContext->appWrites == 0)
+	{
+		return;
+	}
+
+	LogInfo(
+			( "Application data: %lu writes of %lu bytes in %lu records, %lu ms writing", sslContext->appWrites, sslContext->appBytes, sslContext->appSends, sslContext->appWriteMs ));
+}
+
+// A module receive is one to four AT commands, the reads it saved are free
+static void tlsLogReadAhead(void)
+{
+	ReadAheadStats_t readAheadStats;
+	ReadAhead_GetStats(&readAheadStats);
+
+	LogInfo(
+			( "Read-ahead: %lu reads, %lu from memory, %lu module receives for %lu bytes, %lu AT commands in total, %lu socket setters skipped", readAheadStats.reads, readAheadStats.readsFromMemory, readAheadStats.moduleReceives, readAheadStats.bytesReceived, WIFI_GetCommandCount(), WIFI_GetSkippedCommandCount() ));
+}
+
+// Bytes per ms of transfer are kB/s, the CPU is busy for the part of the
+// transfers the task did not sleep through
+static void tlsLogSpi(void)
+{
+	SPI_WIFI_Stats_t spiStats;
+	SPI_WIFI_GetStats(&spiStats);
+
+	uint32_t transferUs = spiStats.RxUs + spiStats.TxUs;
+	if (transferUs == 0)
+	{
+		return;
+	}
+
+	LogInfo(
+			( "ES-WiFi SPI: %lu receives of %lu bytes at %lu kB/s, %lu sends of %lu bytes at %lu kB/s, %lu by DMA, CPU busy %lu%% of the transfers, %lu of %lu ms waiting for the module asleep", spiStats.RxTransfers, spiStats.RxBytes, spiStats.RxUs ? (uint32_t) ((uint64_t) spiStats.RxBytes * 1000U / spiStats.RxUs) : 0U, spiStats.TxTransfers, spiStats.TxBytes, spiStats.TxUs ? (uint32_t) ((uint64_t) spiStats.TxBytes * 1000U / spiStats.TxUs) : 0U, spiStats.DmaTransfers, (uint32_t) ((uint64_t) (transferUs - spiStats.BlockedUs) * 100U / transferUs), spiStats.ReadyBlockedMs, spiStats.ReadyWaitMs ));
+}
+
+// Sockets still held are the other connections sharing the module
+static void tlsLogSockets(void)
+{
+	SocketPoolStats_t socketStats;
+	SocketPool_GetStats(&socketStats);
+
+	LogInfo(
+			( "Sockets: %lu allocations, %lu in use, peak %lu of %u, %lu found none free", socketStats.allocations, socketStats.inUse, socketStats.peakInUse, SOCKET_POOL_SIZE, socketStats.exhausted ));
+	SocketPool_LogUsage();
+}
+
 static TlsTransportStatus_t loadCredentials(NetworkContext_t *pNetCtx,
 		const NetworkCredentials_t *pNetCred)
 {
@@ -137,9 +332,11 @@ static TlsTransportStatus_t loadCredentials(NetworkContext_t *pNetCtx,
 			SSL_FILETYPE_PEM) == SSL_SUCCESS)
 	{
 #if TLS_TRANSPORT_USE_STSAFEA
-		if (wolfSSL_CTX_use_certificate_chain_buffer(pNetCtx->sslContext.ctx,
-				(const byte*) (pNetCred->pClientCert),
-				(long) (pNetCred->clientCertSize)) == SSL_SUCCESS)
+		/* the stsafe-a chain is kept as DER by stsafea_load_client_cert */
+		if (wolfSSL_CTX_use_certificate_chain_buffer_format(
+				pNetCtx->sslContext.ctx, (const byte*) (pNetCred->pClientCert),
+				(long) (pNetCred->clientCertSize),
+				SSL_FILETYPE_ASN1) == SSL_SUCCESS)
 #else
 		if (wolfSSL_CTX_use_certificate_buffer(pNetCtx->sslContext.ctx,
 				(const byte*) (pNetCred->pClientCert),
@@ -179,103 +376,341 @@ static TlsTransportStatus_t loadCredentials(NetworkContext_t *pNetCtx,
 	return returnStatus;
 }
 
+#if TLS_MAX_FRAGMENT_LENGTH
+/*
+ * Asks for TLS_MAX_FRAGMENT_LENGTH byte records. wolfSSL holds the records to
+ * it both ways once the server echoes the extension (RFC 6066), a server that
+ * leaves it out keeps full size records.
+ */
+static void tlsLimitFragment(WOLFSSL *pSsl)
+{
+	wolfSSL_UseMaxFragment(pSsl, TLS_MFL_CODE);
+}
+
+static void tlsLogMaxFragment(WOLFSSL *pSsl)
+{
+	if (pSsl->session != NULL && pSsl->session->mfl == TLS_MFL_CODE)
+	{
+		LogInfo(( "Server accepted %u byte records", TLS_MAX_FRAGMENT_LENGTH ));
+	}
+	else
+	{
+		LogInfo(
+				( "Server did not confirm %u byte records, it may send 16 KB ones", TLS_MAX_FRAGMENT_LENGTH ));
+	}
+}
+#endif
+
+// false when the connection must not be used
+static bool tlsHandshakeDone(NetworkContext_t *pNetCtx)
+{
+#if TLS_TRANSPORT_USE_PINNING
+	if (!TLSPin_Update(pNetCtx->sslContext.ssl, &pNetCtx->sslContext.pinCheck))
+	{
+		return false;
+	}
+#endif
+
+	uint32_t handshakeMs = HAL_GetTick() - pNetCtx->sslContext.handshakeStart;
+#if TLS_TRANSPORT_USE_STSAFEA
+	/* no handshake leaves its key share behind, used or not */
+	stsafe_EphemeralKeyAbandon();
+	tlsLogHandshakeTiming(handshakeMs);
+#endif
+	LogInfo(
+			( "TLS handshake used %lu AT commands, %u records written in %u sends", WIFI_GetCommandCount() - pNetCtx->sslContext.handshakeCommands, pNetCtx->sslContext.handshakeWrites, pNetCtx->sslContext.handshakeSends ));
+#if TLS_MAX_FRAGMENT_LENGTH
+	tlsLogMaxFragment(pNetCtx->sslContext.ssl);
+#endif
+	TLSSession_Update(pNetCtx->sslContext.ssl, handshakeMs);
+
+	return true;
+}
+
+static void tlsHandshakeFailed(NetworkContext_t *pNetCtx)
+{
+	/* let the alert reach the server */
+	tlsFlushSends(pNetCtx);
+
+#if TLS_TRANSPORT_USE_STSAFEA
+	/* a key share left in the slot would block its pre-generation */
+	stsafe_EphemeralKeyAbandon();
+#endif
+
+	/*
+	 * A resumption the server failed must not be offered again. The session is
+	 * only at fault when the handshake was still resuming: a server that turns
+	 * it down goes on with a full handshake, whose failures, a certificate or
+	 * pin mismatch among them, say nothing about the session, and neither does
+	 * a lost link or a failure after wolfSSL_connect.
+	 */
+	int error = wolfSSL_get_error(pNetCtx->sslContext.ssl, 0);
+	if (pNetCtx->sslContext.resumptionOffered
+			&& wolfSSL_session_reused(pNetCtx->sslContext.ssl)
+			&& error != SOCKET_ERROR_E && error != 0)
+	{
+		LogError(( "Resumption failed with %d, dropping the stored session", error ));
+		TLSSession_Forget();
+	}
+
+#if TLS_MAX_FRAGMENT_LENGTH
+	/* the buckets hold records of TLS_MAX_FRAGMENT_LENGTH, not 16 KB */
+	if (error == MEMORY_E
+			&& pNetCtx->sslContext.ssl->max_fragment > TLS_MAX_FRAGMENT_LENGTH)
+	{
+		LogError(
+				( "Out of TLS memory, the server ignored max_fragment_length and may send 16 KB records. Set TLS_MAX_FRAGMENT_LENGTH to 0 for it." ));
+	}
+#endif
+
+	LogError(( "Failed to establish a TLS connection" ));
+}
+
+/*
+ * Ends a handshake left open by tlsSetup. The bytes held back go out as early
+ * data in the ClientHello flight when the ticket allows that many, then the
+ * handshake completes; bytes the server did not take, or that were not sent
+ * early, follow as ordinary application data.
+ */
+static bool tlsFinishEarlyData(NetworkContext_t *pNetCtx)
+{
+	SSLContext_t *sslContext = &pNetCtx->sslContext;
+	WOLFSSL *pSsl = sslContext->ssl;
+	int earlySent = 0;
+
+	sslContext->earlyDataPending = false;
+
+	if (sslContext->earlyDataLength > 0
+			&& sslContext->earlyDataLength <= TLSSession_EarlyDataLimit(pSsl))
+	{
+		if (wolfSSL_write_early_data(pSsl, sslContext->earlyData,
+				sslContext->earlyDataLength, &earlySent) < 0)
+		{
+			tlsHandshakeFailed(pNetCtx);
+			return false;
+		}
+	}
+
+	if (wolfSSL_connect(pSsl) != SSL_SUCCESS)
+	{
+		tlsHandshakeFailed(pNetCtx);
+		return false;
+	}
+	/* the last flight is not followed by a read */
+	if (!tlsFlushSends(pNetCtx))
+	{
+		LogError(( "Failed to send the last handshake flight" ));
+		return false;
+	}
+	if (!tlsHandshakeDone(pNetCtx))
+	{
+		LogError(( "Failed to establish a TLS connection" ));
+		return false;
+	}
+
+	bool accepted = earlySent > 0
+			&& wolfSSL_get_early_data_status(pSsl) == WOLFSSL_EARLY_DATA_ACCEPTED;
+	LogInfo(
+			( "0-RTT: %u bytes held back, %d sent early, %s", sslContext->earlyDataLength, earlySent, accepted ? "accepted" : "not accepted" ));
+
+	if (!accepted && sslContext->earlyDataLength > 0
+			&& wolfSSL_write(pSsl, sslContext->earlyData,
+					sslContext->earlyDataLength)
+					!= sslContext->earlyDataLength)
+	{
+		LogError(( "Failed to send the data held back for 0-RTT" ));
+		return false;
+	}
+	sslContext->earlyDataLength = 0;
+
+	return true;
+}
+
+/*
+ * Builds the context shared by every connection on first use: the trust store
+ * is PEM-decoded, the client chain parsed and the PK callbacks registered
+ * once. Later calls only hand it out; the credentials passed then are not
+ * looked at again.
+ */
+static TlsTransportStatus_t tlsAcquireContext(NetworkContext_t *pNetCtx,
+		const NetworkCredentials_t *pNetCred)
+{
+	if (shared_ctx == NULL)
+	{
+		uint32_t buildStart = HAL_GetTick();
+
+		/* connections allocate from the heap of their context */
+		WOLFSSL_HEAP_HINT *heap = TLSMemory_SessionHeap();
+		if (heap == NULL)
+		{
+			LogError(( "TLS memory pools are not set up" ));
+			return TLS_TRANSPORT_INSUFFICIENT_MEMORY;
+		}
+
+		/* Attempt to create a context that uses the TLS 1.3 or 1.2 */
+
+		WOLFSSL_METHOD *method = 0;
+#if TLS_TRANSPORT_USE_TLS13
+		/* the highest version wolfSSL has, down to TLS 1.2 */
+		method = wolfSSLv23_client_method_ex(heap);
+#else
+		method = wolfTLSv1_2_client_method_ex(heap);
+#endif
+
+		pNetCtx->sslContext.ctx = wolfSSL_CTX_new_ex(method, heap);
+		if (pNetCtx->sslContext.ctx == NULL)
+		{
+			LogError(( "Failed to create a wolfSSL_CTX" ));
+			return TLS_TRANSPORT_CONNECT_FAILURE;
+		}
+
+		/* load credentials from file */
+		if (loadCredentials(pNetCtx, pNetCred) != TLS_TRANSPORT_SUCCESS)
+		{
+			wolfSSL_CTX_free(pNetCtx->sslContext.ctx);
+			pNetCtx->sslContext.ctx = NULL;
+
+			LogError(( "Failed to load credentials" ));
+			return TLS_TRANSPORT_INVALID_CREDENTIALS;
+		}
+
+#if TLS_TRANSPORT_USE_TLS13
+		/* the STSAFE only does P-256, offering nothing else avoids a retry */
+		wolfSSL_CTX_UseSupportedCurve(pNetCtx->sslContext.ctx,
+				WOLFSSL_ECC_SECP256R1);
+#endif
+		TLSSession_SetupContext(pNetCtx->sslContext.ctx);
+
+		shared_ctx = pNetCtx->sslContext.ctx;
+		LogInfo(
+				( "TLS context built in %lu ms", HAL_GetTick() - buildStart ));
+	}
+
+	pNetCtx->sslContext.ctx = shared_ctx;
+
+	return TLS_TRANSPORT_SUCCESS;
+}
+
 static TlsTransportStatus_t tlsSetup(NetworkContext_t *pNetCtx,
 		const char *pHostName, const NetworkCredentials_t *pNetCred)
 {
 	TlsTransportStatus_t returnStatus = TLS_TRANSPORT_SUCCESS;
 
-	uint32_t *xSocket = NULL;
-
 	configASSERT(pNetCtx != NULL);
 	//configASSERT(pNetCtx->isSSL == true)
 	configASSERT(pHostName != NULL);
 	configASSERT(pNetCred != NULL);
 	configASSERT(pNetCred->pRootCa != NULL);
 
-	if (pNetCtx->sslContext.ctx == NULL)
-	{
-		/* Attempt to create a context that uses the TLS 1.3 or 1.2 */
-
-		WOLFSSL_METHOD *method = 0;
-		method = wolfSSLv23_client_method_ex( NULL);
-
-		pNetCtx->sslContext.ctx = wolfSSL_CTX_new(method);
-	}
+	returnStatus = tlsAcquireContext(pNetCtx, pNetCred);
 
-	if (pNetCtx->sslContext.ctx != NULL)
+	if (returnStatus == TLS_TRANSPORT_SUCCESS)
 	{
-		/* load credentials from file */
-		if (loadCredentials(pNetCtx, pNetCred) == TLS_TRANSPORT_SUCCESS)
+		/* create a ssl object, the only allocation left on a reconnect */
+		pNetCtx->sslContext.ssl = wolfSSL_new(pNetCtx->sslContext.ctx);
+
+		if (pNetCtx->sslContext.ssl != NULL)
 		{
-			/* create a ssl object */
-			pNetCtx->sslContext.ssl = wolfSSL_new(pNetCtx->sslContext.ctx);
+			pNetCtx->sslContext.earlyDataPending = false;
+			pNetCtx->sslContext.earlyDataLength = 0;
+			pNetCtx->sslContext.sendStagingLength = 0;
+			pNetCtx->sslContext.handshakeWrites = 0;
+			pNetCtx->sslContext.handshakeSends = 0;
+			pNetCtx->sslContext.appWrites = 0;
+			pNetCtx->sslContext.appBytes = 0;
+			pNetCtx->sslContext.appWriteMs = 0;
+			pNetCtx->sslContext.appSends = 0;
+
+			/* set Recv/Send glue functions to the WOLFSSL object */
+			wolfSSL_SSLSetIORecv(pNetCtx->sslContext.ssl, wolfSSL_IORecvGlue);
+			wolfSSL_SSLSetIOSend(pNetCtx->sslContext.ssl, wolfSSL_IOSendGlue);
+
+			/* set the network context as a context of read/send glue funcs */
+			wolfSSL_SetIOReadCtx(pNetCtx->sslContext.ssl, pNetCtx);
+			wolfSSL_SetIOWriteCtx(pNetCtx->sslContext.ssl, pNetCtx);
 
-			if (pNetCtx->sslContext.ssl != NULL)
-			{
-				xSocket = &(pNetCtx->socket);
+#if TLS_TRANSPORT_USE_STSAFEA
+			stsafe_SetupPkCallbacksContext(pNetCtx);
+			stsafe_ResetPkCallStats();
+#endif
 
-				/* set Recv/Send glue functions to the WOLFSSL object */
-				wolfSSL_SSLSetIORecv(pNetCtx->sslContext.ssl,
-						wolfSSL_IORecvGlue);
-				wolfSSL_SSLSetIOSend(pNetCtx->sslContext.ssl,
-						wolfSSL_IOSendGlue);
+#if TLS_TRANSPORT_USE_TLS13
+			/* one P-256 share, its key made by the STSAFE right away */
+			wolfSSL_UseKeyShare(pNetCtx->sslContext.ssl, WOLFSSL_ECC_SECP256R1);
+			/* resumptions run an ECDHE too: forward secrecy, and the key
+			 * share is always consumed by the SharedSecretCb */
+			wolfSSL_only_dhe_psk(pNetCtx->sslContext.ssl);
+#endif
 
-				/* set socket as a context of read/send glue funcs */
-				wolfSSL_SetIOReadCtx(pNetCtx->sslContext.ssl, xSocket);
-				wolfSSL_SetIOWriteCtx(pNetCtx->sslContext.ssl, xSocket);
+#if TLS_MAX_FRAGMENT_LENGTH
+			/* records that fit one AT send */
+			tlsLimitFragment(pNetCtx->sslContext.ssl);
+#endif
 
-#if TLS_TRANSPORT_USE_STSAFEA
-				stsafe_SetupPkCallbacksContext(pNetCtx);
+#if TLS_TRANSPORT_USE_PINNING
+			TLSPin_Apply(pNetCtx->sslContext.ssl, pHostName,
+					&pNetCtx->sslContext.pinCheck);
+#endif
+
+			/* offer the session kept from an earlier connection or boot */
+			bool resuming = TLSSession_Apply(pNetCtx->sslContext.ssl);
+			pNetCtx->sslContext.resumptionOffered = resuming;
+#if TLS_MAX_FRAGMENT_LENGTH
+			/* the server's answer sets it again, see tlsLogMaxFragment */
+			if (pNetCtx->sslContext.ssl->session != NULL)
+			{
+				pNetCtx->sslContext.ssl->session->mfl = WOLFSSL_MFL_DISABLED;
+			}
 #endif
+			pNetCtx->sslContext.handshakeStart = HAL_GetTick();
+			pNetCtx->sslContext.handshakeCommands = WIFI_GetCommandCount();
 
-				/* let wolfSSL perform tls handshake */
-				if (wolfSSL_connect(pNetCtx->sslContext.ssl) == SSL_SUCCESS)
-				{
-					returnStatus = TLS_TRANSPORT_SUCCESS;
-				}
-				else
-				{
-					wolfSSL_shutdown(pNetCtx->sslContext.ssl);
-					wolfSSL_free(pNetCtx->sslContext.ssl);
-					pNetCtx->sslContext.ssl = NULL;
-					wolfSSL_CTX_free(pNetCtx->sslContext.ctx);
-					pNetCtx->sslContext.ctx = NULL;
-
-					LogError(( "Failed to establish a TLS connection" ));
-					returnStatus = TLS_TRANSPORT_HANDSHAKE_FAILED;
-				}
+			if (resuming
+					&& TLSSession_EarlyDataLimit(pNetCtx->sslContext.ssl) > 0)
+			{
+				/* the handshake goes out with the MQTT CONNECT, see TLSSend */
+				pNetCtx->sslContext.earlyDataPending = true;
+				returnStatus = TLS_TRANSPORT_SUCCESS;
+			}
+			/* let wolfSSL perform tls handshake */
+			else if (wolfSSL_connect(pNetCtx->sslContext.ssl) == SSL_SUCCESS
+					&& tlsFlushSends(pNetCtx) && tlsHandshakeDone(pNetCtx))
+			{
+				returnStatus = TLS_TRANSPORT_SUCCESS;
 			}
 			else
 			{
-				wolfSSL_CTX_free(pNetCtx->sslContext.ctx);
-				pNetCtx->sslContext.ctx = NULL;
+				tlsHandshakeFailed(pNetCtx);
+				wolfSSL_shutdown(pNetCtx->sslContext.ssl);
+				wolfSSL_free(pNetCtx->sslContext.ssl);
+				pNetCtx->sslContext.ssl = NULL;
 
-				LogError(( "Failed to create wolfSSL object" ));
-				returnStatus = TLS_TRANSPORT_INTERNAL_ERROR;
+				returnStatus = TLS_TRANSPORT_HANDSHAKE_FAILED;
 			}
 		}
 		else
 		{
-			wolfSSL_CTX_free(pNetCtx->sslContext.ctx);
-			pNetCtx->sslContext.ctx = NULL;
-
-			LogError(( "Failed to load credentials" ));
-			returnStatus = TLS_TRANSPORT_INVALID_CREDENTIALS;
+			LogError(( "Failed to create wolfSSL object" ));
+			returnStatus = TLS_TRANSPORT_INTERNAL_ERROR;
 		}
 	}
-	else
-	{
-		LogError(( "Failed to create a wolfSSL_CTX" ));
-		returnStatus = TLS_TRANSPORT_CONNECT_FAILURE;
-	}
 
 	return returnStatus;
 }
 
 static TlsTransportStatus_t initTLS(void)
 {
-	/* initialize wolfSSL */
-	wolfSSL_Init();
+	if (tls_initialized)
+	{
+		return TLS_TRANSPORT_SUCCESS;
+	}
+
+	/* initialize wolfSSL, once, it stays up across reconnects */
+	if (wolfSSL_Init() != WOLFSSL_SUCCESS)
+	{
+		return TLS_TRANSPORT_INTERNAL_ERROR;
+	}
+	tls_initialized = true;
 
 #ifdef DEBUG_WOLFSSL
 	wolfSSL_Debugging_ON();
@@ -287,8 +722,14 @@ static TlsTransportStatus_t initTLS(void)
 bool InitSSLContext(NetworkContext_t *NetworkContext)
 {
 #if TLS_TRANSPORT_USE_STSAFEA
-	return stsafea_init(&(NetworkContext->sslContext.stsafea_handle),
-			NetworkContext->sslContext.a_rx_tx_stsafea_data);
+	// the chip is owned and initialized by the STSAFE task
+	if (!stsafe_ServiceWaitReady(STSAFE_SERVICE_READY_TIMEOUT_MS))
+	{
+		return false;
+	}
+	// runs here for the stack, the host verify is too deep for the STSAFE task
+	stsafe_DispatchCalibrate();
+	return true;
 #endif
 	return true;
 }
@@ -299,7 +740,7 @@ void InitTLSTransport(NetworkContext_t *NetworkContext,
 	Transport->send = TLSSend;
 	Transport->recv = TLSRecv;
 	Transport->pNetworkContext = NetworkContext;
-	Transport->writev = NULL;
+	Transport->writev = TLSWritev;
 }
 
 TlsTransportStatus_t TLSWiFiConnect(NetworkContext_t *NetworkContext,
@@ -332,6 +773,26 @@ TlsTransportStatus_t TLSWiFiConnect(NetworkContext_t *NetworkContext,
 		returnStatus = tlsSetup(NetworkContext, HostName, NetworkCredentials);
 	}
 
+#if TLS_TRANSPORT_USE_PINNING
+	/* The broker presented another key than the pinned one, the alert ended
+	 * the connection. The pin is gone, the second handshake validates the
+	 * chain in full. */
+	if (returnStatus == TLS_TRANSPORT_HANDSHAKE_FAILED
+			&& NetworkContext->sslContext.pinCheck.mismatched)
+	{
+		LogInfo(( "Reconnecting to validate the server's new key" ));
+		TLSPin_Forget();
+		PlaintextWifiDisconnect(NetworkContext);
+
+		if (!PlaintextWiFiConnect(NetworkContext, ipaddr, port))
+		{
+			LogError(("Failed to open TCP connection to server"));
+			return TLS_TRANSPORT_CONNECT_FAILURE;
+		}
+		returnStatus = tlsSetup(NetworkContext, HostName, NetworkCredentials);
+	}
+#endif
+
 	/* Clean up on failure. */
 	if (returnStatus != TLS_TRANSPORT_SUCCESS)
 	{
@@ -353,11 +814,13 @@ TlsTransportStatus_t TLSWiFiConnect(NetworkContext_t *NetworkContext,
 void TLSWiFiDisconnect(NetworkContext_t *NetworkContext)
 {
 	WOLFSSL *pSsl = NetworkContext->sslContext.ssl;
-	WOLFSSL_CTX *pCtx = NULL;
 
 	/* shutdown an active TLS connection */
 	wolfSSL_shutdown(pSsl);
 
+	TLSMemory_LogConnection(pSsl);
+	tlsLogWrites(&NetworkContext->sslContext);
+
 	/* cleanup WOLFSSL object */
 	wolfSSL_free(pSsl);
 	NetworkContext->sslContext.ssl = NULL;
@@ -365,14 +828,14 @@ void TLSWiFiDisconnect(NetworkContext_t *NetworkContext)
 	/* Call socket shutdown function to close connection. */
 	PlaintextWifiDisconnect(NetworkContext);
 
-	/* free WOLFSSL_CTX object*/
-	pCtx = NetworkContext->sslContext.ctx;
-
-	wolfSSL_CTX_free(pCtx);
+	/* the WOLFSSL_CTX is kept for the next connection */
 	NetworkContext->sslContext.ctx = NULL;
 
-	wolfSSL_Cleanup();
-
+	tlsLogHeap();
+	TLSMemory_LogUsage();
+	tlsLogReadAhead();
+	tlsLogSpi();
+	tlsLogSockets();
 }
 
 int32_t TLSSend(NetworkContext_t *NetworkContext, const void *Buffer,
@@ -398,14 +861,36 @@ int32_t TLSSend(NetworkContext_t *NetworkContext, const void *Buffer,
 		LogError(( "TLSSend: invalid input, bytesToSend == 0" ));
 		tlsStatus = -1;
 	}
+	else if (NetworkContext->sslContext.earlyDataPending
+			&& bytesToSend
+					<= sizeof(NetworkContext->sslContext.earlyData)
+							- NetworkContext->sslContext.earlyDataLength)
+	{
+		/* coreMQTT sends a packet in pieces, collect them until the first read */
+		SSLContext_t *sslContext = &NetworkContext->sslContext;
+		memcpy(&sslContext->earlyData[sslContext->earlyDataLength], Buffer,
+				bytesToSend);
+		sslContext->earlyDataLength += (uint16_t) bytesToSend;
+		tlsStatus = (int32_t) bytesToSend;
+	}
+	else if (NetworkContext->sslContext.earlyDataPending
+			&& !tlsFinishEarlyData(NetworkContext))
+	{
+		tlsStatus = -1;
+	}
 	else
 	{
-		pSsl = NetworkContext->sslContext.ssl;
+		SSLContext_t *sslContext = &NetworkContext->sslContext;
+		pSsl = sslContext->ssl;
 
+		uint32_t writeStart = HAL_GetTick();
 		iResult = wolfSSL_write(pSsl, Buffer, bytesToSend);
+		sslContext->appWriteMs += HAL_GetTick() - writeStart;
 
 		if (iResult > 0)
 		{
+			sslContext->appWrites++;
+			sslContext->appBytes += (uint32_t) iResult;
 			tlsStatus = iResult;
 		}
 		else if (wolfSSL_want_write(pSsl) == 1)
@@ -446,6 +931,11 @@ int32_t TLSRecv(NetworkContext_t *NetworkContext, void *Buffer,
 		LogError(( "TLSRecv: invalid input, bytesToRecv == 0" ));
 		tlsStatus = -1;
 	}
+	else if (NetworkContext->sslContext.earlyDataPending
+			&& !tlsFinishEarlyData(NetworkContext))
+	{
+		tlsStatus = -1;
+	}
 	else
 	{
 		pSsl = NetworkContext->sslContext.ssl;
@@ -471,6 +961,36 @@ int32_t TLSRecv(NetworkContext_t *NetworkContext, void *Buffer,
 	return tlsStatus;
 }
 
+/*
+ * The pieces of an MQTT packet go out as one record, one MAC and one AT send,
+ * instead of one of each per piece as with TLSSend.
+ */
+int32_t TLSWritev(NetworkContext_t *NetworkContext,
+		TransportOutVector_t *pIoVec, size_t ioVecCount)
+{
+	if (NetworkContext == NULL || pIoVec == NULL || ioVecCount == 0)
+	{
+		LogError(( "TLSWritev: invalid input, NetworkContext=%p", NetworkContext ));
+		return -1;
+	}
+
+	if (ioVecCount == 1)
+	{
+		return TLSSend(NetworkContext, pIoVec[0].iov_base, pIoVec[0].iov_len);
+	}
+
+	size_t length = WritevGather(NetworkContext, pIoVec, ioVecCount);
+#if TLS_MAX_FRAGMENT_LENGTH
+	// One record, coreMQTT sends the rest of a larger packet
+	if (length > TLS_MAX_FRAGMENT_LENGTH)
+	{
+		length = TLS_MAX_FRAGMENT_LENGTH;
+	}
+#endif
+
+	return TLSSend(NetworkContext, NetworkContext->writevBuffer, length);
+}
+
 bool LoadTLSCredentials(NetworkCredentials_t *NetworkCredentials,
 		NetworkContext_t *NetworkContext)
 {
@@ -478,8 +998,7 @@ bool LoadTLSCredentials(NetworkCredentials_t *NetworkCredentials,
 	NetworkCredentials->rootCaSize = strlen( ROOT_CA_PEM);
 
 #if TLS_TRANSPORT_USE_STSAFEA
-	return stsafea_load_client_cert(&NetworkContext->sslContext.stsafea_handle,
-			NetworkCredentials);
+	return stsafea_load_client_cert(NetworkCredentials);
 #else
 	NetworkCredentials->pClientCert =
 			(const unsigned char*) CLIENT_CERTIFICATE_PEM;
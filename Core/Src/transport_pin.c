@@ -0,0 +1,266 @@
+#include "transport_pin.h"
+
+#include <stdio.h>
+#include <string.h>
+
+#include "main.h"
+
+#include "FreeRTOS.h"
+#include "semphr.h"
+
+#include "wolfssl/wolfcrypt/asn.h"
+
+#include "stsafe_interface.h"
+
+typedef struct
+{
+	bool valid;
+	uint32_t pinnedAt; // HAL_GetTick
+	uint8_t hostHash[WC_SHA256_DIGEST_SIZE];
+	uint8_t keyHash[WC_SHA256_DIGEST_SIZE];
+	uint8_t chainHash[WC_SHA256_DIGEST_SIZE];
+	// what validating the chain took, saved by every pinned handshake
+	uint32_t chainVerifies;
+	uint32_t chainVerifyMs;
+} ServerPin_t;
+
+// Connections from the socket pool handshake in parallel, the pin and the
+// stats are only used with pin_mutex held
+static ServerPin_t server_pin;
+static TLSPinStats_t pin_stats;
+static StaticSemaphore_t pin_mutex_buffer;
+static SemaphoreHandle_t pin_mutex = NULL;
+
+static void pin_Lock(void)
+{
+	taskENTER_CRITICAL();
+	if (pin_mutex == NULL)
+	{
+		pin_mutex = xSemaphoreCreateMutexStatic(&pin_mutex_buffer);
+	}
+	taskEXIT_CRITICAL();
+
+	xSemaphoreTake(pin_mutex, portMAX_DELAY);
+}
+
+static void pin_Unlock(void)
+{
+	xSemaphoreGive(pin_mutex);
+}
+
+static void pin_Clear(void)
+{
+	memset(&server_pin, 0, sizeof(server_pin));
+}
+
+// Peer signatures verified so far, on the host or the chip
+static void pin_VerifyWork(uint32_t *verifies, uint32_t *ms)
+{
+	CryptoDispatchStats_t dispatchStats;
+	stsafe_GetDispatchStats(&dispatchStats);
+
+	*verifies = dispatchStats.operations[CRYPTO_OP_VERIFY_HOST].count
+			+ dispatchStats.operations[CRYPTO_OP_VERIFY_STSAFE].count;
+	*ms = dispatchStats.operations[CRYPTO_OP_VERIFY_HOST].totalMs
+			+ dispatchStats.operations[CRYPTO_OP_VERIFY_STSAFE].totalMs;
+}
+
+// The leaf is parsed again on its own, wolfSSL's copy is not reachable here
+static bool pin_HashLeafKey(const WOLFSSL_BUFFER_INFO *leaf, uint8_t *hash)
+{
+	DecodedCert *cert = (DecodedCert*) XMALLOC(sizeof(DecodedCert), NULL,
+			DYNAMIC_TYPE_DCERT);
+	if (cert == NULL)
+	{
+		return false;
+	}
+
+	wc_InitDecodedCert(cert, leaf->buffer, leaf->length, NULL);
+	bool hashed = wc_ParseCert(cert, CERT_TYPE, NO_VERIFY, NULL) == 0
+			&& cert->publicKey != NULL
+			&& wc_Sha256Hash(cert->publicKey, cert->pubKeySize, hash) == 0;
+	wc_FreeDecodedCert(cert);
+	XFREE(cert, NULL, DYNAMIC_TYPE_DCERT);
+
+	return hashed;
+}
+
+static bool pin_HashChain(const WOLFSSL_X509_STORE_CTX *store, uint8_t *hash)
+{
+	wc_Sha256 sha;
+
+	if (wc_InitSha256(&sha) != 0)
+	{
+		return false;
+	}
+
+	bool hashed = true;
+	for (int i = 0; i < store->totalCerts && hashed; i++)
+	{
+		hashed = wc_Sha256Update(&sha, store->certs[i].buffer,
+				store->certs[i].length) == 0;
+	}
+	hashed = hashed && wc_Sha256Final(&sha, hash) == 0;
+	wc_Sha256Free(&sha);
+
+	return hashed;
+}
+
+/*
+ * wolfSSL verify callback, called for the leaf once the chain is done
+ * (WOLFSSL_ALWAYS_VERIFY_CB). Validated is 1 after a full validation, and
+ * always on a pinned connection where nothing was checked.
+ */
+static int pin_VerifyCb(int validated, WOLFSSL_X509_STORE_CTX *store)
+{
+	TLSPinCheck_t *check = (TLSPinCheck_t*) store->userCtx;
+
+	if (!validated || check == NULL || store->error_depth != 0
+			|| store->totalCerts == 0)
+	{
+		return validated;
+	}
+
+	bool hashed = pin_HashLeafKey(&store->certs[0], check->keyHash)
+			&& pin_HashChain(store, check->chainHash);
+
+	if (!check->pinned)
+	{
+		// verifies from here on are the handshake signature's
+		uint32_t verifies, ms;
+		pin_VerifyWork(&verifies, &ms);
+		check->chainVerifies = verifies - check->startVerifies;
+		check->chainVerifyMs = ms - check->startVerifyMs;
+		check->validated = hashed;
+		return validated;
+	}
+
+	pin_Lock();
+
+	if (!hashed
+			|| memcmp(check->keyHash, server_pin.keyHash,
+					sizeof(check->keyHash)) != 0)
+	{
+		pin_stats.keyMismatches++;
+		pin_Clear();
+		pin_Unlock();
+		check->mismatched = true;
+		printf(
+				"TLSPin: the server key does not match the pin, dropped it, the chain is validated again\r\n");
+		return 0;
+	}
+
+	if (memcmp(check->chainHash, server_pin.chainHash,
+			sizeof(check->chainHash)) != 0)
+	{
+		// a renewed certificate for the same key, the key is what is pinned
+		pin_stats.chainChanges++;
+		printf("TLSPin: pinned key in a chain that changed since it was validated\r\n");
+	}
+
+	pin_Unlock();
+
+	check->matched = true;
+	return 1;
+}
+
+void TLSPin_Apply(WOLFSSL *ssl, const char *hostName, TLSPinCheck_t *check)
+{
+	memset(check, 0, sizeof(*check));
+	wc_Sha256Hash((const byte*) hostName, (word32) strlen(hostName),
+			check->hostHash);
+	pin_VerifyWork(&check->startVerifies, &check->startVerifyMs);
+
+	pin_Lock();
+
+	if (server_pin.valid
+			&& HAL_GetTick() - server_pin.pinnedAt >= TLS_PIN_LIFETIME_MS)
+	{
+		pin_stats.expirations++;
+		printf("TLSPin: the pin has expired, validating the chain\r\n");
+		pin_Clear();
+	}
+
+	check->pinned = server_pin.valid
+			&& memcmp(check->hostHash, server_pin.hostHash,
+					sizeof(check->hostHash)) == 0;
+
+	pin_Unlock();
+
+	wolfSSL_SetCertCbCtx(ssl, check);
+	wolfSSL_set_verify(ssl,
+			check->pinned ? WOLFSSL_VERIFY_NONE : WOLFSSL_VERIFY_DEFAULT,
+			pin_VerifyCb);
+}
+
+bool TLSPin_Update(WOLFSSL *ssl, TLSPinCheck_t *check)
+{
+	if (wolfSSL_session_reused(ssl))
+	{
+		// no certificate on a resumption
+		return true;
+	}
+
+	pin_Lock();
+
+	if (check->pinned)
+	{
+		if (!check->matched)
+		{
+			pin_stats.keyMismatches++;
+			pin_Clear();
+			pin_Unlock();
+			check->mismatched = true;
+			printf("TLSPin: pinned handshake without the pinned key, dropped the pin\r\n");
+			return false;
+		}
+
+		pin_stats.pinnedHandshakes++;
+		pin_stats.verifiesAvoided += server_pin.chainVerifies;
+		pin_stats.msSaved += server_pin.chainVerifyMs;
+		printf(
+				"TLSPin: pinned key matched, %lu chain verifies (%lu ms) avoided, %lu verifies and %lu ms over %lu handshakes\r\n",
+				server_pin.chainVerifies, server_pin.chainVerifyMs,
+				pin_stats.verifiesAvoided, pin_stats.msSaved,
+				pin_stats.pinnedHandshakes);
+		pin_Unlock();
+		return true;
+	}
+
+	if (check->validated)
+	{
+		server_pin.valid = true;
+		server_pin.pinnedAt = HAL_GetTick();
+		memcpy(server_pin.hostHash, check->hostHash,
+				sizeof(server_pin.hostHash));
+		memcpy(server_pin.keyHash, check->keyHash, sizeof(server_pin.keyHash));
+		memcpy(server_pin.chainHash, check->chainHash,
+				sizeof(server_pin.chainHash));
+		server_pin.chainVerifies = check->chainVerifies;
+		server_pin.chainVerifyMs = check->chainVerifyMs;
+
+		pin_stats.validations++;
+		printf(
+				"TLSPin: chain validated with %lu verifies in %lu ms, server key pinned for %lu s\r\n",
+				check->chainVerifies, check->chainVerifyMs,
+				TLS_PIN_LIFETIME_MS / 1000U);
+	}
+
+	pin_Unlock();
+
+	return true;
+}
+
+void TLSPin_Forget(void)
+{
+	pin_Lock();
+	pin_Clear();
+	pin_Unlock();
+}
+
+void TLSPin_GetStats(TLSPinStats_t *stats)
+{
+	pin_Lock();
+	*stats = pin_stats;
+	pin_Unlock();
+}
@@ -0,0 +1,120 @@
+#include "transport_readahead.h"
+
+#include <string.h>
+
+#include "es_wifi.h"
+
+#define READAHEAD_MASK (READAHEAD_SIZE - 1U)
+
+_Static_assert((READAHEAD_SIZE & READAHEAD_MASK) == 0,
+		"READAHEAD_SIZE must be a power of two");
+_Static_assert(READAHEAD_SIZE >= ES_WIFI_PAYLOAD_SIZE,
+		"READAHEAD_SIZE must hold a full module receive");
+
+static ReadAheadStats_t readahead_stats;
+
+void ReadAhead_Reset(ReadAhead_t *readAhead)
+{
+	readAhead->read = 0;
+	readAhead->write = 0;
+}
+
+static uint32_t readahead_Level(const ReadAhead_t *readAhead)
+{
+	return readAhead->write - readAhead->read;
+}
+
+static uint16_t readahead_Copy(ReadAhead_t *readAhead, uint8_t *pdata,
+		uint16_t length)
+{
+	uint32_t level = readahead_Level(readAhead);
+	if (length > level)
+	{
+		length = (uint16_t) level;
+	}
+
+	for (uint16_t i = 0; i < length; i++)
+	{
+		pdata[i] = readAhead->buffer[(readAhead->read + i) & READAHEAD_MASK];
+	}
+	readAhead->read += length;
+
+	return length;
+}
+
+// One module receive into the free space up to the end of the buffer
+static WIFI_Status_t readahead_Refill(ReadAhead_t *readAhead, uint32_t socket,
+		uint32_t Timeout)
+{
+	if (readahead_Level(readAhead) == 0)
+	{
+		// start over at the beginning, the whole buffer is one span
+		ReadAhead_Reset(readAhead);
+	}
+
+	uint32_t offset = readAhead->write & READAHEAD_MASK;
+	uint32_t space = READAHEAD_SIZE - readahead_Level(readAhead);
+	if (space > READAHEAD_SIZE - offset)
+	{
+		space = READAHEAD_SIZE - offset;
+	}
+	if (space > ES_WIFI_PAYLOAD_SIZE)
+	{
+		space = ES_WIFI_PAYLOAD_SIZE;
+	}
+	if (space == 0)
+	{
+		return WIFI_STATUS_OK;
+	}
+
+	uint16_t received = 0;
+	WIFI_Status_t ret = WIFI_ReceiveData(socket, &readAhead->buffer[offset],
+			(uint16_t) space, &received, Timeout);
+
+	readahead_stats.moduleReceives++;
+	if (ret == WIFI_STATUS_OK)
+	{
+		readAhead->write += received;
+		readahead_stats.bytesReceived += received;
+	}
+
+	return ret;
+}
+
+WIFI_Status_t ReadAhead_Receive(ReadAhead_t *readAhead, uint32_t socket,
+		uint8_t *pdata, uint16_t Reqlen, uint16_t *RcvDatalen, uint32_t Timeout)
+{
+	readahead_stats.reads++;
+
+	if (readahead_Level(readAhead) > 0)
+	{
+		readahead_stats.readsFromMemory++;
+		*RcvDatalen = readahead_Copy(readAhead, pdata, Reqlen);
+		return WIFI_STATUS_OK;
+	}
+
+	WIFI_Status_t ret = readahead_Refill(readAhead, socket, Timeout);
+
+	// a timeout may still have brought some bytes
+	*RcvDatalen = readahead_Copy(readAhead, pdata, Reqlen);
+
+	return *RcvDatalen > 0 ? WIFI_STATUS_OK : ret;
+}
+
+int32_t ReadAhead_Fill(ReadAhead_t *readAhead, uint32_t socket)
+{
+	uint32_t before = readAhead->write;
+
+	// a zero timeout only polls the module, it does not wait for data
+	if (readahead_Refill(readAhead, socket, 0) != WIFI_STATUS_OK)
+	{
+		return -1;
+	}
+
+	return (int32_t) (readAhead->write - before);
+}
+
+void ReadAhead_GetStats(ReadAheadStats_t *stats)
+{
+	*stats = readahead_stats;
+}
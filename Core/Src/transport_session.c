@@ -0,0 +1,416 @@
+#include "transport_session.h"
+
+#include <stdio.h>
+#include <string.h>
+
+#include "FreeRTOS.h"
+#include "task.h"
+
+// Session fields without an accessor in this configuration
+#include "wolfssl/internal.h"
+#include "wolfssl/wolfcrypt/sha256.h"
+
+#include "stsafe_interface.h"
+
+/*
+ * Last 8 KB of flash, left out of the FLASH region in the linker script. That
+ * is one page in single bank mode and two pages of bank 2 in dual bank mode,
+ * the record sits at the start of either.
+ */
+#define SESSION_RECORD_ADDRESS 0x081FE000U
+#define SESSION_RECORD_MAGIC 0x53455331U // "SES1"
+
+// Plaintext is the 2 byte length of the serialized session, the session and
+// zero padding up to the 8 byte envelope granularity
+#define SESSION_BLOB_HEADER_SIZE 2U
+#define SESSION_BLOB_MAX_SIZE STSAFE_ENVELOPE_MAX_DATA_SIZE
+
+// Least uptime between two writes of a changed record. A TLS 1.3 server sends
+// a new ticket on every connection, the flash copy is only needed after a
+// reboot and an older ticket still resumes until it expires.
+#define SESSION_SAVE_INTERVAL_S (6U * 60U * 60U)
+
+typedef struct
+{
+	uint32_t magic;
+	uint16_t envelopeLength;
+	uint16_t reserved;
+	uint8_t envelope[STSAFE_ENVELOPE_MAX_DATA_SIZE + STSAFE_ENVELOPE_OVERHEAD];
+} SessionRecord_t;
+
+// Programmed in double words
+_Static_assert(sizeof(SessionRecord_t) % sizeof(uint64_t) == 0,
+		"SessionRecord_t must be a multiple of 8 bytes");
+
+static WOLFSSL_SESSION *stored_session = NULL;
+static bool flash_checked = false;
+// Ticket and session ID of the record in flash, see session_Fingerprint
+static uint8_t persisted_fingerprint[WC_SHA256_DIGEST_SIZE];
+static bool persisted_valid = false;
+// Uptime of the last write of this boot
+static bool saved_this_boot = false;
+static uint32_t saved_at = 0;
+
+static TLSSessionStats_t session_stats;
+
+static void session_Wipe(void *buffer, size_t length)
+{
+	volatile uint8_t *bytes = (volatile uint8_t*) buffer;
+
+	for (size_t i = 0; i < length; i++)
+	{
+		bytes[i] = 0;
+	}
+}
+
+// Same clock as wolfSSL's FreeRTOS LowResTimer
+static uint32_t session_Now(void)
+{
+	return xTaskGetTickCount() / configTICK_RATE_HZ;
+}
+
+// What the server resumes from: the session ID and the ticket, if any
+static bool session_Fingerprint(const WOLFSSL_SESSION *session,
+		uint8_t fingerprint[WC_SHA256_DIGEST_SIZE])
+{
+	wc_Sha256 sha;
+
+	if (wc_InitSha256(&sha) != 0)
+	{
+		return false;
+	}
+
+	int result = wc_Sha256Update(&sha, session->sessionID,
+			session->sessionIDSz);
+	if (result == 0 && session->ticketLen > 0)
+	{
+		result = wc_Sha256Update(&sha, session->ticket, session->ticketLen);
+	}
+	if (result == 0)
+	{
+		result = wc_Sha256Final(&sha, fingerprint);
+	}
+	wc_Sha256Free(&sha);
+
+	return result == 0;
+}
+
+static const SessionRecord_t* session_FlashRecord(void)
+{
+	return (const SessionRecord_t*) SESSION_RECORD_ADDRESS;
+}
+
+static bool session_FlashErase(void)
+{
+	FLASH_EraseInitTypeDef erase =
+	{ .TypeErase = FLASH_TYPEERASE_PAGES, .NbPages = 1 };
+	uint32_t pageError = 0;
+
+	if (READ_BIT(FLASH->OPTR, FLASH_OPTR_DBANK) != 0)
+	{
+		// Bank 2, the CPU keeps running from bank 1 during the erase
+		erase.Banks = FLASH_BANK_2;
+		erase.Page = (SESSION_RECORD_ADDRESS - (FLASH_BASE + FLASH_BANK_SIZE))
+				/ FLASH_PAGE_SIZE;
+	}
+	else
+	{
+		// Single bank, fetches stall until the erase is done
+		erase.Banks = FLASH_BANK_1;
+		erase.Page = (SESSION_RECORD_ADDRESS - FLASH_BASE)
+				/ FLASH_PAGE_SIZE_128_BITS;
+	}
+
+	return HAL_FLASHEx_Erase(&erase, &pageError) == HAL_OK;
+}
+
+// A NULL record only erases the page
+static bool session_FlashWrite(const SessionRecord_t *record)
+{
+	bool success = false;
+
+	if (HAL_FLASH_Unlock() != HAL_OK)
+	{
+		return false;
+	}
+	__HAL_FLASH_CLEAR_FLAG(FLASH_FLAG_ALL_ERRORS);
+
+	if (session_FlashErase())
+	{
+		success = true;
+
+		for (uint32_t offset = 0; record != NULL && offset < sizeof(*record);
+				offset += sizeof(uint64_t))
+		{
+			uint64_t doubleWord;
+			memcpy(&doubleWord, (const uint8_t*) record + offset,
+					sizeof(doubleWord));
+
+			if (HAL_FLASH_Program(FLASH_TYPEPROGRAM_DOUBLEWORD,
+			SESSION_RECORD_ADDRESS + offset, doubleWord) != HAL_OK)
+			{
+				success = false;
+				break;
+			}
+		}
+	}
+
+	HAL_FLASH_Lock();
+
+	return success;
+}
+
+/*
+ * Unwraps the session saved by a previous boot. bornOn was taken from the
+ * uptime of that boot, it is moved to now so the session gets a full timeout;
+ * the server still decides whether the ticket or ID is accepted.
+ */
+static WOLFSSL_SESSION* session_LoadFromFlash(void)
+{
+	const SessionRecord_t *record = session_FlashRecord();
+
+	if (record->magic != SESSION_RECORD_MAGIC)
+	{
+		return NULL;
+	}
+
+	uint8_t blob[SESSION_BLOB_MAX_SIZE];
+	WOLFSSL_SESSION *session = NULL;
+
+	if (stsafe_UnwrapEnvelope(record->envelope, record->envelopeLength, blob))
+	{
+		uint16_t sessionLength = (uint16_t) ((blob[0] << 8) | blob[1]);
+		const unsigned char *sessionData = &blob[SESSION_BLOB_HEADER_SIZE];
+
+		if (sessionLength
+				<= record->envelopeLength - STSAFE_ENVELOPE_OVERHEAD
+						- SESSION_BLOB_HEADER_SIZE)
+		{
+			session = wolfSSL_d2i_SSL_SESSION(NULL, &sessionData,
+					sessionLength);
+		}
+	}
+	session_Wipe(blob, sizeof(blob));
+
+	if (session == NULL)
+	{
+		session_stats.restoreFailures++;
+		printf("TLSSession: the stored session could not be restored\r\n");
+		return NULL;
+	}
+
+	wolfSSL_SESSION_set_time(session, (long) session_Now());
+	persisted_valid = session_Fingerprint(session, persisted_fingerprint);
+	printf("TLSSession: restored the session saved before the last reboot\r\n");
+
+	return session;
+}
+
+static bool session_SaveToFlash(WOLFSSL_SESSION *session)
+{
+	int sessionLength = wolfSSL_i2d_SSL_SESSION(session, NULL);
+
+	if (sessionLength <= 0
+			|| sessionLength > SESSION_BLOB_MAX_SIZE - SESSION_BLOB_HEADER_SIZE)
+	{
+		printf("TLSSession: session of %d bytes does not fit an envelope\r\n",
+				sessionLength);
+		return false;
+	}
+
+	uint8_t blob[SESSION_BLOB_MAX_SIZE] =
+	{ 0 };
+	unsigned char *sessionData = &blob[SESSION_BLOB_HEADER_SIZE];
+
+	blob[0] = (uint8_t) (sessionLength >> 8);
+	blob[1] = (uint8_t) sessionLength;
+
+	static SessionRecord_t record;
+	memset(&record, 0xFF, sizeof(record));
+
+	uint16_t blobLength = (uint16_t) ((SESSION_BLOB_HEADER_SIZE + sessionLength
+			+ 7U) & ~7U);
+	bool wrapped = wolfSSL_i2d_SSL_SESSION(session, &sessionData)
+			== sessionLength
+			&& stsafe_WrapEnvelope(blob, blobLength, record.envelope);
+	session_Wipe(blob, sizeof(blob));
+
+	if (!wrapped)
+	{
+		return false;
+	}
+
+	record.magic = SESSION_RECORD_MAGIC;
+	record.envelopeLength = blobLength + STSAFE_ENVELOPE_OVERHEAD;
+	record.reserved = 0;
+
+	return session_FlashWrite(&record);
+}
+
+/*
+ * Writes the session over the record in flash when it resumes differently from
+ * it. Once written in this boot, a changed session waits for
+ * SESSION_SAVE_INTERVAL_S; the copy in RAM serves the reconnects meanwhile.
+ */
+static void session_Persist(WOLFSSL_SESSION *session)
+{
+	uint8_t fingerprint[WC_SHA256_DIGEST_SIZE];
+
+	if (!session_Fingerprint(session, fingerprint))
+	{
+		return;
+	}
+
+	if (persisted_valid
+			&& memcmp(fingerprint, persisted_fingerprint, sizeof(fingerprint))
+					== 0)
+	{
+		return;
+	}
+
+	if (persisted_valid && saved_this_boot
+			&& session_Now() - saved_at < SESSION_SAVE_INTERVAL_S)
+	{
+		session_stats.savesDeferred++;
+		return;
+	}
+
+	if (!session_SaveToFlash(session))
+	{
+		session_stats.saveFailures++;
+		printf("TLSSession: failed to save the session to flash\r\n");
+		return;
+	}
+
+	memcpy(persisted_fingerprint, fingerprint, sizeof(fingerprint));
+	persisted_valid = true;
+	saved_this_boot = true;
+	saved_at = session_Now();
+	session_stats.saves++;
+	printf("TLSSession: saved the session to flash, %lu writes, %lu deferred\r\n",
+			session_stats.saves, session_stats.savesDeferred);
+}
+
+/*
+ * wolfSSL new session callback. A resumed TLS 1.2 session is the one already
+ * stored; a TLS 1.3 resumption brings new tickets, which replace the used one.
+ * The session given is on the heap of the connection, which goes away with
+ * it, so a copy on the general pool is kept and 0 returned.
+ */
+static int session_NewSessionCb(WOLFSSL *ssl, WOLFSSL_SESSION *session)
+{
+	if (wolfSSL_version(ssl) != TLS1_3_VERSION && wolfSSL_session_reused(ssl))
+	{
+		return 0;
+	}
+
+	WOLFSSL_SESSION *copy = wolfSSL_NewSession(NULL);
+	if (copy == NULL || wolfSSL_DupSession(session, copy, 0) != WOLFSSL_SUCCESS)
+	{
+		if (copy != NULL)
+		{
+			wolfSSL_SESSION_free(copy);
+		}
+		printf("TLSSession: no memory to keep the session\r\n");
+		return 0;
+	}
+
+	if (stored_session != NULL)
+	{
+		wolfSSL_SESSION_free(stored_session);
+	}
+	stored_session = copy;
+
+	session_Persist(stored_session);
+
+	return 0;
+}
+
+void TLSSession_SetupContext(WOLFSSL_CTX *ctx)
+{
+	wolfSSL_CTX_sess_set_new_cb(ctx, session_NewSessionCb);
+}
+
+bool TLSSession_Apply(WOLFSSL *ssl)
+{
+	if (!flash_checked)
+	{
+		flash_checked = true;
+		stored_session = session_LoadFromFlash();
+	}
+
+	// Ask for a ticket even when there is nothing to resume yet
+	wolfSSL_UseSessionTicket(ssl);
+
+	if (stored_session == NULL)
+	{
+		return false;
+	}
+
+	if (wolfSSL_set_session(ssl, stored_session) != WOLFSSL_SUCCESS)
+	{
+		// Timed out, the next handshake is a full one and replaces it
+		printf("TLSSession: the stored session has expired\r\n");
+		return false;
+	}
+
+	return true;
+}
+
+uint32_t TLSSession_EarlyDataLimit(const WOLFSSL *ssl)
+{
+	// wolfSSL_SESSION_get_max_early_data needs OPENSSL_EXTRA
+	if (ssl->session == NULL || ssl->session->version.minor != TLSv1_3_MINOR)
+	{
+		return 0;
+	}
+
+	return ssl->session->maxEarlyDataSz;
+}
+
+void TLSSession_Update(WOLFSSL *ssl, uint32_t handshakeMs)
+{
+	if (wolfSSL_session_reused(ssl))
+	{
+		session_stats.resumedHandshakes++;
+		session_stats.resumedTotalMs += handshakeMs;
+	}
+	else
+	{
+		session_stats.fullHandshakes++;
+		session_stats.fullTotalMs += handshakeMs;
+	}
+
+	printf(
+			"TLSSession: %s handshake in %lu ms, average full %lu ms (%lu), resumed %lu ms (%lu)\r\n",
+			wolfSSL_session_reused(ssl) ? "resumed" : "full", handshakeMs,
+			session_stats.fullHandshakes == 0 ?
+					0 : session_stats.fullTotalMs / session_stats.fullHandshakes,
+			session_stats.fullHandshakes,
+			session_stats.resumedHandshakes == 0 ?
+					0 :
+					session_stats.resumedTotalMs
+							/ session_stats.resumedHandshakes,
+			session_stats.resumedHandshakes);
+}
+
+void TLSSession_Forget(void)
+{
+	if (stored_session != NULL)
+	{
+		wolfSSL_SESSION_free(stored_session);
+		stored_session = NULL;
+	}
+	flash_checked = true;
+	persisted_valid = false;
+
+	if (session_FlashRecord()->magic != 0xFFFFFFFFU)
+	{
+		session_FlashWrite(NULL);
+	}
+}
+
+void TLSSession_GetStats(TLSSessionStats_t *stats)
+{
+	*stats = session_stats;
+}
@@ -0,0 +1,135 @@
+#include "transport_socket.h"
+
+#include <stdio.h>
+
+#include "FreeRTOS.h"
+#include "task.h"
+
+typedef struct
+{
+	SocketState_t state;
+	const char *owner;
+} PooledSocket_t;
+
+static PooledSocket_t sockets[SOCKET_POOL_SIZE];
+static SocketPoolStats_t pool_stats;
+
+static const char* pool_StateName(SocketState_t state)
+{
+	switch (state)
+	{
+	case SOCKET_ALLOCATED:
+		return "allocated";
+	case SOCKET_CONNECTED:
+		return "connected";
+	default:
+		return "free";
+	}
+}
+
+uint32_t SocketPool_Allocate(const char *owner)
+{
+	uint32_t socket = SOCKET_POOL_NONE;
+
+	taskENTER_CRITICAL();
+	for (uint32_t i = 0; i < SOCKET_POOL_SIZE; i++)
+	{
+		if (sockets[i].state == SOCKET_FREE)
+		{
+			sockets[i].state = SOCKET_ALLOCATED;
+			sockets[i].owner = owner;
+			socket = i;
+			break;
+		}
+	}
+
+	if (socket != SOCKET_POOL_NONE)
+	{
+		pool_stats.allocations++;
+		pool_stats.inUse++;
+		if (pool_stats.inUse > pool_stats.peakInUse)
+		{
+			pool_stats.peakInUse = pool_stats.inUse;
+		}
+	}
+	else
+	{
+		pool_stats.exhausted++;
+	}
+	taskEXIT_CRITICAL();
+
+	if (socket == SOCKET_POOL_NONE)
+	{
+		printf("SocketPool: no free socket for %s\r\n", owner);
+		SocketPool_LogUsage();
+	}
+
+	return socket;
+}
+
+void SocketPool_SetConnected(uint32_t socket, bool connected)
+{
+	if (socket >= SOCKET_POOL_SIZE)
+	{
+		return;
+	}
+
+	taskENTER_CRITICAL();
+	if (sockets[socket].state != SOCKET_FREE)
+	{
+		sockets[socket].state = connected ? SOCKET_CONNECTED : SOCKET_ALLOCATED;
+	}
+	taskEXIT_CRITICAL();
+}
+
+void SocketPool_Release(uint32_t socket)
+{
+	if (socket >= SOCKET_POOL_SIZE)
+	{
+		return;
+	}
+
+	bool wasFree;
+
+	taskENTER_CRITICAL();
+	wasFree = sockets[socket].state == SOCKET_FREE;
+	if (!wasFree)
+	{
+		sockets[socket].state = SOCKET_FREE;
+		sockets[socket].owner = NULL;
+		pool_stats.inUse--;
+	}
+	taskEXIT_CRITICAL();
+
+	if (wasFree)
+	{
+		printf("SocketPool: socket %lu released twice\r\n", socket);
+	}
+}
+
+SocketState_t SocketPool_GetState(uint32_t socket)
+{
+	return socket < SOCKET_POOL_SIZE ? sockets[socket].state : SOCKET_FREE;
+}
+
+void SocketPool_GetStats(SocketPoolStats_t *stats)
+{
+	taskENTER_CRITICAL();
+	*stats = pool_stats;
+	taskEXIT_CRITICAL();
+}
+
+void SocketPool_LogUsage(void)
+{
+	for (uint32_t i = 0; i < SOCKET_POOL_SIZE; i++)
+	{
+		PooledSocket_t socket = sockets[i];
+
+		if (socket.state != SOCKET_FREE)
+		{
+			printf("SocketPool: socket %lu %s by %s\r\n", i,
+					pool_StateName(socket.state),
+					socket.owner != NULL ? socket.owner : "?");
+		}
+	}
+}
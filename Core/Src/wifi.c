@@ -40,7 +40,8 @@ WIFI_Status_t WIFI_Init(void)
                            SPI_WIFI_DeInit,
                            SPI_WIFI_Delay,
                            SPI_WIFI_SendData,
-                           SPI_WIFI_ReceiveData) == ES_WIFI_STATUS_OK)
+                           SPI_WIFI_ReceiveData,
+                           SPI_WIFI_ReceiveSegments) == ES_WIFI_STATUS_OK)
   {
     if(ES_WIFI_Init(&EsWifiObj) == ES_WIFI_STATUS_OK)
     {
@@ -651,3 +652,24 @@ WIFI_Status_t WIFI_GetModuleName(char *ModuleName, uint8_t ModuleNameLen)
 
   return ret;
 }
+
+/**
+  * @brief  Return the number of AT commands sent to the module
+  * @param  None
+  * @retval Command count
+  */
+uint32_t WIFI_GetCommandCount(void)
+{
+  return EsWifiObj.CommandCount;
+}
+
+/**
+  * @brief  Return the number of socket setters not sent, the module already
+  *         held the value
+  * @param  None
+  * @retval Skipped command count
+  */
+uint32_t WIFI_GetSkippedCommandCount(void)
+{
+  return EsWifiObj.SkippedCommandCount;
+}
@@ -9,11 +9,11 @@
 #include "es_wifi.h"
 #include "wifi.h"
 
+#include "transport_socket.h"
+
 #define WIFI_WRITE_TIMEOUT 10000
 #define WIFI_READ_TIMEOUT  10000
 
-#define SEND_TCP_SOCKET 0
-
 #define WIFI_SSID "WIFI_SSID"
 #define WIFI_PASS "WIFI_PASSWORD"
 
@@ -50,23 +50,25 @@ bool wifi_connect(void)
 bool SendTcpData(const uint8_t *ipaddr, uint16_t port, const uint8_t *pdata,
 		uint16_t Reqlen)
 {
-
-	if (WIFI_OpenClientConnection(SEND_TCP_SOCKET, WIFI_TCP_PROTOCOL,
-			"TCP_CLIENT", ipaddr, port, 0) != WIFI_STATUS_OK)
+	uint32_t socket = SocketPool_Allocate("TCP_CLIENT");
+	if (socket == SOCKET_POOL_NONE)
 	{
-		WIFI_CloseClientConnection(SEND_TCP_SOCKET);
 		return false;
 	}
 
-	uint16_t SentDatalen;
+	bool sent = false;
 
-	if (WIFI_SendData(SEND_TCP_SOCKET, pdata, Reqlen, &SentDatalen,
-	WIFI_WRITE_TIMEOUT) != WIFI_STATUS_OK)
+	if (WIFI_OpenClientConnection(socket, WIFI_TCP_PROTOCOL, "TCP_CLIENT",
+			ipaddr, port, 0) == WIFI_STATUS_OK)
 	{
-		WIFI_CloseClientConnection(SEND_TCP_SOCKET);
-		return false;
+		uint16_t SentDatalen;
+
+		sent = WIFI_SendData(socket, pdata, Reqlen, &SentDatalen,
+		WIFI_WRITE_TIMEOUT) == WIFI_STATUS_OK;
 	}
 
-	WIFI_CloseClientConnection(SEND_TCP_SOCKET);
-	return true;
+	WIFI_CloseClientConnection(socket);
+	SocketPool_Release(socket);
+
+	return sent;
 }
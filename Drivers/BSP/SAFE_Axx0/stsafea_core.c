@@ -104,6 +104,14 @@
 #define STSAFEA_WRAP_UNWRAP_ENVELOPE_ADDITIONAL_RESPONSE_LENGTH         ((uint16_t)8)
 /*!< Response length to I2C parameters query */
 #define STSAFEA_VERIFY_PASSWORD_RESPONSE_LENGTH                         ((uint16_t)2)
+#if (STSAFEA_USE_RESPONSE_TIME_MODEL)
+/*!< Command code field of the command header */
+#define STSAFEA_CMD_HEADER_CODE_MSK                                     ((uint8_t)0x1F)
+/*!< Number of command codes tracked by the response time model */
+#define STSAFEA_RESPONSE_TIME_MODEL_SIZE                                (32U)
+/*!< Shortest processing time estimate in ms */
+#define STSAFEA_RESPONSE_TIME_MIN_ESTIMATE                              (1U)
+#endif /* STSAFEA_USE_RESPONSE_TIME_MODEL */
 /**
   * @}
   */
@@ -113,11 +121,26 @@
 /* Private variables ---------------------------------------------------------*/
 #define WORKAROUND_GENERATE_SIGNATURE /* STSAFE-A1x0 hangs when hash containing only NULL bytes */
 
+#if (STSAFEA_USE_RESPONSE_TIME_MODEL)
+/* Per command code processing time estimates, refined from the observed completion times */
+static struct
+{
+  uint8_t  CommandCode;                                       /* Last transmitted command code */
+  uint32_t SentTick;                                          /* Tick at which it was transmitted */
+  uint32_t MaxWaitMs;                                         /* Worst case processing time of the command */
+  uint32_t EstimateMs[STSAFEA_RESPONSE_TIME_MODEL_SIZE];      /* 0 until the command code is first used */
+} ResponseTimeModel;
+#endif /* STSAFEA_USE_RESPONSE_TIME_MODEL */
+
 /* Global variables ----------------------------------------------------------*/
 
 /* Private function prototypes -----------------------------------------------*/
 static StSafeA_ResponseCode_t StSafeA_TransmitCommand(StSafeA_Handle_t *pStSafeA);
 static StSafeA_ResponseCode_t StSafeA_ReceiveResponse(StSafeA_Handle_t *pStSafeA);
+static void StSafeA_WaitResponse(uint32_t MaxWaitMs);
+#if (STSAFEA_USE_RESPONSE_TIME_MODEL)
+static void StSafeA_UpdateResponseTimeModel(void);
+#endif /* STSAFEA_USE_RESPONSE_TIME_MODEL */
 static StSafeA_ResponseCode_t StSafeA_AssignLVResponse(StSafeA_LVBuffer_t *pDestLVBuffer,
                                                        StSafeA_LVBuffer_t *pSrcLVBuffer, uint16_t ExpectedLen);
 static StSafeA_ResponseCode_t StSafeA_AssignLVBuffer(StSafeA_LVBuffer_t *pDestLVBuffer, uint8_t *pDataBuffer,
@@ -172,7 +195,8 @@ StSafeA_ResponseCode_t StSafeA_Init(StSafeA_Handle_t *pStSafeA, uint8_t *pAlloca
     pStSafeA->CrcSupport    = STSAFEA_CRC_SUPPORT;
     pStSafeA->MacCounter    = 0;
     pStSafeA->InOutBuffer.LV.Length = 0;
-    pStSafeA->InOutBuffer.LV.Data   = pAllocatedRxTxBufferData;
+    /* Commands are serialized after the frame headroom, the header is added in front of them on the wire */
+    pStSafeA->InOutBuffer.LV.Data   = &pAllocatedRxTxBufferData[STSAFEA_FRAME_HEADROOM];
     pStSafeA->HostMacSequenceCounter = STSAFEA_HOST_CMAC_INVALID_COUNTER;
 
     pStSafeA->HashObj.HashType = STSAFEA_SHA_256;
@@ -232,6 +256,20 @@ int32_t StSafeA_GetVersion(void)
   return (int32_t)STSAFEA_VERSION;
 }
 
+#if (STSAFEA_USE_RESPONSE_TIME_MODEL)
+/**
+  * @brief   StSafeA_GetResponseTimeEstimate
+  *          Returns the time waited after transmitting the given command before reading its response.
+  *
+  * @param   CommandCode : STSAFEA_CMD_xxx command code.
+  * @retval  Estimated processing time in ms, 0 if the command has not been used yet.
+  */
+uint32_t StSafeA_GetResponseTimeEstimate(uint8_t CommandCode)
+{
+  return ResponseTimeModel.EstimateMs[CommandCode & STSAFEA_CMD_HEADER_CODE_MSK];
+}
+#endif /* STSAFEA_USE_RESPONSE_TIME_MODEL */
+
 /**
   * @brief   StSafeA_Echo
   *          Executes the echo command expecting to receive back from STSAFEA the
@@ -282,7 +320,7 @@ StSafeA_ResponseCode_t StSafeA_Echo(
       pStSafeA->InOutBuffer.LV.Length = InRespDataLen + STSAFEA_R_MAC_LENGTH(InMAC);
 
       /* Wait for the command processing. Then check for the response */
-      StSafeA_Delay(STSAFEA_MS_WAIT_TIME_CMD_ECHO);
+      StSafeA_WaitResponse(STSAFEA_MS_WAIT_TIME_CMD_ECHO);
 
       status_code = StSafeA_ReceiveResponse(pStSafeA);
 
@@ -330,7 +368,7 @@ StSafeA_ResponseCode_t StSafeA_Reset(
       pStSafeA->InOutBuffer.LV.Length = STSAFEA_R_MAC_LENGTH(InMAC);
 
       /* Wait for the command processing. Then check for the response */
-      StSafeA_Delay(STSAFEA_MS_WAIT_TIME_CMD_RESET);
+      StSafeA_WaitResponse(STSAFEA_MS_WAIT_TIME_CMD_RESET);
 
       status_code = StSafeA_ReceiveResponse(pStSafeA);
       if (status_code == STSAFEA_OK)
@@ -420,7 +458,7 @@ StSafeA_ResponseCode_t StSafeA_GenerateRandom(
       pStSafeA->InOutBuffer.LV.Length = tmp_len;
 
       /* Wait for the command processing. Then check for the response */
-      StSafeA_Delay(STSAFEA_MS_WAIT_TIME_CMD_GENERATE_RANDOM);
+      StSafeA_WaitResponse(STSAFEA_MS_WAIT_TIME_CMD_GENERATE_RANDOM);
 
       status_code = StSafeA_ReceiveResponse(pStSafeA);
 
@@ -476,7 +514,7 @@ StSafeA_ResponseCode_t StSafeA_Hibernate(
       pStSafeA->InOutBuffer.LV.Length = STSAFEA_R_MAC_LENGTH(InMAC);
 
       /* Wait for the command processing. Then check for the response */
-      StSafeA_Delay(STSAFEA_MS_WAIT_TIME_CMD_HIBERNATE);
+      StSafeA_WaitResponse(STSAFEA_MS_WAIT_TIME_CMD_HIBERNATE);
 
       /* Receive */
       status_code = StSafeA_ReceiveResponse(pStSafeA);
@@ -560,7 +598,7 @@ StSafeA_ResponseCode_t StSafeA_DataPartitionQuery(
       pStSafeA->InOutBuffer.LV.Length = STSAFEA_DATA_PARTITION_QUERY_MIN_RESPONSE_LENGTH + STSAFEA_R_MAC_LENGTH(InMAC);
 
       /* Wait for the command processing. Then check for the response */
-      StSafeA_Delay(STSAFEA_MS_WAIT_TIME_CMD_QUERY);
+      StSafeA_WaitResponse(STSAFEA_MS_WAIT_TIME_CMD_QUERY);
 
       /* Receive */
       status_code = StSafeA_ReceiveResponse(pStSafeA);
@@ -740,7 +778,7 @@ StSafeA_ResponseCode_t StSafeA_Decrement(
       pStSafeA->InOutBuffer.LV.Length = STSAFEA_DECREMENT_RESPONSE_LENGTH + STSAFEA_R_MAC_LENGTH(InMAC);
 
       /* Wait for the command processing. Then check for the response */
-      StSafeA_Delay(STSAFEA_MS_WAIT_TIME_CMD_DECREMENT);
+      StSafeA_WaitResponse(STSAFEA_MS_WAIT_TIME_CMD_DECREMENT);
 
       /* Read response */
       status_code = StSafeA_ReceiveResponse(pStSafeA);
@@ -851,7 +889,7 @@ StSafeA_ResponseCode_t StSafeA_Read(
       pStSafeA->InOutBuffer.LV.Length = InRespDataLen + STSAFEA_R_MAC_LENGTH(InMAC);
 
       /* Wait for the command processing. Then check for the response */
-      StSafeA_Delay(STSAFEA_MS_WAIT_TIME_CMD_READ);
+      StSafeA_WaitResponse(STSAFEA_MS_WAIT_TIME_CMD_READ);
 
       status_code = StSafeA_ReceiveResponse(pStSafeA);
 
@@ -959,7 +997,7 @@ StSafeA_ResponseCode_t StSafeA_Process_Update(
       pStSafeA->InOutBuffer.LV.Length = STSAFEA_R_MAC_LENGTH(InMAC);
 
       /* Wait for the command processing. Then check for the response */
-      StSafeA_Delay(STSAFEA_MS_WAIT_TIME_CMD_UPDATE);
+      StSafeA_WaitResponse(STSAFEA_MS_WAIT_TIME_CMD_UPDATE);
 
       status_code = StSafeA_ReceiveResponse(pStSafeA);
     }
@@ -1199,7 +1237,7 @@ StSafeA_ResponseCode_t StSafeA_GenerateKeyPair(
                                         STSAFEA_R_MAC_LENGTH(InMAC);
 
       /* Wait for the command processing. Then check for the response */
-      StSafeA_Delay(STSAFEA_MS_WAIT_TIME_CMD_GENERATE_KEY);
+      StSafeA_WaitResponse(STSAFEA_MS_WAIT_TIME_CMD_GENERATE_KEY);
 
       /* Receive */
       status_code = StSafeA_ReceiveResponse(pStSafeA);
@@ -1376,7 +1414,7 @@ StSafeA_ResponseCode_t StSafeA_GenerateSignature(
         pStSafeA->InOutBuffer.LV.Length = tmp_len + STSAFEA_R_MAC_LENGTH(InMAC); ;
 
         /* Wait for the command processing. Then check for the response */
-        StSafeA_Delay(STSAFEA_MS_WAIT_TIME_CMD_GENERATE_SIGNATURE);
+        StSafeA_WaitResponse(STSAFEA_MS_WAIT_TIME_CMD_GENERATE_SIGNATURE);
 
         /* Read response */
         status_code = StSafeA_ReceiveResponse(pStSafeA);
@@ -1558,7 +1596,7 @@ StSafeA_ResponseCode_t StSafeA_VerifyMessageSignature(
       pStSafeA->InOutBuffer.LV.Length = STSAFEA_VERIFY_MSG_SIGNATURE_RESPONSE_LENGTH + STSAFEA_R_MAC_LENGTH(InMAC);
 
       /* Wait for the command processing. Then check for the response */
-      StSafeA_Delay(STSAFEA_MS_WAIT_TIME_CMD_VERIFY_MSG_SIGNATURE);
+      StSafeA_WaitResponse(STSAFEA_MS_WAIT_TIME_CMD_VERIFY_MSG_SIGNATURE);
 
       /* Read response */
       status_code = StSafeA_ReceiveResponse(pStSafeA);
@@ -1698,7 +1736,7 @@ StSafeA_ResponseCode_t StSafeA_EstablishKey(
                                           STSAFEA_R_MAC_LENGTH(InMAC);
 
         /* Wait for the command processing. Then check for the response */
-        StSafeA_Delay(STSAFEA_MS_WAIT_TIME_CMD_ESTABLISH_KEY);
+        StSafeA_WaitResponse(STSAFEA_MS_WAIT_TIME_CMD_ESTABLISH_KEY);
 
         /* Read response */
         status_code = StSafeA_ReceiveResponse(pStSafeA);
@@ -1801,7 +1839,7 @@ StSafeA_ResponseCode_t StSafeA_ProductDataQuery(
       pStSafeA->InOutBuffer.LV.Length = STSAFEA_PRODUCT_DATA_QUERY_RESPONSE_LENGTH + STSAFEA_R_MAC_LENGTH(InMAC);
 
       /* Wait for the command processing. Then check for the response */
-      StSafeA_Delay(STSAFEA_MS_WAIT_TIME_CMD_QUERY);
+      StSafeA_WaitResponse(STSAFEA_MS_WAIT_TIME_CMD_QUERY);
 
       /* Receive */
       status_code = StSafeA_ReceiveResponse(pStSafeA);
@@ -1966,7 +2004,7 @@ StSafeA_ResponseCode_t StSafeA_I2cParameterQuery(
       pStSafeA->InOutBuffer.LV.Length = STSAFEA_I2C_PARAMETERS_QUERY_RESPONSE_LENGTH + STSAFEA_R_MAC_LENGTH(InMAC);
 
       /* Wait for the command processing. Then check for the response */
-      StSafeA_Delay(STSAFEA_MS_WAIT_TIME_CMD_QUERY);
+      StSafeA_WaitResponse(STSAFEA_MS_WAIT_TIME_CMD_QUERY);
 
       /* Receive */
       status_code = StSafeA_ReceiveResponse(pStSafeA);
@@ -2026,7 +2064,7 @@ StSafeA_ResponseCode_t StSafeA_LifeCycleStateQuery(
       pStSafeA->InOutBuffer.LV.Length = STSAFEA_LIFE_CYCLE_STATE_QUERY_RESPONSE_LENGTH + STSAFEA_R_MAC_LENGTH(InMAC);
 
       /* Wait for the command processing. Then check for the response */
-      StSafeA_Delay(STSAFEA_MS_WAIT_TIME_CMD_QUERY);
+      StSafeA_WaitResponse(STSAFEA_MS_WAIT_TIME_CMD_QUERY);
 
       /* Receive */
       status_code = StSafeA_ReceiveResponse(pStSafeA);
@@ -2082,7 +2120,7 @@ StSafeA_ResponseCode_t StSafeA_HostKeySlotQuery(
       pStSafeA->InOutBuffer.LV.Length = STSAFEA_HOST_KEY_SLOT_QUERY_RESPONSE_LENGTH + STSAFEA_R_MAC_LENGTH(InMAC);
 
       /* Wait for the command processing. Then check for the response */
-      StSafeA_Delay(STSAFEA_MS_WAIT_TIME_CMD_QUERY);
+      StSafeA_WaitResponse(STSAFEA_MS_WAIT_TIME_CMD_QUERY);
 
       /* Receive */
       status_code = StSafeA_ReceiveResponse(pStSafeA);
@@ -2158,7 +2196,7 @@ StSafeA_ResponseCode_t StSafeA_PutAttribute(
       pStSafeA->InOutBuffer.LV.Length = STSAFEA_R_MAC_LENGTH(InMAC);
 
       /* Wait for the command processing. Then check for the response */
-      StSafeA_Delay(STSAFEA_MS_WAIT_TIME_CMD_PUT_ATTRIBUTE);
+      StSafeA_WaitResponse(STSAFEA_MS_WAIT_TIME_CMD_PUT_ATTRIBUTE);
 
       /* Receive */
       status_code = StSafeA_ReceiveResponse(pStSafeA);
@@ -2204,7 +2242,7 @@ StSafeA_ResponseCode_t StSafeA_DeletePassword(
       pStSafeA->InOutBuffer.LV.Length = STSAFEA_R_MAC_LENGTH(InMAC);
 
       /* Wait for the command processing. Then check for the response */
-      StSafeA_Delay(STSAFEA_MS_WAIT_TIME_CMD_DELETE_KEY);
+      StSafeA_WaitResponse(STSAFEA_MS_WAIT_TIME_CMD_DELETE_KEY);
 
       /* Receive */
       status_code = StSafeA_ReceiveResponse(pStSafeA);
@@ -2262,7 +2300,7 @@ StSafeA_ResponseCode_t StSafeA_VerifyPassword(
       pStSafeA->InOutBuffer.LV.Length = STSAFEA_VERIFY_PASSWORD_RESPONSE_LENGTH + STSAFEA_R_MAC_LENGTH(InMAC);
 
       /* Wait for the command processing. Then check for the response */
-      StSafeA_Delay(STSAFEA_MS_WAIT_TIME_CMD_VERIFY_PASSWORD);
+      StSafeA_WaitResponse(STSAFEA_MS_WAIT_TIME_CMD_VERIFY_PASSWORD);
 
       /* Receive */
       status_code = StSafeA_ReceiveResponse(pStSafeA);
@@ -2426,7 +2464,7 @@ StSafeA_ResponseCode_t StSafeA_LocalEnvelopeKeySlotQuery(
       pStSafeA->InOutBuffer.LV.Length = STSAFEA_LOCAL_ENVELOPE_QUERY_MIN_RESPONSE_LENGTH + STSAFEA_R_MAC_LENGTH(InMAC);
 
       /* Wait for the command processing. Then check for the response */
-      StSafeA_Delay(STSAFEA_MS_WAIT_TIME_CMD_QUERY);
+      StSafeA_WaitResponse(STSAFEA_MS_WAIT_TIME_CMD_QUERY);
 
       /* Receive */
       status_code = StSafeA_ReceiveResponse(pStSafeA);
@@ -2535,7 +2573,7 @@ StSafeA_ResponseCode_t StSafeA_GenerateLocalEnvelopeKey(
       pStSafeA->InOutBuffer.LV.Length = STSAFEA_R_MAC_LENGTH(InMAC);
 
       /* Wait for the command processing. Then check for the response */
-      StSafeA_Delay(STSAFEA_MS_WAIT_TIME_CMD_GENERATE_KEY);
+      StSafeA_WaitResponse(STSAFEA_MS_WAIT_TIME_CMD_GENERATE_KEY);
 
       /* Receive */
       status_code = StSafeA_ReceiveResponse(pStSafeA);
@@ -2635,7 +2673,7 @@ StSafeA_ResponseCode_t StSafeA_WrapLocalEnvelope(
                                           STSAFEA_R_MAC_LENGTH(InMAC);
 
         /* Wait for the command processing. Then check for the response */
-        StSafeA_Delay(STSAFEA_MS_WAIT_TIME_CMD_WRAP_LOCAL_ENVELOPE);
+        StSafeA_WaitResponse(STSAFEA_MS_WAIT_TIME_CMD_WRAP_LOCAL_ENVELOPE);
 
         /* Receive */
         status_code = StSafeA_ReceiveResponse(pStSafeA);
@@ -2729,7 +2767,7 @@ StSafeA_ResponseCode_t StSafeA_UnwrapLocalEnvelope(
                                         STSAFEA_R_MAC_LENGTH(InMAC);
 
       /* Wait for the command processing. Then check for the response */
-      StSafeA_Delay(STSAFEA_MS_WAIT_TIME_CMD_UNWRAP_LOCAL_ENVELOPE);
+      StSafeA_WaitResponse(STSAFEA_MS_WAIT_TIME_CMD_UNWRAP_LOCAL_ENVELOPE);
 
       /* Receive */
       status_code = StSafeA_ReceiveResponse(pStSafeA);
@@ -2790,7 +2828,13 @@ static StSafeA_ResponseCode_t StSafeA_TransmitCommand(StSafeA_Handle_t *pStSafeA
     status_code = StSafeA_MAC_SHA_PrePostProcess(pStSafeA, STSAFEA_MAC_SHA_PRE_PROCESS);
     if (status_code == STSAFEA_OK)
     {
+#if (STSAFEA_USE_RESPONSE_TIME_MODEL)
+      ResponseTimeModel.CommandCode = pStSafeA->InOutBuffer.Header & STSAFEA_CMD_HEADER_CODE_MSK;
+#endif /* STSAFEA_USE_RESPONSE_TIME_MODEL */
       status_code = StSafeA_Transmit(&pStSafeA->InOutBuffer, pStSafeA->CrcSupport);
+#if (STSAFEA_USE_RESPONSE_TIME_MODEL)
+      ResponseTimeModel.SentTick = SAFEA1_GetTick();
+#endif /* STSAFEA_USE_RESPONSE_TIME_MODEL */
     }
   }
 
@@ -2812,6 +2856,9 @@ static StSafeA_ResponseCode_t StSafeA_ReceiveResponse(StSafeA_Handle_t *pStSafeA
     status_code = StSafeA_Receive(&pStSafeA->InOutBuffer, pStSafeA->CrcSupport);
     if (status_code == STSAFEA_OK)
     {
+#if (STSAFEA_USE_RESPONSE_TIME_MODEL)
+      StSafeA_UpdateResponseTimeModel();
+#endif /* STSAFEA_USE_RESPONSE_TIME_MODEL */
       pStSafeA->MacCounter ++;
 
       status_code = StSafeA_MAC_SHA_PrePostProcess(pStSafeA, STSAFEA_MAC_SHA_POST_PROCESS);
@@ -2821,6 +2868,81 @@ static StSafeA_ResponseCode_t StSafeA_ReceiveResponse(StSafeA_Handle_t *pStSafeA
   return status_code;
 }
 
+/**
+  * @brief   StSafeA_WaitResponse
+  *          Static function to wait for the processing of the command just transmitted before its response
+  *          is read. Without the response time model this is the worst case processing time.
+  *
+  * @param   MaxWaitMs     : Worst case processing time of the command, STSAFEA_MS_WAIT_TIME_CMD_xxx.
+  * @retval  None
+  */
+static void StSafeA_WaitResponse(uint32_t MaxWaitMs)
+{
+#if (STSAFEA_USE_RESPONSE_TIME_MODEL)
+  uint32_t *p_estimate = &ResponseTimeModel.EstimateMs[ResponseTimeModel.CommandCode];
+
+  if ((*p_estimate == 0U) || (*p_estimate > MaxWaitMs))
+  {
+    *p_estimate = MaxWaitMs;
+  }
+  ResponseTimeModel.MaxWaitMs = MaxWaitMs;
+
+  StSafeA_Delay(*p_estimate);
+#else
+  StSafeA_Delay(MaxWaitMs);
+#endif /* STSAFEA_USE_RESPONSE_TIME_MODEL */
+}
+
+#if (STSAFEA_USE_RESPONSE_TIME_MODEL)
+/**
+  * @brief   StSafeA_UpdateResponseTimeModel
+  *          Static function to refine the processing time estimate of the last transmitted command once its
+  *          response has been received.
+  *          If the first read succeeded the command completed within the estimate, which is lowered by 1/4
+  *          to probe for the actual time. Otherwise the estimate moves 1/4 of the way towards the observed
+  *          completion time.
+  *
+  * @param   None
+  * @retval  None
+  */
+static void StSafeA_UpdateResponseTimeModel(void)
+{
+  uint32_t *p_estimate = &ResponseTimeModel.EstimateMs[ResponseTimeModel.CommandCode];
+  uint32_t estimate = *p_estimate;
+
+  if (estimate == 0U)
+  {
+    /* Response not preceded by StSafeA_WaitResponse (raw command) */
+    return;
+  }
+
+  if (StSafeA_GetReceiveRetries() == 0U)
+  {
+    estimate -= estimate / 4U;
+  }
+  else
+  {
+    uint32_t observed = SAFEA1_GetTick() - ResponseTimeModel.SentTick;
+
+    if (observed > estimate)
+    {
+      estimate += (observed - estimate + 3U) / 4U;
+    }
+  }
+
+  if (estimate < STSAFEA_RESPONSE_TIME_MIN_ESTIMATE)
+  {
+    estimate = STSAFEA_RESPONSE_TIME_MIN_ESTIMATE;
+  }
+  if (estimate > ResponseTimeModel.MaxWaitMs)
+  {
+    estimate = ResponseTimeModel.MaxWaitMs;
+  }
+
+  *p_estimate = estimate;
+}
+#endif /* STSAFEA_USE_RESPONSE_TIME_MODEL */
+
 /**
   * @brief   StSafeA_AssignLVResponse
   *          Static function used to assign the  LV structure from the received response.
@@ -3051,7 +3173,7 @@ StSafeA_ResponseCode_t StSafeA_StartSignatureSession(
       if (pStSafeA->HashObj.HashCtx != NULL)
       {
         /* Wait for the command processing. Then check for the response */
-        StSafeA_Delay(STSAFEA_MS_WAIT_TIME_CMD_START_SESSION);
+        StSafeA_WaitResponse(STSAFEA_MS_WAIT_TIME_CMD_START_SESSION);
 
         status_code = StSafeA_ReceiveResponse(pStSafeA);
       }
@@ -3138,7 +3260,7 @@ StSafeA_ResponseCode_t StSafeA_GetSignature(
       pStSafeA->InOutBuffer.LV.Length += STSAFEA_R_MAC_LENGTH(InMAC);
 
       /* Wait for the command processing. Then check for the response */
-      StSafeA_Delay(STSAFEA_MS_WAIT_TIME_CMD_GET_SIGNATURE);
+      StSafeA_WaitResponse(STSAFEA_MS_WAIT_TIME_CMD_GET_SIGNATURE);
 
       /* Read response */
       status_code = StSafeA_ReceiveResponse(pStSafeA);
@@ -3257,7 +3379,7 @@ StSafeA_ResponseCode_t StSafeA_PublicKeySlotQuery(
                                         + STSAFEA_R_MAC_LENGTH(InMAC);
 
       /* Wait for the command processing. Then check for the response */
-      StSafeA_Delay(STSAFEA_MS_WAIT_TIME_CMD_QUERY);
+      StSafeA_WaitResponse(STSAFEA_MS_WAIT_TIME_CMD_QUERY);
 
       /* Receive */
       status_code = StSafeA_ReceiveResponse(pStSafeA);
@@ -3394,7 +3516,7 @@ StSafeA_ResponseCode_t StSafeA_PutPublicKeySlot(
       pStSafeA->InOutBuffer.LV.Length = STSAFEA_R_MAC_LENGTH(InMAC);
 
       /* Wait for the command processing. Then check for the response */
-      StSafeA_Delay(STSAFEA_MS_WAIT_TIME_CMD_PUT_ATTRIBUTE);
+      StSafeA_WaitResponse(STSAFEA_MS_WAIT_TIME_CMD_PUT_ATTRIBUTE);
 
       /* Receive */
       status_code = StSafeA_ReceiveResponse(pStSafeA);
@@ -3486,7 +3608,7 @@ StSafeA_ResponseCode_t StSafeA_VerifyEntitySignature(
       pStSafeA->InOutBuffer.LV.Length = STSAFEA_VERIFY_ENTITY_SIGNATURE_RESPONSE_LENGTH + STSAFEA_R_MAC_LENGTH(InMAC);
 
       /* Wait for the command processing. Then check for the response */
-      StSafeA_Delay(STSAFEA_MS_WAIT_TIME_CMD_VERIFY_ENTITY_SIGNATURE);
+      StSafeA_WaitResponse(STSAFEA_MS_WAIT_TIME_CMD_VERIFY_ENTITY_SIGNATURE);
 
       /* Read response */
       status_code = StSafeA_ReceiveResponse(pStSafeA);
@@ -3588,7 +3710,7 @@ StSafeA_ResponseCode_t StSafeA_CommandAuthorizationConfigurationQuery(
                                         STSAFEA_R_MAC_LENGTH(InMAC);
 
       /* Wait for the command processing. Then check for the response */
-      StSafeA_Delay(STSAFEA_MS_WAIT_TIME_CMD_QUERY);
+      StSafeA_WaitResponse(STSAFEA_MS_WAIT_TIME_CMD_QUERY);
 
       /* Receive */
       status_code = StSafeA_ReceiveResponse(pStSafeA);
@@ -278,6 +278,10 @@ StSafeA_ResponseCode_t StSafeA_Init(
 
 int32_t StSafeA_GetVersion(void);
 
+#if (STSAFEA_USE_RESPONSE_TIME_MODEL)
+uint32_t StSafeA_GetResponseTimeEstimate(uint8_t CommandCode);
+#endif /* STSAFEA_USE_RESPONSE_TIME_MODEL */
+
 StSafeA_ResponseCode_t StSafeA_Echo(
   StSafeA_Handle_t *pStSafeA,
   uint8_t *pInEchoData,
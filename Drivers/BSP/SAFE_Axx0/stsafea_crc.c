@@ -18,6 +18,7 @@
 
 /* Includes ------------------------------------------------------------------*/
 
+#include <string.h>
 #include "stsafea_crc.h"
 #include MCU_ERRNO_INCLUDE
 
@@ -197,6 +198,166 @@ int32_t CRC16X25_Init(void)
   return BSP_ERROR_NONE;
 }
 
+#if (STSAFEA_CRC_ENGINE == STSAFEA_CRC_ENGINE_SLICE_BY_4)
+/* Table k gives the CRC register update for a byte followed by k zero bytes */
+static uint16_t crc16_slice_by_4_tables[4][256];
+
+/**
+  * @brief   CRC16X25_SliceBy4_Init
+  *          Builds the slice-by-4 tables for the reflected 0x1021 polynomial (0x8408).
+  * @retval  BSP status
+  */
+int32_t CRC16X25_SliceBy4_Init(void)
+{
+  uint16_t remainder;
+  uint16_t dividend;
+  uint8_t bit;
+  uint8_t k;
+
+  for (dividend = 0; dividend < 256U; dividend++)
+  {
+    remainder = dividend;
+    for (bit = 8; bit > 0U; bit--)
+    {
+      remainder = ((remainder & 1U) != 0U) ? ((remainder >> 1) ^ 0x8408U) : (remainder >> 1);
+    }
+    crc16_slice_by_4_tables[0][dividend] = remainder;
+  }
+
+  for (dividend = 0; dividend < 256U; dividend++)
+  {
+    for (k = 1; k < 4U; k++)
+    {
+      remainder = crc16_slice_by_4_tables[k - 1U][dividend];
+      crc16_slice_by_4_tables[k][dividend] = (remainder >> 8) ^ crc16_slice_by_4_tables[0][remainder & 0xFFU];
+    }
+  }
+
+  return BSP_ERROR_NONE;
+}
+
+/**
+  * @brief   StSafeA_Crc16_SliceBy4
+  *          Updates the reflected CRC register with Length bytes, 4 at a time.
+  *
+  * @param   Crc    : CRC register value to start from.
+  * @param   pData  : Data to add to the CRC.
+  * @param   Length : Length of the data.
+  * @retval  uint16_t containing the updated CRC register
+  */
+static uint16_t StSafeA_Crc16_SliceBy4(uint16_t Crc, const uint8_t *pData, uint16_t Length)
+{
+  uint16_t crc = Crc;
+  uint16_t x;
+
+  while (Length >= 4U)
+  {
+    /* The 16-bit register only overlaps the first two bytes of the slice */
+    x = crc ^ ((uint16_t)pData[0] | ((uint16_t)pData[1] << 8));
+    crc = crc16_slice_by_4_tables[3][x & 0xFFU] ^
+          crc16_slice_by_4_tables[2][x >> 8] ^
+          crc16_slice_by_4_tables[1][pData[2]] ^
+          crc16_slice_by_4_tables[0][pData[3]];
+    pData += 4;
+    Length -= 4U;
+  }
+
+  while (Length > 0U)
+  {
+    crc = crc16_slice_by_4_tables[0][(crc ^ *pData) & 0xFFU] ^ (crc >> 8);
+    pData++;
+    Length--;
+  }
+
+  return crc;
+}
+
+/**
+  * @brief   CRC_SliceBy4_Compute
+  *          Same as CRC_Compute, computed with the slice-by-4 tables.
+  *          CRC16X25_SliceBy4_Init must have been called first.
+  *
+  * @param   pData1  : Pointer to 1st input data buffer.
+  * @param   Length1 : Size of 1st input data buffer.
+  * @param   pData2  : Pointer to 2nd input data buffer.
+  * @param   Length2 : Size of 2nd input data buffer.
+  * @retval  uint32_t CRC (returned value LSBs for CRC)
+  */
+uint32_t CRC_SliceBy4_Compute(uint8_t *pData1, uint16_t Length1, uint8_t *pData2, uint16_t Length2)
+{
+  (void)Length1;
+  uint16_t crc16 = 0;
+  if ((pData1 != NULL) && (pData2 != NULL))
+  {
+    crc16 = StSafeA_Crc16_SliceBy4(0xFFFFU, pData1, 1U);
+    crc16 = StSafeA_Crc16_SliceBy4(crc16, pData2, Length2);
+
+    crc16 = (uint16_t)SWAP2BYTES(crc16);
+    crc16 ^= 0xFFFFU;
+  }
+  return (uint32_t)crc16;
+}
+#endif /* STSAFEA_CRC_ENGINE == STSAFEA_CRC_ENGINE_SLICE_BY_4 */
+
+#if (STSAFEA_CRC_ENGINE == STSAFEA_CRC_ENGINE_HW)
+/**
+  * @brief   CRC16X25_HW_Init
+  *          Configures the CRC unit for a 16-bit 0x1021 polynomial with input bytes and output reflected, which
+  *          leaves in CRC->DR the same register value as the reflected table lookup.
+  * @retval  BSP status
+  */
+int32_t CRC16X25_HW_Init(void)
+{
+  __HAL_RCC_CRC_CLK_ENABLE();
+
+  CRC->POL  = 0x1021U;
+  CRC->INIT = 0xFFFFU;
+  CRC->CR   = CRC_CR_POLYSIZE_0 | CRC_CR_REV_IN_0 | CRC_CR_REV_OUT;
+
+  return BSP_ERROR_NONE;
+}
+
+/**
+  * @brief   CRC_HW_Compute
+  *          Same as CRC_Compute, computed by the CRC unit.
+  *          CRC16X25_HW_Init must have been called first.
+  *
+  * @param   pData1  : Pointer to 1st input data buffer.
+  * @param   Length1 : Size of 1st input data buffer.
+  * @param   pData2  : Pointer to 2nd input data buffer.
+  * @param   Length2 : Size of 2nd input data buffer.
+  * @retval  uint32_t CRC (returned value LSBs for CRC)
+  */
+uint32_t CRC_HW_Compute(uint8_t *pData1, uint16_t Length1, uint8_t *pData2, uint16_t Length2)
+{
+  (void)Length1;
+  uint16_t crc16 = 0;
+  uint32_t word;
+  uint16_t i = 0;
+  if ((pData1 != NULL) && (pData2 != NULL))
+  {
+    CRC->CR |= CRC_CR_RESET;
+    *(__IO uint8_t *)&CRC->DR = pData1[0];
+
+    /* Whole words byte swapped, so that the first byte in memory is the first one processed */
+    for (; (i + 4U) <= Length2; i += 4U)
+    {
+      (void)memcpy(&word, &pData2[i], sizeof(word));
+      CRC->DR = SWAP4BYTES(word);
+    }
+    for (; i < Length2; i++)
+    {
+      *(__IO uint8_t *)&CRC->DR = pData2[i];
+    }
+
+    crc16 = (uint16_t)(CRC->DR & 0xFFFFU);
+    crc16 = (uint16_t)SWAP2BYTES(crc16);
+    crc16 ^= 0xFFFFU;
+  }
+  return (uint32_t)crc16;
+}
+#endif /* STSAFEA_CRC_ENGINE == STSAFEA_CRC_ENGINE_HW */
+
 /**
   * @}STSAFEA1_Exported_Functions 
   */
@@ -43,6 +43,10 @@
 /** @defgroup STSAFEA1_CRC_Exported_Constants STSAFEA1 CRC Exported Constants
   * @{
   */
+/* CRC16 X.25 engines that can be selected with STSAFEA_CRC_ENGINE. All of them return the same CRC */
+#define STSAFEA_CRC_ENGINE_REFERENCE           0U /*!< Byte at a time lookup in a 256 entries table */
+#define STSAFEA_CRC_ENGINE_SLICE_BY_4          1U /*!< 4 bytes per step from four 256 entries tables */
+#define STSAFEA_CRC_ENGINE_HW                  2U /*!< STM32 CRC unit set to the reflected 0x1021 polynomial */
 /**
   * @}STSAFEA1_CRC_Exported_Constants
   */
@@ -73,6 +77,10 @@
   */
 int32_t CRC16X25_Init(void);
 uint32_t CRC_Compute(uint8_t *pData1, uint16_t Length1, uint8_t *pData2, uint16_t Length2);
+int32_t CRC16X25_SliceBy4_Init(void);
+uint32_t CRC_SliceBy4_Compute(uint8_t *pData1, uint16_t Length1, uint8_t *pData2, uint16_t Length2);
+int32_t CRC16X25_HW_Init(void);
+uint32_t CRC_HW_Compute(uint8_t *pData1, uint16_t Length1, uint8_t *pData2, uint16_t Length2);
 /**
   * @}STSAFEA1_CRC_Exported_Functions
   */
@@ -23,6 +23,9 @@
 #include "stsafea_service.h"
 #include "safea1_conf.h"
 #include <string.h>
+#if (STSAFEA_USE_RTOS_I2C_BUS == 1U)
+#include "stsafe_i2c_rtos.h"
+#endif /* STSAFEA_USE_RTOS_I2C_BUS */
 
 /** MISRA C:2012 deviation rule has been granted for following rules:
   * - Rule-14.3_a - Medium: Conditional expression is always true.
@@ -65,6 +68,8 @@
   * @{
   */
 static STSAFEA_HW_t HwCtx;
+/* Number of NACKed reads before the last response was received */
+static uint16_t ReceiveRetries;
 /**
   * @}
   */
@@ -287,6 +292,19 @@ void StSafeA_Delay(uint32_t msDelay)
     HwCtx.TimeDelay(msDelay);
   }
 }
+
+/**
+  * @brief   StSafeA_GetReceiveRetries
+  *          Number of read attempts the STSAFE-A1xx answered with a NACK (still busy) during the last
+  *          StSafeA_Receive.
+  *
+  * @param   None
+  * @retval  Number of NACKed reads.
+  */
+uint16_t StSafeA_GetReceiveRetries(void)
+{
+  return ReceiveRetries;
+}
 /**
   * @}
   */
@@ -315,13 +333,30 @@ int8_t StSafeA_HW_Probe(STSAFEA_HW_t  *pCtx)
 {
   STSAFEA_HW_t *HwCtx = pCtx;
 
+#if (STSAFEA_USE_RTOS_I2C_BUS == 1U)
+  /* Interrupt driven transfers, the calling task sleeps while waiting */
+  HwCtx->BusInit    = stsafe_I2C_Init;
+  HwCtx->BusDeInit  = stsafe_I2C_DeInit;
+  HwCtx->BusSend    = stsafe_I2C_Send;
+  HwCtx->BusRecv    = stsafe_I2C_Recv;
+  HwCtx->TimeDelay  = stsafe_Delay;
+#else
   HwCtx->BusInit    = SAFEA1_I2C_Init;
   HwCtx->BusDeInit  = SAFEA1_I2C_DeInit;
   HwCtx->BusSend    = SAFEA1_I2C_Send;
   HwCtx->BusRecv    = SAFEA1_I2C_Recv;
+  HwCtx->TimeDelay  = HAL_Delay;
+#endif /* STSAFEA_USE_RTOS_I2C_BUS */
+#if (STSAFEA_CRC_ENGINE == STSAFEA_CRC_ENGINE_HW)
+  HwCtx->CrcInit    = CRC16X25_HW_Init;
+  HwCtx->CrcCompute = CRC_HW_Compute;
+#elif (STSAFEA_CRC_ENGINE == STSAFEA_CRC_ENGINE_SLICE_BY_4)
+  HwCtx->CrcInit    = CRC16X25_SliceBy4_Init;
+  HwCtx->CrcCompute = CRC_SliceBy4_Compute;
+#else
   HwCtx->CrcInit    = CRC16X25_Init;
   HwCtx->CrcCompute = CRC_Compute;
-  HwCtx->TimeDelay  = HAL_Delay;
+#endif /* STSAFEA_CRC_ENGINE */
   HwCtx->DevAddr    = STSAFEA_DEVICE_ADDRESS;
 
   return STSAFEA_BUS_OK;
@@ -349,6 +384,7 @@ static int8_t StSafeA_SendBytes(StSafeA_TLVBuffer_t *pInBuffer)
   int8_t status_code = STSAFEA_BUS_ERR;
   uint16_t loop = 1;
   uint16_t i2c_length;
+  uint8_t *p_frame;
 
   /* In order to avoid excess data sending over I2C */
   /* pInBuffer->LV.Length should not exceed the max allowed size */
@@ -362,20 +398,18 @@ static int8_t StSafeA_SendBytes(StSafeA_TLVBuffer_t *pInBuffer)
   if (pInBuffer->LV.Data != NULL)
   {
 
-    /* To optimize stack size and avoid to allocate memory for a dedicated transmit
-       buffer, the same pInBuffer.Data is used to send over the Bus. The
-       pInBuffer.Data has to be adjusted in the proper way to be used for this scope,
-       in order to include the Header as well. LV.Data must be 1-byte greater than expected.
-       LV.Data is in fact allocated with 4 additional spare bytes (see STSAFEA_BUFFER_DATA_PACKET_SIZE) */
-    (void)memmove((uint8_t *)&pInBuffer->LV.Data[1], (uint8_t *)&pInBuffer->LV.Data[0], pInBuffer->LV.Length);
-    pInBuffer->LV.Data[0] = pInBuffer->Header;
+    /* The command has been serialized by the Core layer after the frame headroom
+       (see STSAFEA_FRAME_HEADROOM), so the Header is written just in front of it
+       and the whole frame is sent from there, without moving LV.Data */
+    p_frame = &pInBuffer->LV.Data[0] - STSAFEA_HEADER_LENGTH;
+    p_frame[0] = pInBuffer->Header;
 
 
     /* Send to STSAFE-A1xx */
     while ((status_code != STSAFEA_BUS_OK) && (loop <= (STSAFEA_I2C_POLLING_MAX / STSAFEA_I2C_POLLING_STEP)))
     {
       status_code = HwCtx.BusSend(((uint16_t)HwCtx.DevAddr) << 1,
-                                  (uint8_t *)pInBuffer->LV.Data, i2c_length);
+                                  p_frame, i2c_length);
 
       if (status_code == STSAFEA_BUS_NACK)
       {
@@ -384,11 +418,6 @@ static int8_t StSafeA_SendBytes(StSafeA_TLVBuffer_t *pInBuffer)
 
       loop += STSAFEA_I2C_POLLING_STEP;
     }
-
-    /* Restore initial LV.Data, in case caller expects to re-use it */
-    /* At the moment of this implementation Callers functions never need the transmitted LV.Data
-       so the following restore can be commented for speed optimization */
-    (void)memmove((uint8_t *)&pInBuffer->LV.Data[0], (uint8_t *)&pInBuffer->LV.Data[1], pInBuffer->LV.Length);
   }
   return (status_code);
 }
@@ -405,6 +434,9 @@ static int8_t StSafeA_ReceiveBytes(StSafeA_TLVBuffer_t *pOutBuffer)
   uint16_t response_length = pOutBuffer->LV.Length;
   int8_t status_code = STSAFEA_BUS_ERR;
   uint16_t loop = 1;
+  uint8_t *p_frame;
+
+  ReceiveRetries = 0U;
 
   /* In order to avoid excess data sending over I2C */
   /* pInBuffer->LV.Length should not exceed the max allowed size */
@@ -415,18 +447,21 @@ static int8_t StSafeA_ReceiveBytes(StSafeA_TLVBuffer_t *pOutBuffer)
 
   if (pOutBuffer->LV.Data != NULL)
   {
-    /* To optimize stack size and avoid to allocate memory for a dedicated receive
-       buffer, the pOutBuffer.Data is used to receive over the Bus. Than the
-       pOutBuffer structure is re-adjusted in the proper way */
+    /* The response is received into the frame headroom in front of pOutBuffer.Data
+       (see STSAFEA_FRAME_HEADROOM), so that its data lands directly at LV.Data[0]
+       and only the Header and Length have to be picked from the headroom */
+    p_frame = &pOutBuffer->LV.Data[0] - STSAFEA_FRAME_HEADROOM;
+
     while ((status_code != STSAFEA_BUS_OK) && (loop <= (STSAFEA_I2C_POLLING_MAX / STSAFEA_I2C_POLLING_STEP)))
     {
 
       status_code = HwCtx.BusRecv(((uint16_t)HwCtx.DevAddr) << 1,
-                                  pOutBuffer->LV.Data,
-                                  response_length + STSAFEA_HEADER_LENGTH + STSAFEA_LENGTH_SIZE);
+                                  p_frame,
+                                  response_length + STSAFEA_FRAME_HEADROOM);
 
       if (status_code == STSAFEA_BUS_NACK)
       {
+        ReceiveRetries++;
         HwCtx.TimeDelay(STSAFEA_I2C_POLLING_STEP);
       }
 
@@ -434,9 +469,8 @@ static int8_t StSafeA_ReceiveBytes(StSafeA_TLVBuffer_t *pOutBuffer)
     }
 
     /* At this point the pOutBuffer.Header, Length, Data is re-adjusted in the proper way*/
-    pOutBuffer->Header = pOutBuffer->LV.Data[0];
-    pOutBuffer->LV.Length = ((uint16_t)pOutBuffer->LV.Data[1] << 8) + pOutBuffer->LV.Data[2];
-    (void)memcpy(pOutBuffer->LV.Data, &pOutBuffer->LV.Data[3], response_length);
+    pOutBuffer->Header = p_frame[0];
+    pOutBuffer->LV.Length = ((uint16_t)p_frame[1] << 8) + p_frame[2];
     
     if ((pOutBuffer->LV.Length) > STSAFEA_BUFFER_DATA_PACKET_SIZE)
     {
@@ -453,8 +487,8 @@ static int8_t StSafeA_ReceiveBytes(StSafeA_TLVBuffer_t *pOutBuffer)
       while ((status_code != STSAFEA_BUS_OK) && (loop <= (STSAFEA_I2C_POLLING_MAX / STSAFEA_I2C_POLLING_STEP)))
       {
         status_code = HwCtx.BusRecv(((uint16_t)HwCtx.DevAddr) << 1,
-                                    pOutBuffer->LV.Data,
-                                    pOutBuffer->LV.Length + STSAFEA_HEADER_LENGTH + STSAFEA_LENGTH_SIZE);
+                                    p_frame,
+                                    pOutBuffer->LV.Length + STSAFEA_FRAME_HEADROOM);
 
         if (status_code == STSAFEA_BUS_NACK)
         {
@@ -464,9 +498,8 @@ static int8_t StSafeA_ReceiveBytes(StSafeA_TLVBuffer_t *pOutBuffer)
         loop += STSAFEA_I2C_POLLING_STEP;
       }
 
-      pOutBuffer->Header = pOutBuffer->LV.Data[0];
-      pOutBuffer->LV.Length = ((uint16_t)pOutBuffer->LV.Data[1] << 8) + pOutBuffer->LV.Data[2];
-      (void)memcpy(pOutBuffer->LV.Data, &pOutBuffer->LV.Data[3], pOutBuffer->LV.Length);
+      pOutBuffer->Header = p_frame[0];
+      pOutBuffer->LV.Length = ((uint16_t)p_frame[1] << 8) + p_frame[2];
 
     }
   }
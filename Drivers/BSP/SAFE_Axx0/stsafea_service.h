@@ -111,6 +111,7 @@ int8_t StSafeA_HW_Init(void);
 StSafeA_ResponseCode_t StSafeA_Transmit(StSafeA_TLVBuffer_t *pTLV_Buffer, uint8_t CrcSupport);
 StSafeA_ResponseCode_t StSafeA_Receive(StSafeA_TLVBuffer_t *pTLV_Buffer, uint8_t CrcSupport);
 void                   StSafeA_Delay(uint32_t msDelay);
+uint16_t               StSafeA_GetReceiveRetries(void);
 /**
   * @}
   */
@@ -70,8 +70,12 @@ extern "C" {
                                                 STSAFEA_CRC_LENGTH) /*!< Data size in bytes */
 #define STSAFEA_BUFFER_DATA_EXTENSION_SIZE     16U /*!< Additional 16 bytes = 2 Bytes CRC + 10 extra bytes used during
                                                         RMAC calculation + 4 spare bytes
-                                                        used for optimization by the Low Level layer to move bytes
-                                                        inside the same buffer */
+                                                        reserved in front of the data for the frame header
+                                                        (see STSAFEA_FRAME_HEADROOM) */
+#define STSAFEA_FRAME_HEADROOM                 (STSAFEA_HEADER_LENGTH + STSAFEA_LENGTH_SIZE) /*!< Bytes kept free in
+                                                        front of InOutBuffer.LV.Data so that the Low Level layer
+                                                        can put the header (and the response length) on the wire
+                                                        without moving the data */
 /*!< Max extended buffer size in bytes */
 #define STSAFEA_BUFFER_MAX_SIZE                (STSAFEA_BUFFER_DATA_PACKET_SIZE + STSAFEA_BUFFER_DATA_EXTENSION_SIZE)
 #define STSAFEA_ATOMICITY_BUFFER_SIZE          64U /*!< Atomicity buffer size in bytes */
@@ -8917,8 +8917,10 @@ static int SendTls13CertificateVerify(WOLFSSL* ssl)
 
             if (ssl->buffers.key == NULL) {
             #ifdef HAVE_PK_CALLBACKS
+                /* sigLen, as DecodePrivateKey() sets it below: the length
+                 * alone fails the check for a zero sigLen */
                 if (wolfSSL_CTX_IsPrivatePkSet(ssl->ctx))
-                    args->length = (word16)GetPrivateKeySigSize(ssl);
+                    args->sigLen = (word32)GetPrivateKeySigSize(ssl);
                 else
             #endif
                     ERROR_OUT(NO_PRIVATE_KEY, exit_scv);
@@ -0,0 +1,128 @@
+/*
+ * Checks the STSAFE CRC16 X.25 engines of stsafea_crc.c on the host and times
+ * them. REFERENCE and SLICE_BY_4 must return what a bitwise model of the CRC
+ * returns for every frame length the chip can send, 0 to 510 data bytes after
+ * the header byte. The HW engine needs the board and is not covered.
+ *
+ *   cc -O2 -I Tools/crc_check -o crc_check Tools/crc_check/crc_check.c
+ *   ./crc_check
+ *
+ * Exits with 1 on the first mismatch.
+ */
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <time.h>
+
+#include "../../Drivers/BSP/SAFE_Axx0/stsafea_crc.c"
+
+#define MAX_LENGTH 510U
+#define TIMED_BYTES (64U * 1024U * 1024U)
+
+typedef uint32_t (*CrcCompute_t)(uint8_t*, uint16_t, uint8_t*, uint16_t);
+
+// One bit at a time with the reflected polynomial, in CRC_Compute's byte order
+static uint32_t bitwise_Compute(uint8_t *pData1, uint16_t Length1,
+		uint8_t *pData2, uint16_t Length2)
+{
+	(void) Length1;
+	uint16_t crc = 0xFFFFU;
+
+	for (uint32_t i = 0; i <= Length2; i++)
+	{
+		crc ^= i == 0 ? pData1[0] : pData2[i - 1];
+		for (int bit = 0; bit < 8; bit++)
+		{
+			crc = (crc & 1U) ? (uint16_t) ((crc >> 1) ^ 0x8408U) : (crc >> 1);
+		}
+	}
+
+	crc = (uint16_t) ~crc;
+	return (uint32_t) (uint16_t) ((crc << 8) | (crc >> 8));
+}
+
+static double now_ns(void)
+{
+	struct timespec ts;
+	clock_gettime(CLOCK_MONOTONIC, &ts);
+	return ts.tv_sec * 1e9 + ts.tv_nsec;
+}
+
+static double time_ns(CrcCompute_t compute, uint8_t *header, uint8_t *data,
+		uint16_t length)
+{
+	uint32_t rounds = TIMED_BYTES / (length + 1U);
+	volatile uint32_t sink = 0;
+
+	double start = now_ns();
+	for (uint32_t i = 0; i < rounds; i++)
+	{
+		data[0] = (uint8_t) i;
+		sink ^= compute(header, 1, data, length);
+	}
+	(void) sink;
+
+	return (now_ns() - start) / rounds;
+}
+
+int main(void)
+{
+	static uint8_t data[MAX_LENGTH];
+	uint8_t header = 0x00;
+
+	CRC16X25_Init();
+	CRC16X25_SliceBy4_Init();
+
+	// X.25 check value: "123456789" gives 0x906E, sent low byte first
+	uint8_t check[] = "123456789";
+	uint32_t expected = bitwise_Compute(check, 1, check + 1, 8);
+	if (expected != 0x6E90U)
+	{
+		printf("bitwise model: check value %04X, expected 6E90\n",
+				(unsigned int) expected);
+		return 1;
+	}
+
+	srand(1);
+	for (uint16_t length = 0; length <= MAX_LENGTH; length++)
+	{
+		for (int round = 0; round < 16; round++)
+		{
+			header = (uint8_t) rand();
+			for (uint16_t i = 0; i < length; i++)
+			{
+				data[i] = (uint8_t) rand();
+			}
+
+			expected = bitwise_Compute(&header, 1, data, length);
+			uint32_t reference = CRC_Compute(&header, 1, data, length);
+			uint32_t sliced = CRC_SliceBy4_Compute(&header, 1, data, length);
+
+			if (reference != expected || sliced != expected)
+			{
+				printf("length %u: bitwise %04X, reference %04X, slice-by-4 %04X\n",
+						length, (unsigned int) expected,
+						(unsigned int) reference, (unsigned int) sliced);
+				return 1;
+			}
+		}
+	}
+	printf("REFERENCE and SLICE_BY_4 match the bitwise model for 0 to %u bytes\n",
+			MAX_LENGTH);
+
+	static const uint16_t lengths[] =
+	{ 8, 64, 256, 507 };
+	printf("bytes  bitwise ns  reference ns  slice-by-4 ns  speedup\n");
+	for (size_t i = 0; i < sizeof(lengths) / sizeof(lengths[0]); i++)
+	{
+		double bitwise = time_ns(bitwise_Compute, &header, data, lengths[i]);
+		double reference = time_ns(CRC_Compute, &header, data, lengths[i]);
+		double sliced = time_ns(CRC_SliceBy4_Compute, &header, data,
+				lengths[i]);
+
+		printf("%5u  %10.1f  %12.1f  %13.1f  %6.2fx\n", lengths[i], bitwise,
+				reference, sliced, reference / sliced);
+	}
+
+	return 0;
+}
@@ -0,0 +1,17 @@
+/*
+ * Host stand-in for X-CUBE-SAFEA1/Target/safea1_conf.h, with what
+ * stsafea_crc.c needs and nothing of the board.
+ */
+#ifndef __SAFEA1_CONF_H__
+#define __SAFEA1_CONF_H__
+
+#include <stddef.h>
+#include <stdint.h>
+
+#define MCU_ERRNO_INCLUDE <stddef.h>
+#define BSP_ERROR_NONE 0
+
+// The table engines build on the host, the HW one needs the CRC unit
+#define STSAFEA_CRC_ENGINE STSAFEA_CRC_ENGINE_SLICE_BY_4
+
+#endif /* __SAFEA1_CONF_H__ */
@@ -0,0 +1,271 @@
+#!/usr/bin/env python3
+"""Picks the wolfSSL pool buckets from a recorded allocation trace.
+
+Reads the serial log of a firmware built with TLS_MEMORY_TRACE set to 1 in
+wolfSSL/wolfSSL.I-CUBE-wolfSSL_conf.h, which prints a line per allocation and
+free of the general (G) and session (S) pools:
+
+    MEMTRACE <pool> <A|F|X> <requested size> <wolfSSL type>
+
+Tools/tls_memory_trace records such a log on a host, without the board.
+
+The allocations are replayed per pool. For each pool the requested sizes,
+rounded up to the 16 byte block alignment, are split into at most 9 buckets
+so that the pool is as small as possible while every bucket holds the peak
+number of its allocations that were alive at the same time. The bucket table
+is written as Core/Inc/tls_memory_buckets.h, and the peak usage of every
+bucket is reported.
+
+See Core/Inc/tls_memory.h for the pools.
+"""
+
+import argparse
+import math
+import re
+import sys
+import textwrap
+from collections import Counter, defaultdict
+
+TRACE = re.compile(r"MEMTRACE ([GS?]) ([AFX]) (\d+) (-?\d+)")
+
+ALIGN = 16  # WOLFSSL_STATIC_ALIGN, bucket sizes must be multiples of it
+PADDING = 16  # wolfSSL_MemoryPaddingSz() on the target
+MAX_BUCKETS = 9  # WOLFMEM_MAX_BUCKETS
+IO_BUFFER_SIZE = 16992  # WOLFMEM_IO_SZ
+HEAP_OVERHEAD = 256  # WOLFSSL_HEAP and WOLFSSL_HEAP_HINT, rounded up
+
+POOLS = (("G", "general", "GENERAL"), ("S", "session", "SESSION"))
+
+HEADER = """#ifndef INC_TLS_MEMORY_BUCKETS_H_
+#define INC_TLS_MEMORY_BUCKETS_H_
+
+/*
+ * Bucket layout of the wolfSSL pools, see Core/Inc/tls_memory.h. Written by
+ * Tools/tls_memory_buckets.py from a TLS_MEMORY_TRACE log: sizes in bytes,
+ * the number of blocks of each size, and the bytes the blocks take with
+ * TLS_MEMORY_BUCKET_PADDING bytes of bookkeeping each.
+ *
+{trace}
+ */
+
+// wolfSSL_MemoryPaddingSz() on the target, a host build sets its own
+#ifndef TLS_MEMORY_BUCKET_PADDING
+#define TLS_MEMORY_BUCKET_PADDING {padding}U
+#endif
+{pools}
+#endif /* INC_TLS_MEMORY_BUCKETS_H_ */
+"""
+
+
+def align(size):
+    return max(ALIGN, (size + ALIGN - 1) // ALIGN * ALIGN)
+
+
+class Replay:
+    """Live allocations of one pool, sampled after every allocation."""
+
+    def __init__(self):
+        self.live = Counter()  # requested size -> allocations alive
+        self.aligned = Counter()  # aligned size -> allocations alive
+        self.samples = []  # copies of aligned, one per allocation
+        self.types = defaultdict(set)  # aligned size -> wolfSSL types
+        self.allocations = 0
+        self.unmatched_frees = 0
+
+    def alloc(self, size, alloc_type):
+        self.live[size] += 1
+        self.aligned[align(size)] += 1
+        self.types[align(size)].add(alloc_type)
+        self.allocations += 1
+        self.samples.append(+self.aligned)
+
+    def series(self, size):
+        """Allocations of an aligned size alive at every sample."""
+        return [sample[size] for sample in self.samples]
+
+    def free(self, size):
+        # Blocks moved by a realloc are freed without having been reported
+        if self.live[size] == 0:
+            self.unmatched_frees += 1
+            return
+        self.live[size] -= 1
+        self.aligned[align(size)] -= 1
+
+
+def read_trace(stream):
+    replays = {tag: Replay() for tag, _, _ in POOLS}
+    failures = Counter()
+
+    for line in stream:
+        match = TRACE.search(line)
+        if match is None:
+            continue
+        tag, op, size, alloc_type = match.groups()
+        size = int(size)
+        if op == "X":
+            failures[size] += 1
+        elif op == "A":
+            replays[tag].alloc(size, int(alloc_type))
+        else:
+            replays[tag].free(size)
+
+    return replays, failures
+
+
+def choose_buckets(replay, max_buckets):
+    """Splits the sorted sizes into at most max_buckets runs, each served by
+    a bucket as large as its largest size, minimising the pool size."""
+    sizes = sorted(replay.types)
+    count = len(sizes)
+    series = [replay.series(size) for size in sizes]
+
+    # peak[first][last]: most allocations of sizes[first..last] alive at once
+    peak = [[0] * count for _ in range(count)]
+    for first in range(count):
+        alive = [0] * len(replay.samples)
+        for last in range(first, count):
+            alive = [a + b for a, b in zip(alive, series[last])]
+            peak[first][last] = max(alive)
+
+    def cost(first, last):
+        return (sizes[last] + PADDING) * peak[first][last]
+
+    # best[b][i]: smallest pool serving sizes[0..i] with b buckets
+    best = [[math.inf] * count for _ in range(max_buckets + 1)]
+    split = [[-1] * count for _ in range(max_buckets + 1)]
+    for last in range(count):
+        best[1][last] = cost(0, last)
+    for buckets in range(2, max_buckets + 1):
+        for last in range(count):
+            best[buckets][last] = best[buckets - 1][last]
+            split[buckets][last] = split[buckets - 1][last]
+            for first in range(1, last + 1):
+                total = best[buckets - 1][first - 1] + cost(first, last)
+                if total < best[buckets][last]:
+                    best[buckets][last] = total
+                    split[buckets][last] = first
+
+    layout = []
+    buckets, last = max_buckets, count - 1
+    while last >= 0:
+        first = split[buckets][last] if buckets > 1 else 0
+        if first < 0:
+            first = 0
+        types = set().union(*(replay.types[s] for s in sizes[first:last + 1]))
+        layout.append((sizes[last], peak[first][last], types))
+        last = first - 1
+        buckets -= 1
+
+    return list(reversed(layout))
+
+
+def keep_apart(layout, taken):
+    """Moves bucket sizes already used by another pool up by the alignment,
+    the firmware counts usage per bucket size."""
+    result = []
+    used = set(taken)
+    for size, peak, types in layout:
+        while size in used:
+            size += ALIGN
+        used.add(size)
+        result.append((size, peak, types))
+    return result
+
+
+def main():
+    parser = argparse.ArgumentParser(description=__doc__.splitlines()[0])
+    parser.add_argument("trace", nargs="?", default="-",
+                        help="serial log with MEMTRACE lines (default: stdin)")
+    parser.add_argument("-o", "--output",
+                        help="header to write, for example "
+                             "Core/Inc/tls_memory_buckets.h (default: stdout)")
+    parser.add_argument("--margin", type=int, default=25,
+                        help="percent of blocks added to every peak "
+                             "(default: 25)")
+    parser.add_argument("--buckets", type=int, default=MAX_BUCKETS,
+                        help="buckets per pool (default: %d)" % MAX_BUCKETS)
+    parser.add_argument("--io-buffers", type=int, default=0,
+                        help="fixed I/O buffers, 2 per connection when "
+                             "TLS_MAX_FRAGMENT_LENGTH is 0 (default: 0)")
+    parser.add_argument("--region", type=int, default=224 * 1024,
+                        help="size of the TLSPOOL linker region "
+                             "(default: 229376)")
+    parser.add_argument("--note",
+                        help="what the trace covers, for the header "
+                             "(default: the trace file name)")
+    args = parser.parse_args()
+
+    stream = sys.stdin if args.trace == "-" else open(args.trace)
+    replays, failures = read_trace(stream)
+    report = sys.stderr
+
+    if failures:
+        print("%d allocations failed during the trace, the trace layouts in "
+              "Core/Src/tls_memory.c are too small for: %s" % (
+                  sum(failures.values()),
+                  ", ".join(str(s) for s in sorted(failures))), file=report)
+        return 1
+
+    pools = []
+    taken = []
+    total = 0
+    for tag, name, macro in POOLS:
+        replay = replays[tag]
+        if replay.allocations == 0:
+            print("no %s pool allocations in the trace" % name, file=report)
+            return 1
+
+        layout = keep_apart(choose_buckets(replay, args.buckets), taken)
+        taken.extend(size for size, _, _ in layout)
+
+        blocks = [math.ceil(peak * (100 + args.margin) / 100)
+                  for _, peak, _ in layout]
+        blocks_size = sum((size + PADDING) * count
+                          for (size, _, _), count in zip(layout, blocks))
+        total += blocks_size + HEAP_OVERHEAD
+
+        print("%s pool: %d allocations, %d frees without an allocation" % (
+            name, replay.allocations, replay.unmatched_frees), file=report)
+        for (size, peak, types), count in zip(layout, blocks):
+            print("  %5d byte buckets: peak %3d in use, %3d blocks, %6d bytes,"
+                  " wolfSSL types %s" % (
+                      size, peak, count, (size + PADDING) * count,
+                      ",".join(str(t) for t in sorted(types))), file=report)
+        print("  %d bytes of blocks" % blocks_size, file=report)
+
+        pools.append("\n#define TLS_MEMORY_%s_BUCKETS %s\n"
+                     "#define TLS_MEMORY_%s_DIST %s\n"
+                     "#define TLS_MEMORY_%s_BLOCKS_SIZE %dU\n" % (
+                         macro, ", ".join(str(s) for s, _, _ in layout),
+                         macro, ", ".join(str(c) for c in blocks),
+                         macro, blocks_size))
+
+    if args.io_buffers:
+        io_size = args.io_buffers * (IO_BUFFER_SIZE + PADDING) + ALIGN
+        total += io_size
+        print("I/O pool: %d bytes" % io_size, file=report)
+    print("all pools: %d of %d bytes in the TLSPOOL region" % (
+        total, args.region), file=report)
+    if total > args.region:
+        print("the pools do not fit, enlarge TLSPOOL in STM32L4S5VITX_FLASH.ld",
+              file=report)
+
+    if args.note:
+        trace = args.note
+    else:
+        trace = args.trace if args.trace != "-" else "stdin"
+    trace = textwrap.fill("Trace: %s, %d%% more blocks than the peak" % (
+        trace, args.margin), 79, initial_indent=" * ", subsequent_indent=" * ")
+    header = HEADER.format(trace=trace, padding=PADDING,
+                           pools="".join(pools))
+    if args.output:
+        with open(args.output, "w") as output:
+            output.write(header)
+    else:
+        sys.stdout.write(header)
+
+    return 0
+
+
+if __name__ == "__main__":
+    sys.exit(main())
@@ -0,0 +1,132 @@
+#!/usr/bin/env python3
+"""Stand-in TLS broker for Tools/tls_memory_trace/tls_memory_trace.c.
+
+Writes a P-256 ECDSA PKI to the given directory, with the openssl command line
+tool: a root and an intermediate CA with a server certificate for
+example.com (MQTT_BROKER_TLS_HOSTNAME), and a CA with a client certificate in
+place of the STSAFE-A110 device certificate. Then serves TLS 1.3 and 1.2 on
+localhost, asks for the client certificate, sends the TLS 1.3 session tickets
+of the ssl module and echoes what it receives, one thread per connection so
+that connections overlap as they do on the device.
+
+The broker runs in its own process, none of its memory is in the trace.
+"""
+
+import argparse
+import os
+import socket
+import ssl
+import subprocess
+import sys
+import threading
+
+HOSTNAME = "example.com"
+
+
+def openssl(*args):
+    subprocess.run(("openssl",) + args, check=True, stdout=subprocess.DEVNULL,
+                   stderr=subprocess.DEVNULL)
+
+
+def make_key(path):
+    openssl("ecparam", "-name", "prime256v1", "-genkey", "-noout", "-out", path)
+
+
+def make_ca(directory, name, issuer=None):
+    key = os.path.join(directory, name + ".key")
+    cert = os.path.join(directory, name + ".pem")
+    make_key(key)
+    if issuer is None:
+        openssl("req", "-x509", "-new", "-key", key, "-sha256", "-days", "3650",
+                "-subj", "/CN=" + name, "-addext",
+                "basicConstraints=critical,CA:true", "-out", cert)
+    else:
+        # wolfSSL takes an intermediate as CA only with keyCertSign
+        sign(directory, name, issuer, "basicConstraints=critical,CA:true\n"
+             "keyUsage=critical,keyCertSign,cRLSign")
+    return cert
+
+
+def sign(directory, name, issuer, extensions):
+    key = os.path.join(directory, name + ".key")
+    csr = os.path.join(directory, name + ".csr")
+    ext = os.path.join(directory, name + ".ext")
+    with open(ext, "w") as f:
+        f.write(extensions + "\n")
+    openssl("req", "-new", "-key", key, "-subj", "/CN=" + name, "-out", csr)
+    openssl("x509", "-req", "-in", csr, "-CA",
+            os.path.join(directory, issuer + ".pem"), "-CAkey",
+            os.path.join(directory, issuer + ".key"), "-CAcreateserial",
+            "-sha256", "-days", "3650", "-extfile", ext, "-out",
+            os.path.join(directory, name + ".pem"))
+    os.remove(csr)
+    os.remove(ext)
+
+
+def make_pki(directory):
+    os.makedirs(directory, exist_ok=True)
+    make_ca(directory, "root")
+    make_ca(directory, "intermediate", "root")
+    make_key(os.path.join(directory, HOSTNAME + ".key"))
+    sign(directory, HOSTNAME, "intermediate",
+         "subjectAltName=DNS:" + HOSTNAME)
+    make_ca(directory, "device-ca")
+    make_key(os.path.join(directory, "device.key"))
+    sign(directory, "device", "device-ca", "basicConstraints=CA:false")
+
+    # the device reads DER, as stsafea_load_client_cert hands it out
+    openssl("x509", "-in", os.path.join(directory, "device.pem"), "-outform",
+            "DER", "-out", os.path.join(directory, "device.der"))
+    openssl("ec", "-in", os.path.join(directory, "device.key"), "-outform",
+            "DER", "-out", os.path.join(directory, "device-key.der"))
+    with open(os.path.join(directory, "chain.pem"), "w") as chain:
+        for name in (HOSTNAME, "intermediate"):
+            with open(os.path.join(directory, name + ".pem")) as f:
+                chain.write(f.read())
+
+
+def serve(connection):
+    with connection:
+        try:
+            while True:
+                data = connection.recv(4096)
+                if not data:
+                    break
+                connection.sendall(data)
+        except (ssl.SSLError, OSError):
+            pass
+
+
+def main():
+    parser = argparse.ArgumentParser(description=__doc__.splitlines()[0])
+    parser.add_argument("directory", help="where the certificates are written")
+    parser.add_argument("--port", type=int, default=8883)
+    args = parser.parse_args()
+
+    make_pki(args.directory)
+
+    context = ssl.SSLContext(ssl.PROTOCOL_TLS_SERVER)
+    context.minimum_version = ssl.TLSVersion.TLSv1_2
+    context.load_cert_chain(os.path.join(args.directory, "chain.pem"),
+                            os.path.join(args.directory, HOSTNAME + ".key"))
+    context.load_verify_locations(
+        os.path.join(args.directory, "device-ca.pem"))
+    context.verify_mode = ssl.CERT_REQUIRED
+    context.set_ecdh_curve("prime256v1")
+
+    listener = socket.create_server(("127.0.0.1", args.port))
+    print("broker: listening on port", args.port, flush=True)
+
+    while True:
+        client, _ = listener.accept()
+        try:
+            connection = context.wrap_socket(client, server_side=True)
+        except (ssl.SSLError, OSError) as error:
+            print("broker: handshake failed:", error, file=sys.stderr)
+            client.close()
+            continue
+        threading.Thread(target=serve, args=(connection,), daemon=True).start()
+
+
+if __name__ == "__main__":
+    main()
@@ -0,0 +1,579 @@
+/*
+ * Records a TLS_MEMORY_TRACE log on a host for Tools/tls_memory_buckets.py.
+ * The device's wolfSSL configuration and Core/Src/tls_memory.c are built as
+ * they are, the client is set up as tlsSetup does it, and the connections
+ * follow the make-before-break reconnects of the MQTT task: every new one is
+ * made while the last one still serves, alternating full handshakes with
+ * TLS 1.3 PSK resumptions (psk_dhe_ke). The first full handshake validates
+ * the chain, the later ones are pinned; both parse the leaf into a DecodedCert
+ * as transport_pin.c does.
+ *
+ * What the STSAFE-A110 computes, the key share, ECDH and the signature with
+ * the device key, is done here in software on a heap whose buckets are in
+ * neither layout, so it stays out of the trace; the wolfCrypt calls the
+ * device callbacks make around the chip are in it. Peer signatures are
+ * verified by the host engine of the dispatch, the larger of the two.
+ *
+ * Sizes are those of a 64-bit host: structures with pointers are larger than
+ * on the Cortex-M4, so the peaks are an upper bound for the device.
+ *
+ *   W=Middlewares/Third_Party/wolfSSL_wolfSSL_wolfSSL/wolfssl
+ *   cc -O1 -DWOLFSSL_USER_SETTINGS -I Tools/tls_memory_trace -I Core/Inc \
+ *       -I $W -o tls_memory_trace Tools/tls_memory_trace/tls_memory_trace.c \
+ *       Core/Src/tls_memory.c $W/src/{internal,keys,ssl,tls,tls13,wolfio}.c \
+ *       $(find $W/wolfcrypt/src -maxdepth 1 -name '*.c' ! -name misc.c \
+ *       ! -name evp.c) -lpthread -lm
+ *   python3 Tools/tls_memory_trace/broker.py pki &
+ *   ./tls_memory_trace pki > trace.log
+ *
+ * Exits with 1 when a connection fails.
+ */
+
+#include <arpa/inet.h>
+#include <errno.h>
+#include <netinet/in.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <sys/random.h>
+#include <sys/socket.h>
+#include <time.h>
+#include <unistd.h>
+
+#include "tls_memory.h"
+
+#include "wolfssl/internal.h"
+#include "wolfssl/wolfcrypt/asn.h"
+#include "wolfssl/wolfcrypt/ecc.h"
+#include "wolfssl/wolfcrypt/memory.h"
+#include "wolfssl/wolfcrypt/random.h"
+#include "wolfssl/wolfcrypt/sha256.h"
+
+#define BROKER_HOSTNAME "example.com"
+#define BROKER_PORT 8883
+#define KEY_SIZE 32
+// Full handshake and resumption pairs after the first connection
+#define RECONNECTS 4
+// An MQTT CONNECT, a telemetry publish and a larger one
+static const int payload_sizes[] =
+{ 80, 260, 1400 };
+
+// Chip stand-in heap, bucket sizes unlike those of either pool layout
+#define CHIP_HEAP_SIZE (64U * 1024U)
+static const unsigned int chip_sizes[WOLFMEM_MAX_BUCKETS] =
+{ 96, 192, 384, 768, 1536, 3072, 6144, 12288, 24576 };
+static const unsigned int chip_dist[WOLFMEM_MAX_BUCKETS] =
+{ 24, 24, 16, 16, 4, 2, 1, 1, 0 };
+static uint8_t chip_buffer[CHIP_HEAP_SIZE];
+static WOLFSSL_HEAP_HINT *chip_heap;
+static WC_RNG chip_rng;
+static ecc_key device_key;
+static ecc_key ephemeral_key;
+
+typedef struct
+{
+	const char *name;
+	int socket;
+	WOLFSSL *ssl;
+	bool pinned;
+	bool matched;
+	uint8_t keyHash[WC_SHA256_DIGEST_SIZE];
+} Connection_t;
+
+static WOLFSSL_CTX *shared_ctx;
+static WOLFSSL_SESSION *stored_session;
+static bool pin_valid;
+static uint8_t pin_keyHash[WC_SHA256_DIGEST_SIZE];
+
+unsigned int HAL_GetTick(void)
+{
+	struct timespec ts;
+	clock_gettime(CLOCK_MONOTONIC, &ts);
+	return (unsigned int) (ts.tv_sec * 1000U + ts.tv_nsec / 1000000U);
+}
+
+int entropy_GenerateSeed(unsigned char *output, unsigned int sz)
+{
+	return getrandom(output, sz, 0) == (ssize_t) sz ? 0 : -1;
+}
+
+static bool load_file(const char *dir, const char *name, uint8_t **data,
+		long *length)
+{
+	char path[512];
+	snprintf(path, sizeof(path), "%s/%s", dir, name);
+
+	FILE *f = fopen(path, "rb");
+	if (f == NULL)
+	{
+		printf("cannot open %s\n", path);
+		return false;
+	}
+	fseek(f, 0, SEEK_END);
+	*length = ftell(f);
+	fseek(f, 0, SEEK_SET);
+	*data = malloc((size_t) *length);
+	bool read = *data != NULL
+			&& fread(*data, 1, (size_t) *length, f) == (size_t) *length;
+	fclose(f);
+
+	return read;
+}
+
+// stsafe_KeyGenCb: the chip makes the key share, the public point comes back
+static int chip_KeyGenCb(WOLFSSL *ssl, ecc_key *key, unsigned int keySz,
+		int ecc_curve, void *ctx)
+{
+	uint8_t x[KEY_SIZE], y[KEY_SIZE];
+	word32 xLen = sizeof(x), yLen = sizeof(y);
+
+	(void) ssl;
+	(void) keySz;
+	(void) ctx;
+
+	if (ecc_curve != ECC_SECP256R1)
+	{
+		return ECC_CURVE_OID_E;
+	}
+
+	wc_ecc_free(&ephemeral_key);
+	if (wc_ecc_init_ex(&ephemeral_key, chip_heap, INVALID_DEVID) != 0
+			|| wc_ecc_make_key_ex(&chip_rng, KEY_SIZE, &ephemeral_key,
+					ECC_SECP256R1) != 0
+			|| wc_ecc_export_public_raw(&ephemeral_key, x, &xLen, y, &yLen)
+					!= 0)
+	{
+		return -1;
+	}
+
+	return wc_ecc_import_unsigned(key, x, y, NULL, ECC_SECP256R1);
+}
+
+// stsafe_SharedSecretCb for TLS 1.3, the key share key is already issued
+static int chip_SharedSecretCb(WOLFSSL *ssl, ecc_key *otherKey,
+		unsigned char *pubKeyDer, word32 *pubKeySz, unsigned char *out,
+		word32 *outlen, int side, void *ctx)
+{
+	uint8_t x[KEY_SIZE], y[KEY_SIZE];
+	word32 xLen = sizeof(x), yLen = sizeof(y);
+
+	(void) pubKeyDer;
+	(void) pubKeySz;
+	(void) ctx;
+
+	if (side != WOLFSSL_CLIENT_END || wolfSSL_version(ssl) != TLS1_3_VERSION)
+	{
+		return -1;
+	}
+
+	int err = wc_ecc_export_public_raw(otherKey, x, &xLen, y, &yLen);
+	if (err != 0)
+	{
+		return err;
+	}
+
+	ecc_key peer;
+	err = wc_ecc_init_ex(&peer, chip_heap, INVALID_DEVID);
+	if (err == 0)
+	{
+		err = wc_ecc_import_unsigned(&peer, x, y, NULL, ECC_SECP256R1);
+		if (err == 0)
+		{
+			wc_ecc_set_rng(&ephemeral_key, &chip_rng);
+			err = wc_ecc_shared_secret(&ephemeral_key, &peer, out, outlen);
+		}
+		wc_ecc_free(&peer);
+	}
+	wc_ecc_free(&ephemeral_key);
+	wc_ecc_init_ex(&ephemeral_key, chip_heap, INVALID_DEVID);
+
+	return err;
+}
+
+// stsafe_SignCertificateCb: r and s from the chip, encoded by wolfCrypt
+static int chip_SignCb(WOLFSSL *ssl, const unsigned char *in,
+		unsigned int inSz, unsigned char *out, word32 *outSz,
+		const unsigned char *key, unsigned int keySz, void *ctx)
+{
+	uint8_t r[KEY_SIZE], s[KEY_SIZE];
+	mp_int mpR, mpS;
+
+	(void) ssl;
+	(void) key;
+	(void) keySz;
+	(void) ctx;
+
+	if (mp_init_multi(&mpR, &mpS, NULL, NULL, NULL, NULL) != MP_OKAY
+			|| wc_ecc_sign_hash_ex(in, inSz, &chip_rng, &device_key, &mpR,
+					&mpS) != 0
+			|| mp_to_unsigned_bin_len(&mpR, r, KEY_SIZE) != MP_OKAY
+			|| mp_to_unsigned_bin_len(&mpS, s, KEY_SIZE) != MP_OKAY)
+	{
+		return -1;
+	}
+
+	return wc_ecc_rs_raw_to_sig(r, KEY_SIZE, s, KEY_SIZE, out, outSz);
+}
+
+// stsafe_VerifyWithEngine with CRYPTO_ENGINE_HOST
+static int chip_VerifyCb(WOLFSSL *ssl, const unsigned char *sig,
+		unsigned int sigSz, const unsigned char *hash, unsigned int hashSz,
+		const unsigned char *keyDer, unsigned int keySz, int *result,
+		void *ctx)
+{
+	(void) ssl;
+	(void) ctx;
+
+	*result = 0;
+
+	ecc_key key;
+	int err = wc_ecc_init(&key);
+	if (err != 0)
+	{
+		return err;
+	}
+
+	word32 inOutIdx = 0;
+	err = wc_EccPublicKeyDecode(keyDer, &inOutIdx, &key, keySz);
+	if (err == 0)
+	{
+		err = wc_ecc_verify_hash(sig, sigSz, hash, hashSz, result, &key);
+	}
+
+	wc_ecc_free(&key);
+	return err;
+}
+
+static bool chip_Init(const char *pkiDir)
+{
+	uint8_t *der;
+	long length;
+	word32 inOutIdx = 0;
+
+	if (wc_LoadStaticMemory_ex(&chip_heap, WOLFMEM_MAX_BUCKETS, chip_sizes,
+			chip_dist, chip_buffer, sizeof(chip_buffer), WOLFMEM_GENERAL, 0)
+			!= 0 || wc_InitRng_ex(&chip_rng, chip_heap, INVALID_DEVID) != 0
+			|| !load_file(pkiDir, "device-key.der", &der, &length))
+	{
+		return false;
+	}
+
+	bool loaded = wc_ecc_init_ex(&device_key, chip_heap, INVALID_DEVID) == 0
+			&& wc_EccPrivateKeyDecode(der, &inOutIdx, &device_key,
+					(word32) length) == 0
+			&& wc_ecc_init_ex(&ephemeral_key, chip_heap, INVALID_DEVID) == 0;
+	free(der);
+
+	return loaded;
+}
+
+// pin_HashLeafKey
+static bool pin_HashLeafKey(const WOLFSSL_BUFFER_INFO *leaf, uint8_t *hash)
+{
+	DecodedCert *cert = (DecodedCert*) XMALLOC(sizeof(DecodedCert), NULL,
+			DYNAMIC_TYPE_DCERT);
+	if (cert == NULL)
+	{
+		return false;
+	}
+
+	wc_InitDecodedCert(cert, leaf->buffer, leaf->length, NULL);
+	bool hashed = wc_ParseCert(cert, CERT_TYPE, NO_VERIFY, NULL) == 0
+			&& cert->publicKey != NULL
+			&& wc_Sha256Hash(cert->publicKey, cert->pubKeySize, hash) == 0;
+	wc_FreeDecodedCert(cert);
+	XFREE(cert, NULL, DYNAMIC_TYPE_DCERT);
+
+	return hashed;
+}
+
+// pin_VerifyCb, without the chain hash and the stats
+static int pin_VerifyCb(int validated, WOLFSSL_X509_STORE_CTX *store)
+{
+	Connection_t *connection = (Connection_t*) store->userCtx;
+
+	if (!validated || store->error_depth != 0 || store->totalCerts == 0)
+	{
+		return validated;
+	}
+
+	bool hashed = pin_HashLeafKey(&store->certs[0], connection->keyHash);
+	if (!connection->pinned)
+	{
+		return validated;
+	}
+
+	connection->matched = hashed
+			&& memcmp(connection->keyHash, pin_keyHash, sizeof(pin_keyHash))
+					== 0;
+	return connection->matched;
+}
+
+// session_NewSessionCb, with the serialization of session_SaveToFlash
+static int session_NewSessionCb(WOLFSSL *ssl, WOLFSSL_SESSION *session)
+{
+	(void) ssl;
+
+	WOLFSSL_SESSION *copy = wolfSSL_NewSession(NULL);
+	if (copy == NULL || wolfSSL_DupSession(session, copy, 0) != WOLFSSL_SUCCESS)
+	{
+		if (copy != NULL)
+		{
+			wolfSSL_SESSION_free(copy);
+		}
+		printf("no memory to keep the session\n");
+		return 0;
+	}
+
+	if (stored_session != NULL)
+	{
+		wolfSSL_SESSION_free(stored_session);
+	}
+	stored_session = copy;
+
+	uint8_t blob[1024];
+	unsigned char *data = blob;
+	int length = wolfSSL_i2d_SSL_SESSION(stored_session, NULL);
+	if (length > 0 && length <= (int) sizeof(blob))
+	{
+		wolfSSL_i2d_SSL_SESSION(stored_session, &data);
+	}
+
+	return 0;
+}
+
+static int io_Recv(WOLFSSL *ssl, char *buf, int sz, void *context)
+{
+	(void) ssl;
+
+	ssize_t received = recv(*(int*) context, buf, (size_t) sz, 0);
+	if (received < 0)
+	{
+		return errno == EINTR ?
+				WOLFSSL_CBIO_ERR_WANT_READ : WOLFSSL_CBIO_ERR_GENERAL;
+	}
+
+	return received == 0 ? WOLFSSL_CBIO_ERR_CONN_CLOSE : (int) received;
+}
+
+static int io_Send(WOLFSSL *ssl, char *buf, int sz, void *context)
+{
+	(void) ssl;
+
+	ssize_t sent = send(*(int*) context, buf, (size_t) sz, MSG_NOSIGNAL);
+	return sent < 0 ? WOLFSSL_CBIO_ERR_GENERAL : (int) sent;
+}
+
+// tlsAcquireContext and loadCredentials with the STSAFE callbacks
+static bool context_Build(const char *pkiDir)
+{
+	uint8_t *rootCa, *deviceCert;
+	long rootCaSize, deviceCertSize;
+
+	if (!load_file(pkiDir, "root.pem", &rootCa, &rootCaSize)
+			|| !load_file(pkiDir, "device.der", &deviceCert, &deviceCertSize))
+	{
+		return false;
+	}
+
+	WOLFSSL_HEAP_HINT *heap = TLSMemory_SessionHeap();
+	shared_ctx = wolfSSL_CTX_new_ex(wolfSSLv23_client_method_ex(heap), heap);
+
+	bool built = shared_ctx != NULL
+			&& wolfSSL_CTX_load_verify_buffer(shared_ctx, rootCa, rootCaSize,
+					SSL_FILETYPE_PEM) == SSL_SUCCESS
+			&& wolfSSL_CTX_use_certificate_chain_buffer_format(shared_ctx,
+					deviceCert, deviceCertSize, SSL_FILETYPE_ASN1)
+					== SSL_SUCCESS;
+	free(rootCa);
+	free(deviceCert);
+	if (!built)
+	{
+		return false;
+	}
+
+	wolfSSL_CTX_SetEccVerifyCb(shared_ctx, chip_VerifyCb);
+	wolfSSL_CTX_SetEccKeyGenCb(shared_ctx, chip_KeyGenCb);
+	wolfSSL_CTX_SetEccSharedSecretCb(shared_ctx, chip_SharedSecretCb);
+	wolfSSL_CTX_SetEccSignCb(shared_ctx, chip_SignCb);
+	wolfSSL_CTX_SetDevId(shared_ctx, 0);
+	wolfSSL_CTX_UseSupportedCurve(shared_ctx, WOLFSSL_ECC_SECP256R1);
+	wolfSSL_CTX_sess_set_new_cb(shared_ctx, session_NewSessionCb);
+
+	return true;
+}
+
+// An MQTT exchange: a packet out and the broker's echo back, which also
+// brings the session tickets
+static bool connection_Exchange(Connection_t *connection, int size)
+{
+	static uint8_t sent[2048], received[2048];
+
+	memset(sent, connection->name[0], (size_t) size);
+	if (wolfSSL_write(connection->ssl, sent, size) != size)
+	{
+		return false;
+	}
+
+	for (int got = 0; got < size;)
+	{
+		int n = wolfSSL_read(connection->ssl, received + got, size - got);
+		if (n <= 0)
+		{
+			return false;
+		}
+		got += n;
+	}
+
+	return memcmp(sent, received, (size_t) size) == 0;
+}
+
+// tlsSetup, with TLS_TRANSPORT_USE_PINNING
+static bool connection_Open(Connection_t *connection, const char *name,
+		bool resume)
+{
+	memset(connection, 0, sizeof(*connection));
+	connection->name = name;
+
+	struct sockaddr_in broker =
+	{ .sin_family = AF_INET, .sin_port = htons(BROKER_PORT) };
+	inet_pton(AF_INET, "127.0.0.1", &broker.sin_addr);
+
+	connection->socket = socket(AF_INET, SOCK_STREAM, 0);
+	if (connection->socket < 0
+			|| connect(connection->socket, (struct sockaddr*) &broker,
+					sizeof(broker)) != 0)
+	{
+		printf("%s: no TCP connection to the broker\n", name);
+		return false;
+	}
+
+	WOLFSSL *ssl = wolfSSL_new(shared_ctx);
+	connection->ssl = ssl;
+	if (ssl == NULL)
+	{
+		printf("%s: wolfSSL_new failed\n", name);
+		return false;
+	}
+
+	wolfSSL_SSLSetIORecv(ssl, io_Recv);
+	wolfSSL_SSLSetIOSend(ssl, io_Send);
+	wolfSSL_SetIOReadCtx(ssl, &connection->socket);
+	wolfSSL_SetIOWriteCtx(ssl, &connection->socket);
+
+	wolfSSL_UseKeyShare(ssl, WOLFSSL_ECC_SECP256R1);
+	wolfSSL_only_dhe_psk(ssl);
+
+	connection->pinned = pin_valid;
+	wolfSSL_SetCertCbCtx(ssl, connection);
+	wolfSSL_set_verify(ssl,
+			connection->pinned ? WOLFSSL_VERIFY_NONE : WOLFSSL_VERIFY_DEFAULT,
+			pin_VerifyCb);
+
+	wolfSSL_UseSessionTicket(ssl);
+	if (resume && stored_session != NULL)
+	{
+		wolfSSL_set_session(ssl, stored_session);
+	}
+
+	if (wolfSSL_connect(ssl) != SSL_SUCCESS)
+	{
+		printf("%s: handshake failed with %d\n", name,
+				wolfSSL_get_error(ssl, 0));
+		return false;
+	}
+
+	bool reused = wolfSSL_session_reused(ssl);
+	if (!reused && connection->pinned && !connection->matched)
+	{
+		printf("%s: pinned handshake without the pinned key\n", name);
+		return false;
+	}
+	if (!reused && !connection->pinned)
+	{
+		memcpy(pin_keyHash, connection->keyHash, sizeof(pin_keyHash));
+		pin_valid = true;
+	}
+
+	printf("%s: %s %s handshake\n", name, wolfSSL_get_version(ssl),
+			reused ? "resumed" : connection->pinned ? "pinned" : "validated");
+
+	for (size_t i = 0; i < sizeof(payload_sizes) / sizeof(payload_sizes[0]);
+			i++)
+	{
+		if (!connection_Exchange(connection, payload_sizes[i]))
+		{
+			printf("%s: exchange of %d bytes failed\n", name,
+					payload_sizes[i]);
+			return false;
+		}
+	}
+
+	return true;
+}
+
+static void connection_Close(Connection_t *connection)
+{
+	if (connection->ssl != NULL)
+	{
+		TLSMemory_LogConnection(connection->ssl);
+		wolfSSL_shutdown(connection->ssl);
+		wolfSSL_free(connection->ssl);
+		connection->ssl = NULL;
+	}
+	if (connection->socket >= 0)
+	{
+		close(connection->socket);
+		connection->socket = -1;
+	}
+}
+
+int main(int argc, char **argv)
+{
+	if (argc != 2)
+	{
+		printf("usage: %s <directory of broker.py>\n", argv[0]);
+		return 2;
+	}
+	setvbuf(stdout, NULL, _IOLBF, 0);
+
+	if (!TLSMemory_Init() || wolfSSL_Init() != WOLFSSL_SUCCESS
+			|| !chip_Init(argv[1]) || !context_Build(argv[1]))
+	{
+		printf("setup failed\n");
+		return 1;
+	}
+
+	// Each connection is opened while the one before still serves
+	static const char *names[] =
+	{ "A", "B" };
+	Connection_t connections[2];
+	Connection_t *active = &connections[0];
+	Connection_t *standby = &connections[1];
+
+	if (!connection_Open(active, "first", false))
+	{
+		return 1;
+	}
+
+	for (int i = 0; i < 2 * RECONNECTS; i++)
+	{
+		// a resumption, then a full handshake as after a ticket expired
+		bool resume = i % 2 == 0;
+		if (!connection_Open(standby, names[i % 2], resume)
+				|| !connection_Exchange(active, payload_sizes[1]))
+		{
+			return 1;
+		}
+		connection_Close(active);
+
+		Connection_t *swap = active;
+		active = standby;
+		standby = swap;
+	}
+	connection_Close(active);
+
+	TLSMemory_LogUsage();
+
+	return 0;
+}
@@ -0,0 +1,29 @@
+/*
+ * Host build of the device's wolfSSL configuration: the features, math and
+ * pool settings come from wolfSSL/wolfSSL.I-CUBE-wolfSSL_conf.h unchanged,
+ * only the board, FreeRTOS and clock bindings are taken out.
+ */
+#ifndef TLS_MEMORY_TRACE_USER_SETTINGS_H
+#define TLS_MEMORY_TRACE_USER_SETTINGS_H
+
+// Picks the board branch of the configuration without its HAL
+#define STM32L4S5xx
+#include "../../wolfSSL/wolfSSL.I-CUBE-wolfSSL_conf.h"
+#undef STM32L4S5xx
+#undef WOLFSSL_STM32L4
+#undef WOLFSSL_STM32_CUBEMX
+#undef HAL_CONSOLE_UART
+#undef FREERTOS
+
+// wolfSSL_MemoryPaddingSz() with 64-bit pointers
+#define TLS_MEMORY_BUCKET_PADDING 32U
+
+// Every allocation and free of the pools is printed
+#undef TLS_MEMORY_TRACE
+#define TLS_MEMORY_TRACE 1
+#define WOLFSSL_DEBUG_MEMORY
+
+// The HAL tick, from tls_memory_trace.c
+extern unsigned int HAL_GetTick(void);
+
+#endif /* TLS_MEMORY_TRACE_USER_SETTINGS_H */
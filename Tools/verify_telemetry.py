@@ -0,0 +1,131 @@
+#!/usr/bin/env python3
+"""Verifies Merkle batched telemetry signed by the STSAFE-A110.
+
+Reads MQTT payloads published on the telemetry topic, one per line (for
+example the output of mosquitto_sub), and checks every telemetry message
+against its batch's inclusion proof and signed root. The root signature is
+checked with the public key of the device certificate (zone 0 of the chip).
+
+See Core/Inc/telemetry_signing.h for the tree layout.
+
+Requires the `cryptography` package.
+"""
+
+import argparse
+import hashlib
+import re
+import sys
+
+from cryptography import x509
+from cryptography.exceptions import InvalidSignature
+from cryptography.hazmat.primitives import hashes
+from cryptography.hazmat.primitives.asymmetric import ec, utils
+
+FIELD = re.compile(r'(\w+):(?:"([^"]*)"|(\d+))')
+
+LEAF_PREFIX = b"\x00"
+NODE_PREFIX = b"\x01"
+HASH_SIZE = 32
+
+
+def parse_payload(line):
+    fields = {}
+    for name, text, number in FIELD.findall(line):
+        fields[name] = text if number == "" else int(number)
+    return fields
+
+
+def load_public_key(path):
+    with open(path, "rb") as f:
+        data = f.read()
+    if b"-----BEGIN CERTIFICATE-----" in data:
+        cert = x509.load_pem_x509_certificate(data)
+    else:
+        cert = x509.load_der_x509_certificate(data)
+    return cert.public_key()
+
+
+def root_from_proof(payload, seq, count, proof):
+    node = hashlib.sha256(LEAF_PREFIX + payload).digest()
+    siblings = [proof[i:i + HASH_SIZE] for i in range(0, len(proof), HASH_SIZE)]
+    index = seq
+    while count > 1:
+        if index % 2 == 1:
+            node = hashlib.sha256(NODE_PREFIX + siblings.pop(0) + node).digest()
+        elif index + 1 < count:
+            node = hashlib.sha256(NODE_PREFIX + node + siblings.pop(0)).digest()
+        # else: no sibling, carried up unchanged
+        index //= 2
+        count = (count + 1) // 2
+    if siblings:
+        raise ValueError("proof longer than the tree")
+    return node
+
+
+def verify_root(public_key, root, signature):
+    r = int.from_bytes(signature[:HASH_SIZE], "big")
+    s = int.from_bytes(signature[HASH_SIZE:], "big")
+    try:
+        public_key.verify(utils.encode_dss_signature(r, s), root,
+                          ec.ECDSA(utils.Prehashed(hashes.SHA256())))
+        return True
+    except InvalidSignature:
+        return False
+
+
+def main():
+    parser = argparse.ArgumentParser(description=__doc__.splitlines()[0])
+    parser.add_argument("cert", help="device certificate, PEM or DER")
+    parser.add_argument("payloads", nargs="?", default="-",
+                        help="file with one published payload per line (default: stdin)")
+    args = parser.parse_args()
+
+    public_key = load_public_key(args.cert)
+    stream = sys.stdin if args.payloads == "-" else open(args.payloads)
+
+    messages = {}  # (batch, seq) -> payload bytes
+    proofs = {}  # (batch, seq) -> proof bytes
+    roots = {}  # batch -> (count, root, signature)
+
+    for line in stream:
+        line = line.rstrip("\r\n")
+        fields = parse_payload(line)
+        if "batch" not in fields:
+            continue
+        batch = fields["batch"]
+        if "root" in fields:
+            roots[batch] = (fields["count"], bytes.fromhex(fields["root"]),
+                            bytes.fromhex(fields["sig"]))
+        elif "proof" in fields:
+            proofs[(batch, fields["seq"])] = bytes.fromhex(fields["proof"])
+        elif "seq" in fields:
+            messages[(batch, fields["seq"])] = line.encode()
+
+    valid_roots = {}
+    for batch, (count, root, signature) in sorted(roots.items()):
+        valid_roots[batch] = verify_root(public_key, root, signature)
+        if not valid_roots[batch]:
+            print(f"batch {batch}: INVALID root signature")
+
+    failures = 0
+    for (batch, seq), payload in sorted(messages.items()):
+        if batch not in roots or (batch, seq) not in proofs:
+            print(f"batch {batch} seq {seq}: UNVERIFIED (batch not signed yet)")
+            failures += 1
+            continue
+        count, root, _ = roots[batch]
+        try:
+            matches = root_from_proof(payload, seq, count, proofs[(batch, seq)]) == root
+        except ValueError:
+            matches = False
+        if matches and valid_roots[batch]:
+            print(f"batch {batch} seq {seq}: OK")
+        else:
+            print(f"batch {batch} seq {seq}: FAILED")
+            failures += 1
+
+    return 1 if failures else 0
+
+
+if __name__ == "__main__":
+    sys.exit(main())
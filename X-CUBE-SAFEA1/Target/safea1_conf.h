@@ -63,6 +63,7 @@ extern "C" {
 #define SAFEA1_I2C_Init                BSP_I2C2_Init
 #define SAFEA1_I2C_DeInit              BSP_I2C2_DeInit
 #define SAFEA1_Delay                   HAL_Delay
+#define SAFEA1_GetTick                 HAL_GetTick
 
 /* Set to 1 to optimize RAM usage. If set to 1 the StSafeA_Handle_t.InOutBuffer used through the BSP APIs is shared
   with the application between each command & response. It means that every time the MW API returns
@@ -72,6 +73,24 @@ extern "C" {
   a right sized buffer to be passed as parameter to the BSP command API */
 #define STSAFEA_USE_OPTIMIZATION_SHARED_RAM             0U
 
+/* Set to 1 to drive the I2C bus in interrupt mode and to wait for transfer completion, command processing
+  and NACK back-off through FreeRTOS (see stsafe_i2c_rtos.h), so other tasks keep running while the
+  STSAFE-A computes. Set to 0 to use the blocking BSP functions and HAL_Delay */
+#define STSAFEA_USE_RTOS_I2C_BUS                        1U
+
+/* Set to 1 to wait, after each command, for a per command code estimate of the processing time instead of the
+  worst case STSAFEA_MS_WAIT_TIME_CMD_xxx, then poll for the response every STSAFEA_I2C_POLLING_STEP ms.
+  Estimates start at the worst case and are refined from the observed completion times */
+#define STSAFEA_USE_RESPONSE_TIME_MODEL                 1U
+
+/* CRC16 X.25 engine assigned to HwCtx.CrcInit / HwCtx.CrcCompute, one of STSAFEA_CRC_ENGINE_xxx (see stsafea_crc.h).
+  REFERENCE is the original byte at a time table lookup. SLICE_BY_4 builds four tables (2 KB of RAM) in CrcInit and
+  consumes 4 bytes per step. HW uses the STM32L4 CRC unit, which must not be used by anything else */
+#define STSAFEA_CRC_ENGINE                              STSAFEA_CRC_ENGINE_SLICE_BY_4
+
+/* I2C polling step in ms, used while the STSAFE-A1xx NACKs a response read */
+#define STSAFEA_I2C_POLLING_STEP                        1U
+
 #ifdef STSAFE_A100
 /* Set to 1 in order to use Signature Sessions.
    Set to 0 to optimize code/memory size otherwise */
@@ -37,7 +37,7 @@
 #define WOLF_CONF_WOLFCRYPT_ONLY      0
 
 /*---------- WOLF_CONF_TLS13 -----------*/
-#define WOLF_CONF_TLS13      0
+#define WOLF_CONF_TLS13      1
 
 /*---------- WOLF_CONF_TLS12 -----------*/
 #define WOLF_CONF_TLS12      1
@@ -356,9 +356,26 @@
 #define WOLFSSL_ASN_TEMPLATE
 #define HAVE_SNI
 
+/* 0: 16 KB records in fixed I/O buffers, any broker. 512, 1024, 2048 or
+ * 4096 asks for records of at most that many bytes with the
+ * max_fragment_length extension, so that one record goes out in one ES-WiFi
+ * AT send and the record buffers come from the pool buckets, see
+ * Core/Src/transport_interface_tls.c. A broker may ignore the extension and
+ * send 16 KB records, which then find no buffer and fail every handshake:
+ * only set a length for a broker known to answer it. TLSPOOL in
+ * STM32L4S5VITX_FLASH.ld can then shrink by 34 KB per connection. */
+#define HAVE_MAX_FRAGMENT
+#define TLS_MAX_FRAGMENT_LENGTH 0
+
+/* the verify callback sees the leaf of a valid chain too, the server key is
+ * pinned there, see Core/Src/transport_pin.c */
+#define WOLFSSL_ALWAYS_VERIFY_CB
+
 #if defined(WOLF_CONF_TLS13) && WOLF_CONF_TLS13 == 1
     #define WOLFSSL_TLS13
     #define HAVE_HKDF
+    /* MQTT CONNECT as 0-RTT data on resumption, see transport_interface_tls.c */
+    #define WOLFSSL_EARLY_DATA
 #endif
 #if defined(WOLF_CONF_DTLS) && WOLF_CONF_DTLS == 1
     #define WOLFSSL_DTLS
@@ -386,8 +403,13 @@
 #endif
 
 /* TLS Session Cache */
-#if 0
+#if 1
     #define SMALL_SESSION_CACHE
+    /* resumable sessions are kept across reboots, see
+     * Core/Src/transport_session.c */
+    #define HAVE_SESSION_TICKET
+    #define HAVE_EXT_CACHE /* wolfSSL_i2d_SSL_SESSION / d2i */
+    #define WOLFSSL_NO_REALLOC /* long tickets, the FreeRTOS heap has no realloc */
 #else
     #define NO_SESSION_CACHE
 #endif
@@ -618,6 +640,21 @@
 #define USE_CERT_BUFFERS_2048
 #define USE_CERT_BUFFERS_256
 
+/* ------------------------------------------------------------------------- */
+/* Static Memory */
+/* ------------------------------------------------------------------------- */
+/* Fixed bucket pools in a RAM region of their own instead of the FreeRTOS
+ * heap, see Core/Src/tls_memory.c */
+#define WOLFSSL_STATIC_MEMORY
+#define WOLFSSL_STATIC_MEMORY_DEBUG_CALLBACK
+
+/* 1 prints every pool allocation and free for Tools/tls_memory_buckets.py.
+ * WOLFSSL_DEBUG_MEMORY makes frees report the size that was asked for. */
+#define TLS_MEMORY_TRACE 0
+#if TLS_MEMORY_TRACE
+    #define WOLFSSL_DEBUG_MEMORY
+#endif
+
 /* ------------------------------------------------------------------------- */
 /* Debugging */
 /* ------------------------------------------------------------------------- */
@@ -651,6 +688,10 @@
 #if !defined(WOLF_CONF_RNG) || WOLF_CONF_RNG == 1
     /* default is enabled */
     #define HAVE_HASHDRBG
+
+    /* DRBG seeds come from the entropy pool, see Core/Src/task_entropy.c */
+    extern int entropy_GenerateSeed(unsigned char* output, unsigned int sz);
+    #define CUSTOM_RAND_GENERATE_SEED entropy_GenerateSeed
 #else /* WOLF_CONF_RNG == 0 */
     #define WC_NO_HASHDRBG
     #define WC_NO_RNG
@@ -665,7 +706,8 @@
 #if defined(WOLF_CONF_WOLFCRYPT_ONLY) && WOLF_CONF_WOLFCRYPT_ONLY == 1
     #define WOLFCRYPT_ONLY
 #endif
-//#define NO_WOLFSSL_SERVER
+/* client only, the TLS 1.3 server ticket code also needs XREALLOC */
+#define NO_WOLFSSL_SERVER
 //#define NO_WOLFSSL_CLIENT
 
 #if defined(WOLF_CONF_TEST) && WOLF_CONF_TEST == 0
@@ -694,9 +736,14 @@
 /* Base16 / Base64 encoding */
 //#define NO_CODING
 
-/* bypass certificate date checking, due to lack of properly configured RTC source */
+/* bypass certificate date checking, due to lack of properly configured RTC source.
+ * NO_ASN_TIME would also drop the session cache and tickets, which time out on
+ * the FreeRTOS tick (LowResTimer) and not on the calendar time. */
 #ifndef HAL_RTC_MODULE_ENABLED
-    #define NO_ASN_TIME
+    #define NO_ASN_TIME_CHECK
+    #define XTIME(t1) ((void) (t1), (time_t) 0)
+    /* TLS 1.3 ticket age, the HAL tick counts milliseconds since boot */
+    #define XTIME_MS(t1) ((void) (t1), HAL_GetTick())
 #endif
 
 #define HAVE_PK_CALLBACKS